@@ -0,0 +1,144 @@
+#include "BroadPhase.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BROADPHASE_SSE2 1
+#endif
+
+namespace {
+
+const size_t kPadding = 4;
+
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+// Axis along which the box centers spread the most
+int widestAxis(const std::vector<Aabb> &boxes)
+{
+    double sum[3] = { 0.0, 0.0, 0.0 }, sumSquares[3] = { 0.0, 0.0, 0.0 };
+    for(size_t i = 0; i < boxes.size(); ++i) {
+        for(int a = 0; a < 3; ++a) {
+            const double c = 0.5 * ((double)boxes[i].lo[a] + boxes[i].hi[a]);
+            sum[a] += c;
+            sumSquares[a] += c * c;
+        }
+    }
+    int best = 0;
+    double bestVariance = -1.0;
+    for(int a = 0; a < 3; ++a) {
+        const double mean = sum[a] / std::max<size_t>(boxes.size(), 1);
+        const double variance = sumSquares[a] / std::max<size_t>(boxes.size(), 1) - mean * mean;
+        if(variance > bestVariance) {
+            bestVariance = variance;
+            best = a;
+        }
+    }
+    return best;
+}
+
+}
+
+BroadPhase::BroadPhase() : sweepAxis(0), sortMoves(-1)
+{
+}
+
+void BroadPhase::update(const std::vector<Aabb> &boxes)
+{
+    const size_t count = boxes.size();
+    const int axis = widestAxis(boxes);
+
+    if(count != order.size() || axis != sweepAxis) {
+        sweepAxis = axis;
+        order.resize(count);
+        for(size_t i = 0; i < count; ++i) order[i] = (unsigned int)i;
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            return boxes[a].lo[axis] < boxes[b].lo[axis];
+        });
+        keys.resize(count);
+        for(size_t k = 0; k < count; ++k) keys[k] = boxes[order[k]].lo[axis];
+        sortMoves = -1;
+    } else {
+        // Last frame's order with this frame's values, repaired in place
+        for(size_t k = 0; k < count; ++k) keys[k] = boxes[order[k]].lo[axis];
+        sortMoves = 0;
+        for(size_t k = 1; k < count; ++k) {
+            const float key = keys[k];
+            if(!(key < keys[k - 1])) continue;
+            const unsigned int index = order[k];
+            size_t j = k;
+            do {
+                keys[j] = keys[j - 1];
+                order[j] = order[j - 1];
+                --j;
+            } while(j > 0 && key < keys[j - 1]);
+            keys[j] = key;
+            order[j] = index;
+            sortMoves += (long)(k - j);
+        }
+    }
+
+    // Sorted copies for the sweep; the padding starts past any box's end
+    const int axis1 = (axis + 1) % 3, axis2 = (axis + 2) % 3;
+    sweepLo.resize(count + kPadding);
+    sweepHi.resize(count + kPadding);
+    lo1.resize(count + kPadding);
+    hi1.resize(count + kPadding);
+    lo2.resize(count + kPadding);
+    hi2.resize(count + kPadding);
+    for(size_t k = 0; k < count; ++k) {
+        const Aabb &box = boxes[order[k]];
+        sweepLo[k] = keys[k];
+        sweepHi[k] = box.hi[axis];
+        lo1[k] = box.lo[axis1];
+        hi1[k] = box.hi[axis1];
+        lo2[k] = box.lo[axis2];
+        hi2[k] = box.hi[axis2];
+    }
+    for(size_t k = count; k < count + kPadding; ++k) {
+        sweepLo[k] = lo1[k] = lo2[k] = kInfinity;
+        sweepHi[k] = hi1[k] = hi2[k] = -kInfinity;
+    }
+}
+
+void BroadPhase::findPairs(std::vector<Pair> &pairs) const
+{
+    const size_t count = order.size();
+
+    for(size_t i = 0; i < count; ++i) {
+        const float end = sweepHi[i];
+
+#ifdef BROADPHASE_SSE2
+        const __m128 vEnd = _mm_set1_ps(end);
+        const __m128 vLo1 = _mm_set1_ps(lo1[i]), vHi1 = _mm_set1_ps(hi1[i]);
+        const __m128 vLo2 = _mm_set1_ps(lo2[i]), vHi2 = _mm_set1_ps(hi2[i]);
+
+        // Candidates start in order along the axis: once a lane starts past
+        // this box's end, so do all the following ones
+        for(size_t j = i + 1; j < count; j += 4) {
+            const __m128 started = _mm_cmple_ps(_mm_loadu_ps(&sweepLo[j]), vEnd);
+            __m128 overlap = _mm_and_ps(started, _mm_cmple_ps(_mm_loadu_ps(&lo1[j]), vHi1));
+            overlap = _mm_and_ps(overlap, _mm_cmpge_ps(_mm_loadu_ps(&hi1[j]), vLo1));
+            overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_loadu_ps(&lo2[j]), vHi2));
+            overlap = _mm_and_ps(overlap, _mm_cmpge_ps(_mm_loadu_ps(&hi2[j]), vLo2));
+
+            const int mask = _mm_movemask_ps(overlap);
+            for(int lane = 0; mask && lane < 4; ++lane) {
+                if(!(mask & (1 << lane))) continue;
+                const unsigned int a = order[i], b = order[j + lane];
+                const Pair pair = { std::min(a, b), std::max(a, b) };
+                pairs.push_back(pair);
+            }
+            if(_mm_movemask_ps(started) != 0xf) break;
+        }
+#else
+        for(size_t j = i + 1; j < count && sweepLo[j] <= end; ++j) {
+            if(lo1[j] > hi1[i] || hi1[j] < lo1[i] || lo2[j] > hi2[i] || hi2[j] < lo2[i]) continue;
+            const unsigned int a = order[i], b = order[j];
+            const Pair pair = { std::min(a, b), std::max(a, b) };
+            pairs.push_back(pair);
+        }
+#endif
+    }
+}
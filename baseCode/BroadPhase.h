@@ -0,0 +1,57 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+
+struct Aabb {
+    float lo[3];
+    float hi[3];
+};
+
+/*
+ * Sweep and prune: finds the pairs of boxes that overlap without looking
+ * at every pair.
+ *
+ * The boxes are kept sorted by their lower end on one axis, the one their
+ * centers spread the most along. The sweep then only compares a box with
+ * those starting before it ends on that axis, four at a time with SSE,
+ * testing the two other axes at once.
+ *
+ * Bodies move little from one frame to the next, so the order of the
+ * previous update is almost right: an insertion sort repairs it in close
+ * to linear time. Only a change in the number of boxes or in the axis
+ * sorts from scratch.
+ */
+class BroadPhase
+{
+public:
+    struct Pair {
+        unsigned int a, b;      // indices of the boxes, a < b
+    };
+
+    BroadPhase();
+
+    // Boxes of all the bodies, by body index
+    void update(const std::vector<Aabb> &boxes);
+
+    // Overlapping pairs as of the last update, appended in no given order
+    void findPairs(std::vector<Pair> &pairs) const;
+
+    int axis() const { return sweepAxis; }
+    // Elements moved by the last insertion sort, or -1 for a full sort
+    long lastSortMoves() const { return sortMoves; }
+
+private:
+    int sweepAxis;
+    long sortMoves;
+
+    std::vector<unsigned int> order;        // box indices, by lower end on the axis
+    std::vector<float> keys;                // lower ends, in that order
+
+    // The boxes in sorted order, one array per bound and axis: sweep first,
+    // then the two others. Padded with empty boxes for the last lanes.
+    std::vector<float> sweepLo, sweepHi;
+    std::vector<float> lo1, hi1, lo2, hi2;
+};
+
+#endif // BROADPHASE_H
@@ -0,0 +1,798 @@
+#include "Bvh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE2 1
+#endif
+
+namespace {
+
+const int kBins = 16;
+const unsigned int kMinLeafSize = 2;        // never split below this
+const unsigned int kMaxLeafSize = 8;        // always split above this
+const float kTraversalCost = 1.0f;          // relative to one triangle test
+const size_t kParallelRange = 1 << 16;      // ranges measured and binned in parallel from this size
+const int kStackSize = 128;
+// Deeper ranges are split at their median: halving 2^32 triangles at most
+// adds 32 levels, and a traversal never holds more than depth + 1 entries
+const int kMaxSahDepth = 64;
+static_assert(kMaxSahDepth + 32 + 1 <= kStackSize, "BVH traversal stack too small");
+
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+struct Box {
+    float lo[3], hi[3];
+
+    void reset()
+    {
+        for(int a = 0; a < 3; ++a) {
+            lo[a] = kInfinity;
+            hi[a] = -kInfinity;
+        }
+    }
+
+    void grow(const float p[3])
+    {
+        for(int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], p[a]);
+            hi[a] = std::max(hi[a], p[a]);
+        }
+    }
+
+    void grow(const Box &other)
+    {
+        for(int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], other.lo[a]);
+            hi[a] = std::max(hi[a], other.hi[a]);
+        }
+    }
+
+    float area() const
+    {
+        const float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        if(dx < 0.0f) return 0.0f;
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+struct Primitive {
+    Box box;
+    float centroid[3];
+};
+
+struct Bin {
+    Box box;
+    unsigned int count;
+};
+
+// Builds the nodes of one range of the triangle order, top down
+class Builder
+{
+public:
+    struct Task {
+        size_t node;
+        unsigned int begin, end;
+        int depth;
+    };
+
+    Builder(const std::vector<Primitive> &prims, std::vector<unsigned int> &order, bool parallel)
+        : prims(prims), order(order), parallel(parallel), deferred(NULL), deferBelow(0) {}
+
+    // Ranges smaller than minimum are not built but left in tasks, their node
+    // standing in as a leaf until then
+    void defer(std::vector<Task> &tasks, size_t minimum)
+    {
+        deferred = &tasks;
+        deferBelow = minimum;
+    }
+
+    void build(std::vector<Bvh::Node> &nodes, size_t node, unsigned int begin, unsigned int end, int depth);
+
+private:
+    void measure(unsigned int begin, unsigned int end, Box &bounds, Box &centroids) const;
+    void binRange(unsigned int begin, unsigned int end, const Box &centroids, Bin bins[3][kBins]) const;
+
+    static int binOf(float value, float lo, float scale)
+    {
+        return std::min(kBins - 1, std::max(0, (int)((value - lo) * scale)));
+    }
+
+    const std::vector<Primitive> &prims;
+    std::vector<unsigned int> &order;
+    bool parallel;
+    std::vector<Task> *deferred;
+    size_t deferBelow;
+};
+
+void Builder::measure(unsigned int begin, unsigned int end, Box &bounds, Box &centroids) const
+{
+    bounds.reset();
+    centroids.reset();
+    std::mutex mutex;
+    const std::function<void(size_t, size_t)> body = [&](size_t from, size_t to) {
+        Box b, c;
+        b.reset();
+        c.reset();
+        for(size_t i = begin + from; i < begin + to; ++i) {
+            const Primitive &p = prims[order[i]];
+            b.grow(p.box);
+            c.grow(p.centroid);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        bounds.grow(b);
+        centroids.grow(c);
+    };
+    if(parallel && end - begin >= kParallelRange) parallelFor(end - begin, kParallelRange / 4, body);
+    else body(0, end - begin);
+}
+
+void Builder::binRange(unsigned int begin, unsigned int end, const Box &centroids, Bin bins[3][kBins]) const
+{
+    float scale[3];
+    for(int a = 0; a < 3; ++a) {
+        const float extent = centroids.hi[a] - centroids.lo[a];
+        scale[a] = extent > 0.0f ? kBins / extent : 0.0f;
+        for(int b = 0; b < kBins; ++b) {
+            bins[a][b].box.reset();
+            bins[a][b].count = 0;
+        }
+    }
+
+    std::mutex mutex;
+    const std::function<void(size_t, size_t)> body = [&](size_t from, size_t to) {
+        Bin local[3][kBins];
+        for(int a = 0; a < 3; ++a)
+            for(int b = 0; b < kBins; ++b) {
+                local[a][b].box.reset();
+                local[a][b].count = 0;
+            }
+
+        for(size_t i = begin + from; i < begin + to; ++i) {
+            const Primitive &p = prims[order[i]];
+            for(int a = 0; a < 3; ++a) {
+                Bin &bin = local[a][binOf(p.centroid[a], centroids.lo[a], scale[a])];
+                bin.box.grow(p.box);
+                ++bin.count;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for(int a = 0; a < 3; ++a)
+            for(int b = 0; b < kBins; ++b) {
+                bins[a][b].box.grow(local[a][b].box);
+                bins[a][b].count += local[a][b].count;
+            }
+    };
+    if(parallel && end - begin >= kParallelRange) parallelFor(end - begin, kParallelRange / 4, body);
+    else body(0, end - begin);
+}
+
+void Builder::build(std::vector<Bvh::Node> &nodes, size_t node, unsigned int begin, unsigned int end, int depth)
+{
+    Box bounds, centroids;
+    measure(begin, end, bounds, centroids);
+    for(int a = 0; a < 3; ++a) {
+        nodes[node].lo[a] = bounds.lo[a];
+        nodes[node].hi[a] = bounds.hi[a];
+    }
+    nodes[node].index = begin;
+    nodes[node].count = end - begin;
+
+    const unsigned int count = end - begin;
+    if(count <= kMinLeafSize) return;
+    if(deferred && count < deferBelow) {
+        Task task = { node, begin, end, depth };
+        deferred->push_back(task);
+        return;
+    }
+
+    // Cheapest of the planes between bins: traversal plus the triangles
+    // on each side weighted by the chance a ray hits that side
+    Bin bins[3][kBins];
+    const bool sah = depth < kMaxSahDepth;
+    if(sah) binRange(begin, end, centroids, bins);
+
+    const float leafCost = (float)count;
+    const float parentArea = std::max(bounds.area(), 1e-30f);
+    float bestCost = kInfinity;
+    int bestAxis = -1, bestSplit = 0;
+    for(int a = 0; sah && a < 3; ++a) {
+        if(!(centroids.hi[a] > centroids.lo[a])) continue;
+
+        float rightArea[kBins];
+        unsigned int rightCount[kBins];
+        Box box;
+        box.reset();
+        unsigned int running = 0;
+        for(int b = kBins - 1; b > 0; --b) {
+            box.grow(bins[a][b].box);
+            running += bins[a][b].count;
+            rightArea[b] = box.area();
+            rightCount[b] = running;
+        }
+
+        box.reset();
+        running = 0;
+        for(int b = 1; b < kBins; ++b) {
+            box.grow(bins[a][b - 1].box);
+            running += bins[a][b - 1].count;
+            if(running == 0 || rightCount[b] == 0) continue;
+            const float cost = kTraversalCost + (box.area() * running + rightArea[b] * rightCount[b]) / parentArea;
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestSplit = b;
+            }
+        }
+    }
+
+    if(bestCost >= leafCost && count <= kMaxLeafSize) return;
+
+    unsigned int mid;
+    if(bestAxis < 0) {
+        // Every centroid in the same place, or too deep: any split of the
+        // order does
+        mid = begin + count / 2;
+    } else {
+        const float lo = centroids.lo[bestAxis];
+        const float scale = kBins / (centroids.hi[bestAxis] - lo);
+        const std::vector<Primitive> &p = prims;
+        mid = (unsigned int)(std::partition(order.begin() + begin, order.begin() + end, [&](unsigned int i) {
+            return binOf(p[i].centroid[bestAxis], lo, scale) < bestSplit;
+        }) - order.begin());
+        if(mid == begin || mid == end) mid = begin + count / 2;
+    }
+
+    const size_t left = nodes.size();
+    nodes.resize(left + 2);
+    nodes[node].index = (unsigned int)left;
+    nodes[node].count = 0;
+    build(nodes, left, begin, mid, depth + 1);
+    build(nodes, left + 1, mid, end, depth + 1);
+}
+
+// Entry distance of the ray into the node, if it gets in before tMax
+inline bool slab(const Bvh::Node &n, const float o[3], const float inv[3], float tMax, float &tEntry)
+{
+    float t0 = 0.0f, t1 = tMax;
+    for(int a = 0; a < 3; ++a) {
+        float tNear = (n.lo[a] - o[a]) * inv[a];
+        float tFar = (n.hi[a] - o[a]) * inv[a];
+        if(tNear > tFar) std::swap(tNear, tFar);
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+    }
+    tEntry = t0;
+    return t0 <= t1;
+}
+
+#ifdef BVH_SSE2
+struct PacketRays {
+    __m128 o[3], d[3], inv[3];
+};
+
+// Lanes entering the node before their tMax, and the nearest entry among them
+inline int slab(const Bvh::Node &n, const PacketRays &r, __m128 tMax, float &tEntry)
+{
+    __m128 t0 = _mm_setzero_ps(), t1 = tMax;
+    for(int a = 0; a < 3; ++a) {
+        const __m128 tLo = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.lo[a]), r.o[a]), r.inv[a]);
+        const __m128 tHi = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.hi[a]), r.o[a]), r.inv[a]);
+        t0 = _mm_max_ps(t0, _mm_min_ps(tLo, tHi));
+        t1 = _mm_min_ps(t1, _mm_max_ps(tLo, tHi));
+    }
+    const int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(t0, t1), _mm_cmplt_ps(t0, tMax)));
+    if(!mask) return 0;
+
+    float entries[4];
+    _mm_storeu_ps(entries, t0);
+    tEntry = kInfinity;
+    for(int lane = 0; lane < 4; ++lane)
+        if(mask & (1 << lane)) tEntry = std::min(tEntry, entries[lane]);
+    return mask;
+}
+
+inline float horizontalMax(__m128 v)
+{
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+}
+#endif
+
+struct StackEntry {
+    unsigned int node;
+    float t;
+};
+
+inline GLuint corner(const GLuint *indices, size_t triangle, int k)
+{
+    return indices ? indices[3 * triangle + k] : (GLuint)(3 * triangle + k);
+}
+
+inline float dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline float boxDistanceSquared(const Bvh::Node &n, const float p[3])
+{
+    float sum = 0.0f;
+    for(int a = 0; a < 3; ++a) {
+        const float d = std::max(std::max(n.lo[a] - p[a], p[a] - n.hi[a]), 0.0f);
+        sum += d * d;
+    }
+    return sum;
+}
+
+inline bool boxesOverlap(const Bvh::Node &n, const float lo[3], const float hi[3])
+{
+    return n.lo[0] <= hi[0] && n.hi[0] >= lo[0] && n.lo[1] <= hi[1] && n.hi[1] >= lo[1] &&
+           n.lo[2] <= hi[2] && n.hi[2] >= lo[2];
+}
+
+// Point of the triangle a, a + ab, a + ac nearest to p, found from the
+// Voronoi region p lies in (Ericson, Real-Time Collision Detection 5.1.5)
+void closestOnTriangle(const float a[3], const float ab[3], const float ac[3], const float p[3], float out[3])
+{
+    const float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    const float d1 = dot3(ab, ap), d2 = dot3(ac, ap);
+    if(d1 <= 0.0f && d2 <= 0.0f) {
+        for(int k = 0; k < 3; ++k) out[k] = a[k];
+        return;
+    }
+
+    const float bp[3] = { ap[0] - ab[0], ap[1] - ab[1], ap[2] - ab[2] };
+    const float d3 = dot3(ab, bp), d4 = dot3(ac, bp);
+    if(d3 >= 0.0f && d4 <= d3) {
+        for(int k = 0; k < 3; ++k) out[k] = a[k] + ab[k];
+        return;
+    }
+
+    const float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        const float v = d1 / (d1 - d3);
+        for(int k = 0; k < 3; ++k) out[k] = a[k] + v * ab[k];
+        return;
+    }
+
+    const float cp[3] = { ap[0] - ac[0], ap[1] - ac[1], ap[2] - ac[2] };
+    const float d5 = dot3(ab, cp), d6 = dot3(ac, cp);
+    if(d6 >= 0.0f && d5 <= d6) {
+        for(int k = 0; k < 3; ++k) out[k] = a[k] + ac[k];
+        return;
+    }
+
+    const float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        const float w = d2 / (d2 - d6);
+        for(int k = 0; k < 3; ++k) out[k] = a[k] + w * ac[k];
+        return;
+    }
+
+    const float va = d3 * d6 - d5 * d4;
+    if(va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        for(int k = 0; k < 3; ++k) out[k] = a[k] + ab[k] + w * (ac[k] - ab[k]);
+        return;
+    }
+
+    const float denom = 1.0f / (va + vb + vc);
+    const float v = vb * denom, w = vc * denom;
+    for(int k = 0; k < 3; ++k) out[k] = a[k] + v * ab[k] + w * ac[k];
+}
+
+// Separating axis test of the triangle v0, v0 + e1, v0 + e2 against the
+// box of the given center and half extents (Akenine-Moller): the box axes,
+// the triangle's normal and the nine products of an axis with an edge
+bool triangleOverlapsBox(const float v0[3], const float e1[3], const float e2[3], const float center[3],
+                         const float half[3])
+{
+    float v[3][3];
+    for(int a = 0; a < 3; ++a) {
+        v[0][a] = v0[a] - center[a];
+        v[1][a] = v[0][a] + e1[a];
+        v[2][a] = v[0][a] + e2[a];
+    }
+
+    for(int a = 0; a < 3; ++a) {
+        if(std::min(v[0][a], std::min(v[1][a], v[2][a])) > half[a]) return false;
+        if(std::max(v[0][a], std::max(v[1][a], v[2][a])) < -half[a]) return false;
+    }
+
+    const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    const float reach = half[0] * std::fabs(normal[0]) + half[1] * std::fabs(normal[1]) + half[2] * std::fabs(normal[2]);
+    if(std::fabs(dot3(normal, v[0])) > reach) return false;
+
+    const float edges[3][3] = {
+        { e1[0], e1[1], e1[2] },
+        { e2[0] - e1[0], e2[1] - e1[1], e2[2] - e1[2] },
+        { -e2[0], -e2[1], -e2[2] }
+    };
+    for(int a = 0; a < 3; ++a) {
+        for(int e = 0; e < 3; ++e) {
+            // Unit axis a crossed with the edge
+            float axis[3] = { 0.0f, 0.0f, 0.0f };
+            const int b = (a + 1) % 3, c = (a + 2) % 3;
+            axis[b] = -edges[e][c];
+            axis[c] = edges[e][b];
+
+            const float p0 = dot3(axis, v[0]), p1 = dot3(axis, v[1]), p2 = dot3(axis, v[2]);
+            const float r = half[b] * std::fabs(axis[b]) + half[c] * std::fabs(axis[c]);
+            if(std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r) return false;
+        }
+    }
+    return true;
+}
+
+}
+
+Bvh::Bvh()
+{
+}
+
+void Bvh::build(const float *positions, const GLuint *indices, size_t triangleCount)
+{
+    nodes.clear();
+    triangles.clear();
+    ids.clear();
+    if(triangleCount == 0) return;
+
+    std::vector<Primitive> prims(triangleCount);
+    parallelFor(triangleCount, 16384, [&](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; ++t) {
+            Primitive &p = prims[t];
+            p.box.reset();
+            for(int k = 0; k < 3; ++k) p.box.grow(&positions[3 * corner(indices, t, k)]);
+            for(int a = 0; a < 3; ++a) p.centroid[a] = 0.5f * (p.box.lo[a] + p.box.hi[a]);
+        }
+    });
+
+    std::vector<unsigned int> order(triangleCount);
+    for(size_t t = 0; t < triangleCount; ++t) order[t] = (unsigned int)t;
+
+    // The top of the tree, splitting until there is a subtree for every
+    // core several times over
+    std::vector<Builder::Task> tasks;
+    Builder top(prims, order, true);
+    top.defer(tasks, std::max<size_t>(4096, triangleCount / (8 * workerCount())));
+    nodes.reserve(triangleCount);
+    nodes.push_back(Node());
+    top.build(nodes, 0, 0, (unsigned int)triangleCount, 0);
+
+    // Then the subtrees, each in its own array, taken by the cores in turn
+    std::vector<std::vector<Node> > subtrees(tasks.size());
+    std::atomic<size_t> next(0);
+    parallelFor(std::min<size_t>(workerCount(), tasks.size()), 1, [&](size_t, size_t) {
+        for(size_t i = next++; i < tasks.size(); i = next++) {
+            Builder builder(prims, order, false);
+            subtrees[i].push_back(Node());
+            builder.build(subtrees[i], 0, tasks[i].begin, tasks[i].end, tasks[i].depth);
+        }
+    });
+
+    // Appended after the top; the root of each takes the place of its task's node
+    for(size_t i = 0; i < tasks.size(); ++i) {
+        const std::vector<Node> &subtree = subtrees[i];
+        const size_t base = nodes.size() - 1;   // local index 1 lands at nodes.size()
+        for(size_t j = 0; j < subtree.size(); ++j) {
+            Node n = subtree[j];
+            if(n.count == 0) n.index = (unsigned int)(base + n.index);
+            if(j == 0) nodes[tasks[i].node] = n;
+            else nodes.push_back(n);
+        }
+    }
+
+    // Triangles in leaf order
+    triangles.resize(triangleCount);
+    ids.swap(order);
+    parallelFor(triangleCount, 16384, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            const float *v0 = &positions[3 * corner(indices, ids[i], 0)];
+            const float *v1 = &positions[3 * corner(indices, ids[i], 1)];
+            const float *v2 = &positions[3 * corner(indices, ids[i], 2)];
+            Triangle &t = triangles[i];
+            for(int a = 0; a < 3; ++a) {
+                t.v0[a] = v0[a];
+                t.e1[a] = v1[a] - v0[a];
+                t.e2[a] = v2[a] - v0[a];
+            }
+        }
+    });
+}
+
+void Bvh::bounds(float lo[3], float hi[3]) const
+{
+    for(int a = 0; a < 3; ++a) {
+        lo[a] = nodes.empty() ? kInfinity : nodes[0].lo[a];
+        hi[a] = nodes.empty() ? -kInfinity : nodes[0].hi[a];
+    }
+}
+
+bool Bvh::intersect(const float origin[3], const float direction[3], float tMax, Hit &hit) const
+{
+    return traverse<false>(origin, direction, tMax, hit);
+}
+
+bool Bvh::occluded(const float origin[3], const float direction[3], float tMax) const
+{
+    Hit hit;
+    return traverse<true>(origin, direction, tMax, hit);
+}
+
+void Bvh::intersect(const RayPacket &rays, HitPacket &hits) const
+{
+    traverse<false>(rays, hits);
+}
+
+void Bvh::occluded(const RayPacket &rays, HitPacket &hits) const
+{
+    traverse<true>(rays, hits);
+}
+
+bool Bvh::closestPoint(const float point[3], float maxDistance, Closest &closest) const
+{
+    closest.distanceSquared = maxDistance * maxDistance;
+    closest.triangle = kNoHit;
+    if(nodes.empty()) return false;
+
+    StackEntry stack[kStackSize];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top++].t = boxDistanceSquared(nodes[0], point);
+
+    while(top > 0) {
+        const StackEntry entry = stack[--top];
+        if(entry.t >= closest.distanceSquared) continue;
+        const Node &n = nodes[entry.node];
+
+        if(n.count > 0) {
+            for(unsigned int i = n.index; i < n.index + n.count; ++i) {
+                const Triangle &tri = triangles[i];
+                float q[3];
+                closestOnTriangle(tri.v0, tri.e1, tri.e2, point, q);
+                const float d[3] = { q[0] - point[0], q[1] - point[1], q[2] - point[2] };
+                const float distanceSquared = dot3(d, d);
+                if(distanceSquared < closest.distanceSquared) {
+                    closest.distanceSquared = distanceSquared;
+                    closest.triangle = ids[i];
+                    for(int a = 0; a < 3; ++a) closest.point[a] = q[a];
+                }
+            }
+            continue;
+        }
+
+        // Nearer box last, so that it is searched first
+        const float da = boxDistanceSquared(nodes[n.index], point);
+        const float db = boxDistanceSquared(nodes[n.index + 1], point);
+        const bool aFirst = da <= db;
+        assert(top + 2 <= kStackSize);
+        stack[top].node = aFirst ? n.index + 1 : n.index;
+        stack[top++].t = aFirst ? db : da;
+        stack[top].node = aFirst ? n.index : n.index + 1;
+        stack[top++].t = aFirst ? da : db;
+    }
+    return closest.triangle != kNoHit;
+}
+
+bool Bvh::overlaps(const float lo[3], const float hi[3], std::vector<unsigned int> *found) const
+{
+    if(nodes.empty() || !boxesOverlap(nodes[0], lo, hi)) return false;
+    const float center[3] = { 0.5f * (lo[0] + hi[0]), 0.5f * (lo[1] + hi[1]), 0.5f * (lo[2] + hi[2]) };
+    const float half[3] = { 0.5f * (hi[0] - lo[0]), 0.5f * (hi[1] - lo[1]), 0.5f * (hi[2] - lo[2]) };
+
+    unsigned int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    bool any = false;
+
+    while(top > 0) {
+        const Node &n = nodes[stack[--top]];
+        if(n.count > 0) {
+            for(unsigned int i = n.index; i < n.index + n.count; ++i) {
+                const Triangle &tri = triangles[i];
+                if(!triangleOverlapsBox(tri.v0, tri.e1, tri.e2, center, half)) continue;
+                if(!found) return true;
+                found->push_back(ids[i]);
+                any = true;
+            }
+            continue;
+        }
+        assert(top + 2 <= kStackSize);
+        for(unsigned int child = n.index; child < n.index + 2; ++child)
+            if(boxesOverlap(nodes[child], lo, hi)) stack[top++] = child;
+    }
+    return any;
+}
+
+template <bool AnyHit>
+bool Bvh::traverse(const float o[3], const float d[3], float tMax, Hit &hit) const
+{
+    hit.t = tMax;
+    hit.u = hit.v = 0.0f;
+    hit.triangle = kNoHit;
+    if(nodes.empty()) return false;
+
+    const float inv[3] = { 1.0f / d[0], 1.0f / d[1], 1.0f / d[2] };
+    StackEntry stack[kStackSize];
+    int top = 0;
+
+    float tRoot;
+    if(!slab(nodes[0], o, inv, tMax, tRoot)) return false;
+    stack[top].node = 0;
+    stack[top++].t = tRoot;
+
+    while(top > 0) {
+        const StackEntry entry = stack[--top];
+        if(entry.t > hit.t) continue;
+        const Node &n = nodes[entry.node];
+
+        if(n.count > 0) {
+            // Moller-Trumbore
+            for(unsigned int i = n.index; i < n.index + n.count; ++i) {
+                const Triangle &tri = triangles[i];
+                const float p[3] = { d[1] * tri.e2[2] - d[2] * tri.e2[1], d[2] * tri.e2[0] - d[0] * tri.e2[2], d[0] * tri.e2[1] - d[1] * tri.e2[0] };
+                const float det = tri.e1[0] * p[0] + tri.e1[1] * p[1] + tri.e1[2] * p[2];
+                if(std::fabs(det) < 1e-12f) continue;
+                const float invDet = 1.0f / det;
+
+                const float s[3] = { o[0] - tri.v0[0], o[1] - tri.v0[1], o[2] - tri.v0[2] };
+                const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+                if(u < 0.0f || u > 1.0f) continue;
+                const float q[3] = { s[1] * tri.e1[2] - s[2] * tri.e1[1], s[2] * tri.e1[0] - s[0] * tri.e1[2], s[0] * tri.e1[1] - s[1] * tri.e1[0] };
+                const float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+                if(v < 0.0f || u + v > 1.0f) continue;
+                const float t = (tri.e2[0] * q[0] + tri.e2[1] * q[1] + tri.e2[2] * q[2]) * invDet;
+                if(t <= 0.0f || t >= hit.t) continue;
+
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = ids[i];
+                if(AnyHit) return true;
+            }
+            continue;
+        }
+
+        // Nearer child first, the farther one waits on the stack
+        float ta, tb;
+        const bool hitA = slab(nodes[n.index], o, inv, hit.t, ta);
+        const bool hitB = slab(nodes[n.index + 1], o, inv, hit.t, tb);
+        assert(top + 2 <= kStackSize);
+        if(hitA && hitB) {
+            const bool aFirst = ta <= tb;
+            stack[top].node = aFirst ? n.index + 1 : n.index;
+            stack[top++].t = aFirst ? tb : ta;
+            stack[top].node = aFirst ? n.index : n.index + 1;
+            stack[top++].t = aFirst ? ta : tb;
+        } else if(hitA || hitB) {
+            stack[top].node = hitA ? n.index : n.index + 1;
+            stack[top++].t = hitA ? ta : tb;
+        }
+    }
+    return hit.triangle != kNoHit;
+}
+
+template <bool AnyHit>
+void Bvh::traverse(const RayPacket &rays, HitPacket &out) const
+{
+#ifdef BVH_SSE2
+    for(int lane = 0; lane < 4; ++lane) {
+        out.hits[lane].t = rays.tMax[lane];
+        out.hits[lane].u = out.hits[lane].v = 0.0f;
+        out.hits[lane].triangle = kNoHit;
+    }
+    if(nodes.empty()) return;
+
+    PacketRays r;
+    for(int a = 0; a < 3; ++a) {
+        r.o[a] = _mm_load_ps(rays.origin[a]);
+        r.d[a] = _mm_load_ps(rays.direction[a]);
+        r.inv[a] = _mm_div_ps(_mm_set1_ps(1.0f), r.d[a]);
+    }
+    __m128 tClosest = _mm_load_ps(rays.tMax);
+    __m128 hitU = _mm_setzero_ps(), hitV = _mm_setzero_ps();
+    __m128i hitIndex = _mm_set1_epi32(-1);     // leaf order
+
+    StackEntry stack[kStackSize];
+    int top = 0;
+
+    float tRoot;
+    if(!slab(nodes[0], r, tClosest, tRoot)) return;
+    stack[top].node = 0;
+    stack[top++].t = tRoot;
+
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    while(top > 0) {
+        const StackEntry entry = stack[--top];
+        if(entry.t > horizontalMax(tClosest)) continue;
+        const Node &n = nodes[entry.node];
+
+        if(n.count > 0) {
+            // Moller-Trumbore, one triangle against the four rays
+            for(unsigned int i = n.index; i < n.index + n.count; ++i) {
+                const Triangle &tri = triangles[i];
+                const __m128 e1x = _mm_set1_ps(tri.e1[0]), e1y = _mm_set1_ps(tri.e1[1]), e1z = _mm_set1_ps(tri.e1[2]);
+                const __m128 e2x = _mm_set1_ps(tri.e2[0]), e2y = _mm_set1_ps(tri.e2[1]), e2z = _mm_set1_ps(tri.e2[2]);
+
+                const __m128 px = _mm_sub_ps(_mm_mul_ps(r.d[1], e2z), _mm_mul_ps(r.d[2], e2y));
+                const __m128 py = _mm_sub_ps(_mm_mul_ps(r.d[2], e2x), _mm_mul_ps(r.d[0], e2z));
+                const __m128 pz = _mm_sub_ps(_mm_mul_ps(r.d[0], e2y), _mm_mul_ps(r.d[1], e2x));
+                const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                const __m128 invDet = _mm_div_ps(one, det);
+
+                const __m128 sx = _mm_sub_ps(r.o[0], _mm_set1_ps(tri.v0[0]));
+                const __m128 sy = _mm_sub_ps(r.o[1], _mm_set1_ps(tri.v0[1]));
+                const __m128 sz = _mm_sub_ps(r.o[2], _mm_set1_ps(tri.v0[2]));
+                const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+                const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r.d[0], qx), _mm_mul_ps(r.d[1], qy)), _mm_mul_ps(r.d[2], qz)), invDet);
+                const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+                // A zero determinant gives infinities or NaNs, which fail these
+                __m128 accept = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+                accept = _mm_and_ps(accept, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                accept = _mm_and_ps(accept, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, tClosest)));
+                if(!_mm_movemask_ps(accept)) continue;
+
+                // Occlusion retires the lanes that hit: a tMax of 0 fails every later test
+                tClosest = _mm_or_ps(_mm_and_ps(accept, AnyHit ? zero : t), _mm_andnot_ps(accept, tClosest));
+                hitU = _mm_or_ps(_mm_and_ps(accept, u), _mm_andnot_ps(accept, hitU));
+                hitV = _mm_or_ps(_mm_and_ps(accept, v), _mm_andnot_ps(accept, hitV));
+                const __m128i acceptInt = _mm_castps_si128(accept);
+                hitIndex = _mm_or_si128(_mm_and_si128(acceptInt, _mm_set1_epi32((int)i)), _mm_andnot_si128(acceptInt, hitIndex));
+            }
+            if(AnyHit && _mm_movemask_ps(_mm_cmpgt_ps(tClosest, zero)) == 0) break;
+            continue;
+        }
+
+        float ta, tb;
+        const int hitA = slab(nodes[n.index], r, tClosest, ta);
+        const int hitB = slab(nodes[n.index + 1], r, tClosest, tb);
+        assert(top + 2 <= kStackSize);
+        if(hitA && hitB) {
+            const bool aFirst = ta <= tb;
+            stack[top].node = aFirst ? n.index + 1 : n.index;
+            stack[top++].t = aFirst ? tb : ta;
+            stack[top].node = aFirst ? n.index : n.index + 1;
+            stack[top++].t = aFirst ? ta : tb;
+        } else if(hitA || hitB) {
+            stack[top].node = hitA ? n.index : n.index + 1;
+            stack[top++].t = hitA ? ta : tb;
+        }
+    }
+
+    float t[4], u[4], v[4];
+    int index[4];
+    _mm_storeu_ps(t, tClosest);
+    _mm_storeu_ps(u, hitU);
+    _mm_storeu_ps(v, hitV);
+    _mm_storeu_si128((__m128i*)index, hitIndex);
+    for(int lane = 0; lane < 4; ++lane) {
+        if(index[lane] < 0) continue;
+        Hit &hit = out.hits[lane];
+        if(!AnyHit) hit.t = t[lane];
+        hit.u = u[lane];
+        hit.v = v[lane];
+        hit.triangle = ids[index[lane]];
+    }
+#else
+    for(int lane = 0; lane < 4; ++lane) {
+        const float o[3] = { rays.origin[0][lane], rays.origin[1][lane], rays.origin[2][lane] };
+        const float d[3] = { rays.direction[0][lane], rays.direction[1][lane], rays.direction[2][lane] };
+        traverse<AnyHit>(o, d, rays.tMax[lane], out.hits[lane]);
+    }
+#endif
+}
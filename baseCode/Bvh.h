@@ -0,0 +1,102 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Bounding volume hierarchy over triangles.
+ *
+ * Answers ray queries, nearest point queries and box overlap queries.
+ * Built top down, each node split where the surface area heuristic finds
+ * it cheapest among 16 candidate planes per axis (binned SAH). The upper
+ * levels are binned in parallel over all triangles; below them the subtrees
+ * are independent and built on all cores at once.
+ *
+ * Nodes are 32 bytes, the two children of a node next to each other; the
+ * triangles are copied in leaf order, as an origin and two edges, so that
+ * a leaf reads them from one contiguous run.
+ */
+class Bvh
+{
+public:
+    struct Node {
+        float lo[3];
+        unsigned int index;     // first triangle of a leaf, first child otherwise
+        float hi[3];
+        unsigned int count;     // triangles of a leaf, 0 for an inner node
+    };
+
+    struct Hit {
+        float t;
+        float u, v;             // barycentric, of the second and third vertex
+        unsigned int triangle;  // as given to build(), kNoHit if none
+    };
+
+    // Four rays traced together; they should start close to each other and
+    // point about the same way for the traversal to pay off
+    struct alignas(16) RayPacket {
+        float origin[3][4];     // x, y, z of the four rays
+        float direction[3][4];
+        float tMax[4];          // 0 for lanes to leave out
+    };
+
+    struct HitPacket {
+        Hit hits[4];
+    };
+
+    struct Closest {
+        float point[3];
+        float distanceSquared;
+        unsigned int triangle;  // as given to build(), kNoHit if none
+    };
+
+    static const unsigned int kNoHit = 0xffffffffu;
+
+    Bvh();
+
+    // positions: x, y, z per vertex; indices: three per triangle, NULL for
+    // consecutive vertices
+    void build(const float *positions, const GLuint *indices, size_t triangleCount);
+
+    // Nearest hit along origin + t * direction, t in (0, tMax)
+    bool intersect(const float origin[3], const float direction[3], float tMax, Hit &hit) const;
+    // Whether anything is hit at all, stops at the first hit found
+    bool occluded(const float origin[3], const float direction[3], float tMax) const;
+
+    // Same for four rays at a time; occlusion only fills in whether a lane
+    // hit, with the triangle set to anything but kNoHit
+    void intersect(const RayPacket &rays, HitPacket &hits) const;
+    void occluded(const RayPacket &rays, HitPacket &hits) const;
+
+    // Point of the triangles nearest to point, if one is within maxDistance
+    bool closestPoint(const float point[3], float maxDistance, Closest &closest) const;
+
+    // Whether any triangle overlaps the box [lo, hi]. With triangles given,
+    // every overlapping one is appended, otherwise the first one found ends
+    // the search.
+    bool overlaps(const float lo[3], const float hi[3], std::vector<unsigned int> *triangles = NULL) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t triangleCount() const { return triangles.size(); }
+    bool empty() const { return nodes.empty(); }
+
+    // Bounds of everything, lo > hi when empty
+    void bounds(float lo[3], float hi[3]) const;
+
+private:
+    struct Triangle {
+        float v0[3];
+        float e1[3];            // v1 - v0
+        float e2[3];            // v2 - v0
+    };
+
+    template <bool AnyHit> bool traverse(const float origin[3], const float direction[3], float tMax, Hit &hit) const;
+    template <bool AnyHit> void traverse(const RayPacket &rays, HitPacket &hits) const;
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<unsigned int> ids;      // triangle as given to build(), in leaf order
+};
+
+#endif // BVH_H
@@ -1,480 +1,618 @@
-#include "CCanvas.h"
-#include "Base.h"
-#include "Sphere.h"
-#include "Circle.h"
-
-using namespace std;
-
-float alpha = 90;
-int view = 0;
-double turret_rot = 0;
-
-struct camera {
-    double x = 0;
-    double y = 0;
-    double z = 65;
-    double dx = 0;
-    double dy = 0;
-    double dz = 64;
-    double ux = 0;
-    double uy = 1;
-    double uz = 0;
-} c;
-//-----------------------------------------------------------------------------
-
-void CCanvas::keyPressEvent(QKeyEvent *event) {
-    std::cout << "Pressed " << event->key() << std::endl;
-    double temp_x;
-    double temp_z;
-    double temp_y;
-    double ang_x;
-    double temp;
-    std::cout<<c.x<<" "<<c.y<<" "<<c.z<<endl;
-    std::cout<<c.dx<<" "<<c.dy<<" "<<c.dz<<endl;
-
-    switch(event->key()){
-    case 32: //space
-        view++;
-        view %= 3;
-        break;
-    case 83: //s
-        temp = c.z;
-        c.z += c.z - c.dz;
-        c.dz += temp - c.dz;
-        temp = c.x;
-        c.x += c.x - c.dx;
-        c.dx += temp - c.dx;
-        temp = c.y;
-        c.y += c.y - c.dy;
-        c.dy += temp - c.dy;
-        break;
-    case 87: //w
-        temp = c.z;
-        c.z -= c.z - c.dz;//1
-        c.dz -= temp - c.dz;
-        temp = c.x;
-        c.x -= c.x - c.dx;//2
-        c.dx -= temp - c.dx;
-        temp = c.y;
-        c.y -= c.y - c.dy;//2
-        c.dy -= temp - c.dy;
-        break;
-//    case 68: //d
-//        c.x+=1;
-//        c.dx+=1;
-//        break;
-//    case 65: //a
-//        c.x-=1;
-//        c.dx-=1;
-//        break;
-    case 16777235://up
-        temp_y = c.y - c.dy;
-        temp_z = c.z - c.dz;
-        ang_x = std::atan2f(temp_y,temp_z) - 0.1;
-        c.y = c.dy + std::sin(ang_x);
-        c.z = c.dz + std::cos(ang_x);
-        break;
-    case 65:
-    case 16777234://left
-        temp_x = c.x - c.dx;
-        temp_z = c.z - c.dz;
-        ang_x = std::atan2f(temp_x,temp_z) + 0.1;
-        c.x = c.dx + std::sin(ang_x);
-        c.z = c.dz + std::cos(ang_x);
-        break;
-    case 16777237://down
-        temp_y = c.y - c.dy;
-        temp_z = c.z - c.dz;
-        ang_x = std::atan2f(temp_y,temp_z) + 0.1;
-        c.y = c.dy + std::sin(ang_x);
-        c.z = c.dz + std::cos(ang_x);
-        break;
-    case 68:
-    case 16777236://right
-        temp_x = c.x - c.dx;
-        temp_z = c.z - c.dz;
-        ang_x = std::atan2f(temp_x,temp_z) - 0.1;
-        c.x = c.dx + std::sin(ang_x);
-        c.z = c.dz + std::cos(ang_x);
-        break;
-    }
-}
-void CCanvas::initializeGL()
-{
-    this->setFocusPolicy(Qt::StrongFocus);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.5f);			   // black background
-    glClearDepth(1.0f);								   // depth buffer setup
-    glEnable(GL_DEPTH_TEST);						   // enables depth testing
-    glDepthFunc(GL_LEQUAL);							   // the type of depth testing to do
-    glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST); // really nice perspective calculations
-    glShadeModel(GL_SMOOTH);
-
-    // One light source
-    glEnable(GL_LIGHTING);
-
-    glEnable(GL_LIGHT0);
-    /*
-     * The position is transformed by the modelview matrix when glLightfv is called (just as if it were
-     * a point), and it is stored in eye coordinates. If the w component of the position is 0.0,
-     * the light is treated as a directional source. Diffuse and specular lighting calculations take
-     * the light's direction, but not its actual position, into account, and attenuation is disabled.
-     * Otherwise, diffuse and specular lighting calculations are based on the actual location of the
-     * light in eye coordinates, and attenuation is enabled. The default position is (0,0,1,0); thus,
-     * the default light source is directional, parallel to, and in the direction of the -z axis.
-     */
-    GLfloat lightpos[] = {10.0, 10.0, 5.0, 5.0};
-    glLightfv(GL_LIGHT0, GL_POSITION, lightpos);
-
-
-
-    /*
-     * Before you can use the texture you need to initialize it by calling the setTexture() method.
-     * Before you can use OBJ/PLY model, you need to initialize it by calling init() method.
-     */
-    textureTrain.setTexture();
-    textureSky.setTexture();
-    body_texture.setTexture();
-    texturePlanet1.setTexture();
-    texturePlanet2.setTexture();
-    texturePlanet3.setTexture();
-    skybox.init();
-    modelTrain.init();
-    modelTrain2.init();
-    engine.init();
-    turret.init();
-    body.init();
-    wing_left.init();
-    wing_right.init();
-    tail.init();
-    logo.init();
-}
-
-//-----------------------------------------------------------------------------
-
-void CCanvas::glPerspective(const GLdouble fovy, const GLdouble aspect, const GLdouble zNear, const GLdouble zFar)
-{
-    const GLdouble d = 1.0 / tan(fovy / 360.0 * PI);
-    const GLdouble delta = zNear - zFar;
-
-    GLdouble *mat = new GLdouble[16];
-
-    mat[0] = d / aspect;
-    mat[1] = 0.0;
-    mat[2] = 0.0;
-    mat[3] = 0.0;
-
-    mat[4] = 0.0;
-    mat[5] = d;
-    mat[6] = 0.0;
-    mat[7] = 0.0;
-
-    mat[8]  = 0.0;
-    mat[9]  = 0.0;
-    mat[10] = (zNear + zFar) / delta;
-    mat[11] = -1.0;
-
-    mat[12] = 0.0;
-    mat[13] = 0.0;
-    mat[14] = 2.0 * zNear * zFar / delta;
-    mat[15] = 0.0;
-
-    glMultMatrixd(mat);
-
-    delete[] mat;
-}
-
-void CCanvas::lookAt(const GLdouble eyeX,
-                     const GLdouble eyeY,						// VP on the course slides
-                     const GLdouble eyeZ,
-                     const GLdouble centerX,
-                     const GLdouble centerY,					// q on the course slides
-                     const GLdouble centerZ,
-                     const GLdouble upX,
-                     const GLdouble upY,							// VUP on the course slides
-                     const GLdouble upZ )
-{
-    Point3d VP(eyeX, eyeY, eyeZ);
-    Point3d q(centerX, centerY, centerZ);
-    Point3d VUP(upX, upY, upZ);
-    Point3d VPN = VP-q;
-
-    // From slide 5, Lecture 13
-    Point3d z(VPN.normalized());            // z' = VPN / ||VPN||
-    Point3d x((VUP ^ z).normalized());      // x' = VUP*z / ||VUP*z||
-    Point3d y(z^x);                         // y' = z*x
-    Point3d p(VP);                          // p' = VP
-
-    GLdouble *mat = new GLdouble[16];
-
-    // TODO: set up the LookAt matrix correctly!
-    mat[0] = x.x();
-    mat[1] = y.x();
-    mat[2] = z.x();
-    mat[3] = 0.0;
-
-    mat[4] = x.y();
-    mat[5] = y.y();
-    mat[6] = z.y();
-    mat[7] = 0.0;
-
-    mat[8] = x.z();
-    mat[9] = y.z();
-    mat[10] = z.z();
-    mat[11] = 0.0;
-
-    mat[12] = -x*p;
-    mat[13] = -y*p;
-    mat[14] = -z*p;
-    mat[15] = 1.0;
-
-    glMultMatrixd(mat);
-
-    delete[] mat;
-}
-
-void CCanvas::resizeGL(int width, int height)
-{
-    // set up the window-to-viewport transformation
-    glViewport(0, 0, width, height);
-
-    // vertical camera opening angle
-    double beta = 60.0;
-
-    // aspect ratio
-    double gamma;
-    if(height > 0) gamma = width / (double)height;
-    else gamma = width;
-
-    // front and back clipping plane at
-    double n = -0.01;
-    double f = -1000.0;
-
-    // frustum corners
-    // double t = -tan(beta * 3.14159 / 360.0) * n;
-    // double b = -t;
-    // double r = gamma * t;
-    // double l = -r;
-
-    // set projection matrix
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    // glFrustum(l,r, b,t, -n,-f);
-
-    // alternatively, directly from alpha and gamma
-    glPerspective(beta, gamma, -n, -f);
-}
-
-//-----------------------------------------------------------------------------
-
-void CCanvas::setView(View _view) {
-    switch(_view) {
-    case Perspective:
-        glTranslatef(0.f, 0.f, -95.0f);
-        break;
-    case Cockpit:
-        // Maybe you want to have an option to view the scene from the train cockpit, up to you
-        glRotatef(60, 0,1,0);
-        glRotatef(10, 0,0,1);
-        glTranslatef(0.f, 0.f, -65.0f);
-        glRotatef(-90,0,1,0);
-        glTranslatef(24, 0, -10);
-        glRotatef(-alpha*100,0,1,0);
-        glTranslatef(0.f,10.f,0.0f);
-        break;
-    case Free:
-        lookAt(c.x,c.y,c.z,  c.dx,c.dy,c.dz,  c.ux,c.uy,c.uz);
-        break;
-    }
-}
-
-void CCanvas::paintGL()
-{
-    static camera c;
-    const double RADIUS = 17.1f;
-    const double INTERVAL = 0.01;
-    static float tau=35;
-    // clear screen and depth buffer
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    GLfloat amb[]  = {0.4f, 0.4f, 0.4f};
-    GLfloat diff[] = {0.7f, 0.7f, 0.7f};
-    GLfloat spec[] = {0.4f, 0.4f, 0.4f};
-    GLfloat shin = 0.0001;
-    // set model-view matrix
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    lookAt(0,0,0,  0,0,-1,  0,1,0);
-
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-    // Setup the current view
-    switch(view){
-    case 0:
-        setView(View::Perspective);
-        break;
-    case 1:
-        setView(View::Cockpit);
-        break;
-    case 2:
-        setView(View::Free);
-        break;
-    }
-
-    textureSky.bind();
-    glPushMatrix();
-    glRotated(0,0,1,0);
-    glScaled(20,20,20);
-
-    skybox.draw();
-    glPopMatrix();
-    glPushMatrix();
-    //    glRotated(180+tau,0,1,0);
-    glRotated(180,0,1,0);
-    glScaled(20,20,20);
-
-    skybox.draw();
-    glPopMatrix();
-    textureSky.unbind();
-
-    // Drawing the object with texture
-    //    textureTrain.bind();
-    // You can stack new transformation matrix if you don't want
-    // the previous transformations to apply on this object
-    glPushMatrix();
-    /*
-     * Obtaining the values of the current modelview matrix
-     *  GLfloat matrix[16];
-     *  glGetFloatv (GL_MODELVIEW_MATRIX, matrix);
-    */
-    double x = RADIUS * cos(5);
-    double y = RADIUS;
-    double z = RADIUS * sin(5);
-
-    //    glScaled(25,20,20);
-    //    glTranslatef(0.f,-1.5f,-1.0f);
-
-    //    double deltaX = z * cos(alpha) - x * sin(alpha);
-    double deltaX = 0 + cos(alpha)*RADIUS;
-    //    double deltaY = y * cos(alpha) - 20;
-    double deltaY = -15.f + sin(alpha)*RADIUS;
-    double deltaZ = -10; //+ cos(alpha)*RADIUS + sin(alpha)*RADIUS; //x * cos(alpha) + z * sin(alpha);
-    glColor3f(0.5f, 0.5f, 0.5f);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, amb);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diff);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, &shin);
-    // Look at the ObjModel class to see how the drawing is done
-
-    glScaled(2,2,2);
-    glTranslatef(0.f,-10.f,0.0f);
-    glRotatef(alpha*100,0,1,0);
-
-    glTranslatef(20, 0, 0);
-    glRotatef(180,0,1,0);
-
-    body_texture.bind();
-    body.draw();
-    body_texture.unbind();
-
-
-
-    glPushMatrix();
-    glTranslatef(0.f,2.05f,1.4f);
-    glRotatef(alpha*60,0,1,0);
-    turret.draw();
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(0.f,0.f,-8.2f);
-    glRotatef(180, 0, 1, -0.1f);
-    engine.draw();
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(0.f, 2.98f, -7.2f);
-    glRotatef(270,0,1,0);
-    glRotatef(7,0,0,1);
-    tail.draw();
-    glTranslatef(0.81f,-0.46f,0);
-    glScalef(1.12,1.12,1);
-    glRotatef(alpha*30, 0, 0, 1);
-    logo.draw();
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(2.8,0,0);
-    glTranslatef(-0.2,-0.8,-5);
-    glRotatef(95,0,1,0);
-    glRotatef(185,0,0,1);
-    glRotatef(-10, 50,1,0);
-    glRotatef(-10,0,1,0);
-    wing_left.draw();
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(-2.1,0,0);
-    glTranslatef(-0.45,-0.9,-5.1);
-    glRotatef(90,0,1,0);
-    glRotatef(180,0,0,1);
-    glRotatef(-22, 1,1,0);
-    glRotatef(210,1,0,0);
-    glRotatef(-30,0,1,0);
-    glRotatef(0,0,0,1);
-    wing_right.draw();
-    glPopMatrix();
-
-    tau+=1;
-
-    alpha+=INTERVAL;
-    // Look at the PlyModel class to see how the drawing is done
-    /*
-     * The models you load can have different scales. If you are drawing a proper model but nothing
-     * is shown, check the scale of the model, your camera could be for example inside of it.
-     */
-    //glScalef(0.02f, 0.02f, 0.02f);
-    //modelTrain2.draw();
-    // Remove the last transformation matrix from the stack - you have drawn your last
-    // object with a new transformation and now you go back to the previous one
-    glPopMatrix();
-    //    textureTrain.unbind();
-    texturePlanet1.bind();
-    glPushMatrix();
-    glScaled(20,20,20);
-    glTranslatef(0.f,-1.5f,0);
-    glRotatef(-tau/10,0.f,1.f,0.f);
-    Sphere s(200, 200);
-    s.draw();
-    glPopMatrix();
-    texturePlanet1.unbind();
-
-    textureTrain.bind();
-    glPushMatrix();
-    glScaled(10,10, 10);
-    glTranslatef(12.f,5.f,-20.0f);
-    glRotatef(-tau,0.f,1.f,0.f);
-    Sphere planet1(40, 40);
-    planet1.draw();
-    glPopMatrix();
-    textureTrain.unbind();
-
-    texturePlanet2.bind();
-    glPushMatrix();
-    glScaled(10,10, 10);
-    glTranslatef(-5.f,5.f,10.0f);
-    glRotatef(-tau/5,0.f,1.f,0.f);
-    Sphere planet2(40, 40);
-    planet2.draw();
-    glPopMatrix();
-    texturePlanet2.unbind();
-
-    texturePlanet3.bind();
-    glPushMatrix();
-    glTranslatef(-10.f,9.f,0.0f);
-    glScaled(4,4, 4);
-    glRotatef(-tau/10,0.f,1.f,0.f);
-    Sphere planet3(40, 40);
-    planet3.draw();
-    glPopMatrix();
-    texturePlanet3.unbind();
-
-}
+#include "CCanvas.h"
+#include "Base.h"
+#include "Circle.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Animation, advanced by the builder thread only
+float alpha = 90;
+float tau = 35;
+
+int view = 0;
+double turret_rot = 0;
+
+camera c;
+//-----------------------------------------------------------------------------
+
+void CCanvas::keyPressEvent(QKeyEvent *event) {
+    LOG_DEBUG("Pressed %d", event->key());
+    double temp_x;
+    double temp_z;
+    double temp_y;
+    double ang_x;
+    double temp;
+    LOG_DEBUG("%g %g %g", c.x, c.y, c.z);
+    LOG_DEBUG("%g %g %g", c.dx, c.dy, c.dz);
+
+    switch(event->key()){
+    case 72: //h
+        profiler.setOverlayVisible(!profiler.isOverlayVisible());
+        break;
+    case 80: //p
+        if(profiler.isCsvRecording()) profiler.stopCsv();
+        else profiler.startCsv(global_path + "/frame_profile.csv");
+        break;
+    case 70: //f
+        sortOpaque = !sortOpaque;
+        break;
+    case 90: //z
+        depthPrepass = !depthPrepass;
+        break;
+    case 84: //t
+        traceRequested = true;
+        break;
+    case 79: //o
+        showGuides = !showGuides;
+        break;
+    case 32: //space
+        view++;
+        view %= 3;
+        break;
+    case 83: //s
+        temp = c.z;
+        c.z += c.z - c.dz;
+        c.dz += temp - c.dz;
+        temp = c.x;
+        c.x += c.x - c.dx;
+        c.dx += temp - c.dx;
+        temp = c.y;
+        c.y += c.y - c.dy;
+        c.dy += temp - c.dy;
+        break;
+    case 87: //w
+        temp = c.z;
+        c.z -= c.z - c.dz;//1
+        c.dz -= temp - c.dz;
+        temp = c.x;
+        c.x -= c.x - c.dx;//2
+        c.dx -= temp - c.dx;
+        temp = c.y;
+        c.y -= c.y - c.dy;//2
+        c.dy -= temp - c.dy;
+        break;
+//    case 68: //d
+//        c.x+=1;
+//        c.dx+=1;
+//        break;
+//    case 65: //a
+//        c.x-=1;
+//        c.dx-=1;
+//        break;
+    case 16777235://up
+        temp_y = c.y - c.dy;
+        temp_z = c.z - c.dz;
+        ang_x = std::atan2f(temp_y,temp_z) - 0.1;
+        c.y = c.dy + std::sin(ang_x);
+        c.z = c.dz + std::cos(ang_x);
+        break;
+    case 65:
+    case 16777234://left
+        temp_x = c.x - c.dx;
+        temp_z = c.z - c.dz;
+        ang_x = std::atan2f(temp_x,temp_z) + 0.1;
+        c.x = c.dx + std::sin(ang_x);
+        c.z = c.dz + std::cos(ang_x);
+        break;
+    case 16777237://down
+        temp_y = c.y - c.dy;
+        temp_z = c.z - c.dz;
+        ang_x = std::atan2f(temp_y,temp_z) + 0.1;
+        c.y = c.dy + std::sin(ang_x);
+        c.z = c.dz + std::cos(ang_x);
+        break;
+    case 68:
+    case 16777236://right
+        temp_x = c.x - c.dx;
+        temp_z = c.z - c.dz;
+        ang_x = std::atan2f(temp_x,temp_z) - 0.1;
+        c.x = c.dx + std::sin(ang_x);
+        c.z = c.dz + std::cos(ang_x);
+        break;
+    }
+}
+void CCanvas::initializeGL()
+{
+    this->setFocusPolicy(Qt::StrongFocus);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.5f);			   // black background
+    glClearDepth(1.0f);								   // depth buffer setup
+    glState.enable(GL_DEPTH_TEST);					   // enables depth testing
+    glDepthFunc(GL_LEQUAL);							   // the type of depth testing to do
+    glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST); // really nice perspective calculations
+    glShadeModel(GL_SMOOTH);
+    glState.enable(GL_NORMALIZE);					   // scaled models and quantized vertices need unit normals
+
+    // One light source
+    glState.enable(GL_LIGHTING);
+
+    glState.enable(GL_LIGHT0);
+    /*
+     * The position is transformed by the modelview matrix when glLightfv is called (just as if it were
+     * a point), and it is stored in eye coordinates. If the w component of the position is 0.0,
+     * the light is treated as a directional source. Diffuse and specular lighting calculations take
+     * the light's direction, but not its actual position, into account, and attenuation is disabled.
+     * Otherwise, diffuse and specular lighting calculations are based on the actual location of the
+     * light in eye coordinates, and attenuation is enabled. The default position is (0,0,1,0); thus,
+     * the default light source is directional, parallel to, and in the direction of the -z axis.
+     */
+    GLfloat lightpos[] = {10.0, 10.0, 5.0, 5.0};
+    glLightfv(GL_LIGHT0, GL_POSITION, lightpos);
+    softRaster.setLight(lightpos);
+    stillTracer.setLight(lightpos);
+
+
+
+    /*
+     * Textures are loaded, and shared, by the texture manager.
+     * Before you can use OBJ/PLY model, you need to initialize it by calling init() method.
+     */
+    textures.setBudget((size_t)texture_budget_mb << 20);
+    body_texture = textures.acquire(global_path + "/../images/body.png");
+    // The software path samples whole images, not streamed tiles
+    useVirtualPlanet = !software_rasterizer && planetTiles.open(global_path + "/../images/train1.vtex");
+    if(!useVirtualPlanet) texturePlanet1 = textures.acquire(global_path + "/../images/train1.jpg");
+
+    earthRegion = planetAtlas.add(global_path + "/../images/earth.jpg");
+    moonRegion = planetAtlas.add(global_path + "/../images/moon.png");
+    plutonRegion = planetAtlas.add(global_path + "/../images/pluton.png");
+    if(!planetAtlas.build()) {
+        textureTrain = textures.acquire(global_path + "/../images/earth.jpg");
+        texturePlanet2 = textures.acquire(global_path + "/../images/moon.png");
+        texturePlanet3 = textures.acquire(global_path + "/../images/pluton.png");
+    }
+    sky.init();
+    worldLines.init();
+    hudLines.init();
+    modelTrain.init();
+    modelTrain2.init();
+    engine.init();
+    turret.init();
+    body.init();
+    wing_left.init();
+    wing_right.init();
+    tail.init();
+    logo.init();
+
+    profiler.init();
+
+    // Everything the builder reads is loaded by now
+    startBuilder();
+}
+
+//-----------------------------------------------------------------------------
+
+void CCanvas::lookAt(Matrix4 &target,
+                     const GLdouble eyeX,
+                     const GLdouble eyeY,						// VP on the course slides
+                     const GLdouble eyeZ,
+                     const GLdouble centerX,
+                     const GLdouble centerY,					// q on the course slides
+                     const GLdouble centerZ,
+                     const GLdouble upX,
+                     const GLdouble upY,							// VUP on the course slides
+                     const GLdouble upZ )
+{
+    // From slide 5, Lecture 13: z' = VPN / ||VPN||, x' = VUP*z / ||VUP*z||, y' = z*x
+    target.multiply(Matrix4::lookAt(Vec3(eyeX, eyeY, eyeZ), Vec3(centerX, centerY, centerZ), Vec3(upX, upY, upZ)));
+}
+
+void CCanvas::resizeGL(int width, int height)
+{
+    // set up the window-to-viewport transformation
+    glViewport(0, 0, width, height);
+
+    // vertical camera opening angle
+    double beta = 60.0;
+
+    // aspect ratio
+    double gamma;
+    if(height > 0) gamma = width / (double)height;
+    else gamma = width;
+
+    // front and back clipping plane at
+    double n = -0.01;
+    double f = -1000.0;
+
+    // frustum corners
+    // double t = -tan(beta * 3.14159 / 360.0) * n;
+    // double b = -t;
+    // double r = gamma * t;
+    // double l = -r;
+
+    // set projection matrix
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    // glFrustum(l,r, b,t, -n,-f);
+
+    // alternatively, directly from alpha and gamma
+    projection = Matrix4::perspective(beta, gamma, -n, -f);
+    glLoadMatrixf(projection.m);
+    planetTiles.resize(width, height);
+    softRaster.resize(width, height);
+    softRaster.setProjection(projection);
+
+    // Lets the models pick their level of detail from their size on screen
+    ObjModel::setLodProjection(height / (2.0 * tan(beta / 360.0 * PI)));
+}
+
+//-----------------------------------------------------------------------------
+
+void CCanvas::setView(Matrix4 &matrix, View _view, const camera &c, float alpha) {
+    switch(_view) {
+    case Perspective:
+        matrix.translate(0.f, 0.f, -95.0f);
+        break;
+    case Cockpit:
+        // Maybe you want to have an option to view the scene from the train cockpit, up to you
+        matrix.rotate(60, 0,1,0);
+        matrix.rotate(10, 0,0,1);
+        matrix.translate(0.f, 0.f, -65.0f);
+        matrix.rotate(-90,0,1,0);
+        matrix.translate(24, 0, -10);
+        matrix.rotate(-alpha*100,0,1,0);
+        matrix.translate(0.f,10.f,0.0f);
+        break;
+    case Free:
+        lookAt(matrix, c.x,c.y,c.z,  c.dx,c.dy,c.dz,  c.ux,c.uy,c.uz);
+        break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CCanvas::startBuilder()
+{
+    // In the order of collisionNames
+    collisions.addObject(&body);
+    collisions.addObject(&bigSphere);
+    collisions.addObject(&smallSphere);
+    collisions.addObject(&smallSphere);
+    collisions.addObject(&smallSphere);
+
+    builderRunning = true;
+    builder = std::thread(&CCanvas::builderLoop, this);
+}
+
+void CCanvas::stopBuilder()
+{
+    if(!builder.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(builderMutex);
+        builderRunning = false;
+    }
+    builderWake.notify_one();
+    builder.join();
+}
+
+void CCanvas::requestFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(builderMutex);
+        ++requestedFrames;
+    }
+    builderWake.notify_one();
+}
+
+void CCanvas::builderLoop()
+{
+    unsigned long built = 0;
+    for(;;) {
+        {
+            // The mutex only parks the idle builder, the frames themselves
+            // go through the triple buffers
+            std::unique_lock<std::mutex> lock(builderMutex);
+            builderWake.wait(lock, [&] { return !builderRunning || requestedFrames != built; });
+            if(!builderRunning) return;
+            built = requestedFrames;
+        }
+
+        inputs.update();
+        FramePacket &packet = packets.back();
+        buildFrame(inputs.front(), packet);
+        packets.publish();
+    }
+}
+
+void CCanvas::buildFrame(const SceneInput &input, FramePacket &packet)
+{
+    const double INTERVAL = 0.01;
+
+    // set model-view matrix
+    packet.view = Matrix4::identity();
+    lookAt(packet.view, 0,0,0,  0,0,-1,  0,1,0);
+
+    // Setup the current view
+    switch(input.view){
+    case 0:
+        setView(packet.view, View::Perspective, input.c, alpha);
+        break;
+    case 1:
+        setView(packet.view, View::Cockpit, input.c, alpha);
+        break;
+    case 2:
+        setView(packet.view, View::Free, input.c, alpha);
+        break;
+    }
+
+    Frustum frustum;
+    frustum.extract(input.projection);
+
+    // Only the matrices are computed here, the GL thread draws the list as is
+    DrawList &opaque = packet.opaque;
+    opaque.clear();
+
+    Matrix4 ship = packet.view;
+    ship.scale(2,2,2);
+    ship.translate(0.f,-10.f,0.0f);
+    ship.rotate(alpha*100,0,1,0);
+
+    ship.translate(20, 0, 0);
+    ship.rotate(180,0,1,0);
+    opaque.add(ship, &body, &body_texture, "ship/body", false, &frustum);
+    collisions.setTransform(0, ship);
+
+    Matrix4 part = ship;
+    part.translate(0.f,2.05f,1.4f);
+    part.rotate(alpha*60,0,1,0);
+    opaque.add(part, &turret, NULL, "ship/turret", false, &frustum);
+
+    part = ship;
+    part.translate(0.f,0.f,-8.2f);
+    part.rotate(180, 0, 1, -0.1f);
+    opaque.add(part, &engine, NULL, "ship/engine", false, &frustum);
+
+    part = ship;
+    part.translate(0.f, 2.98f, -7.2f);
+    part.rotate(270,0,1,0);
+    part.rotate(7,0,0,1);
+    opaque.add(part, &tail, NULL, "ship/tail", false, &frustum);
+    part.translate(0.81f,-0.46f,0);
+    part.scale(1.12,1.12,1);
+    part.rotate(alpha*30, 0, 0, 1);
+    opaque.add(part, &logo, NULL, "ship/logo", false, &frustum);
+
+    part = ship;
+    part.translate(2.8,0,0);
+    part.translate(-0.2,-0.8,-5);
+    part.rotate(95,0,1,0);
+    part.rotate(185,0,0,1);
+    part.rotate(-10, 50,1,0);
+    part.rotate(-10,0,1,0);
+    opaque.add(part, &wing_left, NULL, "ship/wing_left", false, &frustum);
+
+    part = ship;
+    part.translate(-2.1,0,0);
+    part.translate(-0.45,-0.9,-5.1);
+    part.rotate(90,0,1,0);
+    part.rotate(180,0,0,1);
+    part.rotate(-22, 1,1,0);
+    part.rotate(210,1,0,0);
+    part.rotate(-30,0,1,0);
+    part.rotate(0,0,0,1);
+    opaque.add(part, &wing_right, NULL, "ship/wing_right", false, &frustum);
+
+    // Look at the PlyModel class to see how the drawing is done
+    /*
+     * The models you load can have different scales. If you are drawing a proper model but nothing
+     * is shown, check the scale of the model, your camera could be for example inside of it.
+     */
+    //glScalef(0.02f, 0.02f, 0.02f);
+    //modelTrain2.draw();
+
+    // The big planet covers a good part of the screen: worth a depth pre-pass
+    Matrix4 planet = packet.view;
+    planet.scale(20,20,20);
+    planet.translate(0.f,-1.5f,0);
+    planet.rotate(-tau/10,0.f,1.f,0.f);
+    if(useVirtualPlanet) opaque.add(planet, &virtualPlanet, NULL, "planet/train", true, &frustum);
+    else opaque.add(planet, &bigSphere, &texturePlanet1, "planet/train", true, &frustum);
+    collisions.setTransform(1, planet);
+
+    planet = packet.view;
+    planet.scale(10,10, 10);
+    planet.translate(12.f,5.f,-20.0f);
+    planet.rotate(-tau,0.f,1.f,0.f);
+    if(planetAtlas.isBuilt()) opaque.addAtlased(planet, &smallSphere, earthRegion, "planet/earth", false, &frustum);
+    else opaque.add(planet, &smallSphere, &textureTrain, "planet/earth", false, &frustum);
+    collisions.setTransform(2, planet);
+
+    planet = packet.view;
+    planet.scale(10,10, 10);
+    planet.translate(-5.f,5.f,10.0f);
+    planet.rotate(-tau/5,0.f,1.f,0.f);
+    if(planetAtlas.isBuilt()) opaque.addAtlased(planet, &smallSphere, moonRegion, "planet/moon", false, &frustum);
+    else opaque.add(planet, &smallSphere, &texturePlanet2, "planet/moon", false, &frustum);
+    collisions.setTransform(3, planet);
+
+    planet = packet.view;
+    planet.translate(-10.f,9.f,0.0f);
+    planet.scale(4,4, 4);
+    planet.rotate(-tau/10,0.f,1.f,0.f);
+    if(planetAtlas.isBuilt()) opaque.addAtlased(planet, &smallSphere, plutonRegion, "planet/pluton", false, &frustum);
+    else opaque.add(planet, &smallSphere, &texturePlanet3, "planet/pluton", false, &frustum);
+    collisions.setTransform(4, planet);
+
+    if(input.sortOpaque) opaque.sortFrontToBack();
+
+    // The view moves everything alike, eye space does as well as the world
+    reportCollisions();
+
+    tau+=1;
+    alpha+=INTERVAL;
+
+    packet.index = ++builtFrames;
+}
+
+void CCanvas::reportCollisions()
+{
+    static const char *const collisionNames[] = {
+        "ship/body", "planet/train", "planet/earth", "planet/moon", "planet/pluton"
+    };
+
+    contacts.clear();
+    collisions.collide(contacts);
+
+    std::vector<std::pair<unsigned int, unsigned int> > now;
+    for(size_t i = 0; i < contacts.size(); ++i) {
+        const CollisionWorld::Contact &contact = contacts[i];
+        now.push_back(std::make_pair(contact.a, contact.b));
+        if(std::find(touching.begin(), touching.end(), now.back()) == touching.end())
+            LOG_INFO("collision: %s with %s, %.2f deep", collisionNames[contact.a], collisionNames[contact.b],
+                     contact.depth);
+    }
+    touching.swap(now);
+}
+
+void CCanvas::paintGL()
+{
+    profiler.beginFrame();
+    textures.beginFrame();
+    planetTiles.beginFrame();
+
+    // Hand the latest input to the builder, take the latest finished frame
+    // and let the builder start on the next one while this one is drawn
+    SceneInput &input = inputs.back();
+    input.view = view;
+    input.c = c;
+    input.sortOpaque = sortOpaque;
+    input.projection = projection;
+    inputs.publish();
+
+    packets.update();
+    requestFrame();
+    FramePacket &packet = packets.front();
+
+    // clear screen and depth buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if(packet.index == 0) {
+        // Nothing built yet
+        profiler.endFrame();
+        return;
+    }
+
+    GLfloat amb[]  = {0.4f, 0.4f, 0.4f, 1.0f};
+    GLfloat diff[] = {0.7f, 0.7f, 0.7f, 1.0f};
+    GLfloat spec[] = {0.4f, 0.4f, 0.4f, 1.0f};
+    GLfloat shin = 0.0001;
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(packet.view.m);
+
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    glColor3f(0.5f, 0.5f, 0.5f);
+    glState.material(GL_FRONT_AND_BACK, GL_AMBIENT, amb);
+    glState.material(GL_FRONT_AND_BACK, GL_DIFFUSE, diff);
+    glState.material(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
+    glState.material(GL_FRONT_AND_BACK, GL_SHININESS, &shin);
+
+    stillTracer.setMaterial(amb, diff, spec, shin);
+
+    // Look at the ObjModel class to see how the drawing is done
+    if(software_rasterizer) {
+        softRaster.setMaterial(amb, diff, spec, shin);
+        packet.opaque.drawSoftware(softRaster);
+        ProfileScope scope("software present");
+        softRaster.present();
+    } else {
+        packet.opaque.draw(depthPrepass);
+    }
+
+    if(showGuides) {
+        // The ship flies around (0, -20, 0) at 2 * 20 units, see buildFrame()
+        static const GLubyte orbitColor[4] = { 90, 160, 255, 255 };
+        shipOrbit.draw(worldLines, Point3f(0, -20, 0), Point3f(1, 0, 0), Point3f(0, 0, 1), orbitColor);
+    }
+    profiler.beginSection("lines");
+    worldLines.flush();
+    profiler.endSection();
+
+    // The sky goes last, the depth test rejects everything already covered
+    profiler.beginSection("skybox");
+    sky.draw();
+    profiler.endSection();
+
+    if(showGuides) {
+        static const GLubyte reticleColor[4] = { 255, 255, 255, 160 };
+        reticle.draw(hudLines, width() / 2.0f, height() / 2.0f, reticleColor);
+
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0, width(), height(), 0, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        glState.disable(GL_DEPTH_TEST);
+        hudLines.flush();
+        glState.enable(GL_DEPTH_TEST);
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+
+    profiler.endFrame();
+    profiler.drawOverlay(this);
+
+    if(traceRequested) {
+        traceRequested = false;
+        traceStill(packet);
+    }
+}
+
+bool CCanvas::pick(int x, int y, DrawList::Pick &picked)
+{
+    const FramePacket &packet = packets.front();
+    if(packet.index == 0 || width() <= 0 || height() <= 0) return false;
+
+    // Through the pixel center, from the near plane to the far plane
+    const Matrix4 inverse = projection.inverse();
+    const float ndcX = 2.0f * (x + 0.5f) / width() - 1.0f;
+    const float ndcY = 1.0f - 2.0f * (y + 0.5f) / height();
+    const Vec4 nearPoint = inverse.transform(Vec4(ndcX, ndcY, -1.0f, 1.0f));
+    const Vec4 farPoint = inverse.transform(Vec4(ndcX, ndcY, 1.0f, 1.0f));
+    const Vec3 from(nearPoint.x / nearPoint.w, nearPoint.y / nearPoint.w, nearPoint.z / nearPoint.w);
+    const Vec3 to(farPoint.x / farPoint.w, farPoint.y / farPoint.w, farPoint.z / farPoint.w);
+    const Vec3 direction = normalized(to - from);
+
+    const float origin[3] = { from.x, from.y, from.z };
+    const float unit[3] = { direction.x, direction.y, direction.z };
+    return packet.opaque.pick(origin, unit, picked) && picked.distance <= length(to - from);
+}
+
+void CCanvas::mousePressEvent(QMouseEvent *event)
+{
+    DrawList::Pick picked;
+    if(pick(event->x(), event->y(), picked))
+        LOG_INFO("picked %s at %.2f from the near plane (triangle %d)", picked.name, picked.distance,
+                 picked.triangle == Bvh::kNoHit ? -1 : (int)picked.triangle);
+    else
+        LOG_INFO("picked nothing at %d, %d", event->x(), event->y());
+}
+
+void CCanvas::traceStill(const FramePacket &packet)
+{
+    stillTracer.clear();
+    stillTracer.setProjection(projection);
+    stillTracer.setEnvironment(sky.imagePath(), packet.view);
+    packet.opaque.gather(stillTracer);
+
+    const int w = width(), h = height();
+    std::vector<unsigned int> pixels;
+    TraceStats stats;
+    stillTracer.render(w, h, pixels, stats);
+    if(pixels.empty()) return;
+
+    QImage image(w, h, QImage::Format_RGB32);
+    for(int y = 0; y < h; ++y) memcpy(image.scanLine(y), &pixels[(size_t)y * w], (size_t)w * 4);
+    const std::string path = global_path + "/trace_" + std::to_string(packet.index) + ".png";
+    if(!image.save(path.c_str())) LOG_WARNING("cannot write %s", path);
+
+    LOG_INFO("traced %s: %zu triangles, BVH of %zu nodes built in %.1f ms, %llu rays in %.1f ms (%.2f Mrays/s)",
+             path, stats.triangles, stats.nodes, stats.buildMs, stats.rays, stats.traceMs,
+             stats.raysPerSecond() / 1e6);
+}
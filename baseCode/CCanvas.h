@@ -1,106 +1,228 @@
-/************************************************************************/
-/* Guards                                                               */
-/************************************************************************/
-#ifndef CCANVAS_H
-#define CCANVAS_H
-
-#include <iostream>
-#include <QtOpenGL>
-#include <QGLWidget>
-#include <QTimer>
-
-#include "Base.h"
-#include "texture.hpp"
-
-#include "ObjModel.h"
-#include "PlyModel.h"
-#include "globals.h"
-
-using namespace std;
-
-/************************************************************************/
-/* Canvas to draw                                                       */
-/************************************************************************/
-class CCanvas : public QGLWidget
-{
-  Q_OBJECT
-
-public:
-    explicit CCanvas(QWidget *parent = 0) : QGLWidget(parent),
-        body_texture(global_path + "/../images/body.png"),
-        textureTrain(global_path + "/../images/earth.jpg"),
-        texturePlanet1(global_path + "/../images/train1.jpg"),
-        texturePlanet2(global_path + "/../images/moon.png"),
-        texturePlanet3(global_path + "/../images/pluton.png"),
-        modelTrain(global_path + "/../images/ship.obj"),
-        modelTrain2(global_path + "/../images/train.ply"),
-        skybox(global_path + "/../images/skybox.obj"),
-        body(global_path + "/../images/body_test.obj"),
-        logo(global_path + "/../images/logo.obj"),
-        tail(global_path + "/../images/tail.obj"),
-        wing_left(global_path + "/../images/wing_left.obj"),
-        wing_right(global_path + "/../images/wing_right.obj"),
-        turret(global_path + "/../images/turret.obj"),
-        engine(global_path + "/../images/engine.obj"),
-        textureSky(global_path + "/../images/skybox.jpg")
-    {
-        QTimer *timer = new QTimer(this);
-        connect(timer, SIGNAL(timeout()), this, SLOT(updateGL()));
-        timer->start(10);
-    }
-
-protected:
-    void initializeGL();
-    void resizeGL(int width, int height);
-    void paintGL();
-    void keyPressEvent(QKeyEvent * event);
-
-private:
-    void lookAt(const GLdouble eyex,
-                const GLdouble eyey,
-                const GLdouble eyez,
-                const GLdouble centerx,
-                const GLdouble centery,
-                const GLdouble centerz,
-                const GLdouble upx,
-                const GLdouble upy,
-                const GLdouble upz);
-
-    void glPerspective(const GLdouble fovy,
-                       const GLdouble aspect,
-                       const GLdouble zNear,
-                       const GLdouble zFar);
-
-
-    enum View {
-        Perspective = 0,    // View the scene from a perspective (from above, from a side, or whatever)
-        Cockpit,            // View the scene from the train cockpit (if you want, or whatever other view)
-        Free
-    };
-
-    void setView(View _view);
-
-    // Models and textures
-    Texture textureTrain;
-    Texture body_texture;
-    Texture textureSky;
-    Texture texturePlanet1;
-    Texture texturePlanet2;
-    Texture texturePlanet3;
-    // Model loaded from .obj format
-    ObjModel modelTrain;
-    ObjModel skybox;
-
-    ObjModel body;
-    ObjModel logo;
-    ObjModel tail;
-    ObjModel engine;
-    ObjModel wing_left;
-    ObjModel wing_right;
-    ObjModel turret;
-
-    // Model loaded from .ply format
-    PlyModel modelTrain2;
-};
-
-#endif
+/************************************************************************/
+/* Guards                                                               */
+/************************************************************************/
+#ifndef CCANVAS_H
+#define CCANVAS_H
+
+#include <iostream>
+#include <QtOpenGL>
+#include <QGLWidget>
+#include <QTimer>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Base.h"
+#include "TextureManager.h"
+
+#include "ObjModel.h"
+#include "PlyModel.h"
+#include "Sphere.h"
+#include "VirtualSphere.h"
+#include "DrawList.h"
+#include "SoftRasterizer.h"
+#include "RayTracer.h"
+#include "CollisionWorld.h"
+#include "Matrix4.h"
+#include "TripleBuffer.h"
+#include "Skybox.h"
+#include "LineBatch.h"
+#include "Circle.h"
+#include "globals.h"
+
+using namespace std;
+
+struct camera {
+    double x = 0;
+    double y = 0;
+    double z = 65;
+    double dx = 0;
+    double dy = 0;
+    double dz = 64;
+    double ux = 0;
+    double uy = 1;
+    double uz = 0;
+};
+
+/************************************************************************/
+/* Canvas to draw                                                       */
+/************************************************************************/
+class CCanvas : public QGLWidget
+{
+  Q_OBJECT
+
+public:
+    explicit CCanvas(QWidget *parent = 0) : QGLWidget(parent),
+        earthRegion(NULL),
+        moonRegion(NULL),
+        plutonRegion(NULL),
+        modelTrain(global_path + "/../images/ship.obj"),
+        modelTrain2(global_path + "/../images/train.ply"),
+        body(global_path + "/../images/body_test.obj"),
+        logo(global_path + "/../images/logo.obj"),
+        tail(global_path + "/../images/tail.obj"),
+        wing_left(global_path + "/../images/wing_left.obj"),
+        wing_right(global_path + "/../images/wing_right.obj"),
+        turret(global_path + "/../images/turret.obj"),
+        engine(global_path + "/../images/engine.obj"),
+        sky(global_path + "/../images/skybox.jpg"),
+        hudLines(1024),
+        shipOrbit(40),
+        reticle(12),
+        showGuides(false),
+        bigSphere(200, 200),
+        smallSphere(40, 40),
+        virtualPlanet(planetTiles),
+        useVirtualPlanet(false),
+        sortOpaque(true),
+        depthPrepass(false),
+        traceRequested(false),
+        projection(Matrix4::identity()),
+        builderRunning(false),
+        requestedFrames(0),
+        builtFrames(0)
+    {
+        QTimer *timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(updateGL()));
+        timer->start(10);
+    }
+
+    ~CCanvas() { stopBuilder(); }
+
+    // Object drawn under the given widget pixel in the frame on screen, if
+    // any; the point is in that frame's eye space
+    bool pick(int x, int y, DrawList::Pick &picked);
+
+protected:
+    void initializeGL();
+    void resizeGL(int width, int height);
+    void paintGL();
+    void keyPressEvent(QKeyEvent * event);
+    void mousePressEvent(QMouseEvent *event);
+
+private:
+    void lookAt(Matrix4 &target,
+                const GLdouble eyex,
+                const GLdouble eyey,
+                const GLdouble eyez,
+                const GLdouble centerx,
+                const GLdouble centery,
+                const GLdouble centerz,
+                const GLdouble upx,
+                const GLdouble upy,
+                const GLdouble upz);
+
+
+    enum View {
+        Perspective = 0,    // View the scene from a perspective (from above, from a side, or whatever)
+        Cockpit,            // View the scene from the train cockpit (if you want, or whatever other view)
+        Free
+    };
+
+    void setView(Matrix4 &matrix, View _view, const camera &c, float alpha);
+
+    /*
+     * Frame N+1 is recorded on a builder thread while the GL thread draws
+     * frame N: view and model matrices, culling, levels of detail and depth
+     * sorting are done there, paintGL is left with the GL calls.
+     */
+    struct SceneInput {
+        int view;
+        camera c;
+        bool sortOpaque;
+        Matrix4 projection;
+    };
+
+    struct FramePacket {
+        FramePacket() : index(0) {}
+        unsigned long index;    // 0 until a frame was built in this slot
+        Matrix4 view;
+        DrawList opaque;
+    };
+
+    void startBuilder();
+    void stopBuilder();
+    void requestFrame();
+    void builderLoop();
+    void buildFrame(const SceneInput &input, FramePacket &packet);
+    // Logs the ship touching a planet, once per contact
+    void reportCollisions();
+
+    // Ray traces the frame's opaque objects against the sky and saves the image
+    void traceStill(const FramePacket &packet);
+
+    // Models and textures
+    TextureHandle textureTrain;
+    TextureHandle body_texture;
+    TextureHandle texturePlanet1;
+    TextureHandle texturePlanet2;
+    TextureHandle texturePlanet3;
+
+    // The small planets share one sphere and one atlas; the handles above
+    // are their fallback when the atlas cannot be built
+    TextureAtlas planetAtlas;
+    const AtlasRegion *earthRegion;
+    const AtlasRegion *moonRegion;
+    const AtlasRegion *plutonRegion;
+    // Model loaded from .obj format
+    ObjModel modelTrain;
+
+    ObjModel body;
+    ObjModel logo;
+    ObjModel tail;
+    ObjModel engine;
+    ObjModel wing_left;
+    ObjModel wing_right;
+    ObjModel turret;
+
+    // Model loaded from .ply format
+    PlyModel modelTrain2;
+
+    // Cube map sky, drawn after the opaque geometry
+    Skybox sky;
+
+    // Orbit rings in world space and HUD circles in pixels, one draw each per frame
+    LineBatch worldLines;
+    LineBatch hudLines;
+    Circle shipOrbit;
+    Circle reticle;
+    bool showGuides;
+
+    // Planets, all the small ones share the same geometry
+    Sphere bigSphere;
+    Sphere smallSphere;
+
+    // The big planet is streamed from images/train1.vtex when there is one
+    VirtualTexture planetTiles;
+    VirtualSphere virtualPlanet;
+    bool useVirtualPlanet;
+
+    bool sortOpaque;
+    bool depthPrepass;
+
+    // The opaque pass on the CPU, blitted before the lines and the sky
+    SoftRasterizer softRaster;
+
+    // Stills traced on request, textures kept loaded between them
+    RayTracer stillTracer;
+    bool traceRequested;
+
+    Matrix4 projection;
+
+    TripleBuffer<SceneInput> inputs;    // GL thread to builder
+    TripleBuffer<FramePacket> packets;  // builder to GL thread
+    std::thread builder;
+    std::mutex builderMutex;
+    std::condition_variable builderWake;
+    bool builderRunning;
+    unsigned long requestedFrames;
+    unsigned long builtFrames;          // builder only
+
+    // The ship's hull against the planets, builder only; body numbers
+    // follow collisionNames
+    CollisionWorld collisions;
+    std::vector<CollisionWorld::Contact> contacts;
+    std::vector<std::pair<unsigned int, unsigned int> > touching;
+};
+
+#endif
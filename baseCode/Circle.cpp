@@ -1,18 +1,19 @@
 #include "Circle.h"
 
-const float DEG2RAD = 3.14159/180;
+Circle::Circle(float radius) : radius(radius) {}
 
-Circle::Circle(float radius){}
-
-void Circle::draw()
+void Circle::draw(LineBatch &batch, float x, float y, const GLubyte color[4]) const
 {
-   glBegin(GL_LINE_LOOP);
-
-   for (int i=0; i<=360; i++)
-   {
-      float degInRad = i*DEG2RAD;
-      glVertex2f(cos(degInRad)*radius,sin(degInRad)*radius);
-   }
+    const GLfloat center[3] = { x, y, 0.0f };
+    const GLfloat u[3] = { 1.0f, 0.0f, 0.0f };
+    const GLfloat v[3] = { 0.0f, 1.0f, 0.0f };
+    batch.addCircle(center, u, v, radius, color);
+}
 
-   glEnd();
+void Circle::draw(LineBatch &batch, const Point3f &center, const Point3f &u, const Point3f &v, const GLubyte color[4]) const
+{
+    const GLfloat c[3] = { center.x(), center.y(), center.z() };
+    const GLfloat fu[3] = { u.x(), u.y(), u.z() };
+    const GLfloat fv[3] = { v.x(), v.y(), v.z() };
+    batch.addCircle(c, fu, fv, radius, color);
 }
@@ -4,12 +4,17 @@
 #include <QtOpenGL>
 #include "Point2.h"
 #include "Point3.h"
+#include "LineBatch.h"
 
 class Circle
 {
 public:
     Circle(float radius);
-    void draw();
+
+    // Appends the circle, in the XY plane around (x, y), to the batch
+    void draw(LineBatch &batch, float x, float y, const GLubyte color[4]) const;
+    // Same, in the plane spanned by the unit vectors u and v around center
+    void draw(LineBatch &batch, const Point3f &center, const Point3f &u, const Point3f &v, const GLubyte color[4]) const;
 
 private:
     float radius;
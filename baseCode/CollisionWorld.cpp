@@ -0,0 +1,152 @@
+#include "CollisionWorld.h"
+#include "Bvh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Pairs tested by one task
+const size_t kNarrowChunk = 256;
+
+bool pairLess(const BroadPhase::Pair &x, const BroadPhase::Pair &y)
+{
+    return x.a < y.a || (x.a == y.a && x.b < y.b);
+}
+
+}
+
+unsigned int CollisionWorld::addSphere(float radius)
+{
+    Body body;
+    body.mesh = NULL;
+    body.modelCenter[0] = body.modelCenter[1] = body.modelCenter[2] = 0.0f;
+    body.modelRadius = radius;
+    bodies.push_back(body);
+    setTransform((unsigned int)(bodies.size() - 1), Matrix4::identity());
+    return (unsigned int)(bodies.size() - 1);
+}
+
+unsigned int CollisionWorld::addObject(const Drawable *object)
+{
+    Body body;
+    body.mesh = object->meshBvh();
+    object->bounds(body.modelCenter, body.modelRadius);
+    bodies.push_back(body);
+    setTransform((unsigned int)(bodies.size() - 1), Matrix4::identity());
+    return (unsigned int)(bodies.size() - 1);
+}
+
+void CollisionWorld::setTransform(unsigned int index, const Matrix4 &modelToWorld)
+{
+    Body &body = bodies[index];
+    body.toWorld = modelToWorld;
+    body.toModel = modelToWorld.inverse();
+
+    const GLfloat *m = modelToWorld.m;
+    body.scale = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    const Vec3 center = modelToWorld.transformPoint(Vec3(body.modelCenter[0], body.modelCenter[1], body.modelCenter[2]));
+    body.center[0] = center.x;
+    body.center[1] = center.y;
+    body.center[2] = center.z;
+    body.radius = body.modelRadius * body.scale;
+}
+
+bool CollisionWorld::sphereSphere(unsigned int a, unsigned int b, Contact &contact) const
+{
+    const Body &first = bodies[a], &second = bodies[b];
+    float d[3];
+    for(int k = 0; k < 3; ++k) d[k] = second.center[k] - first.center[k];
+    const float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    const float depth = first.radius + second.radius - distance;
+    if(depth < 0.0f) return false;
+
+    // Concentric spheres push apart along any axis
+    for(int k = 0; k < 3; ++k) contact.normal[k] = distance > 0.0f ? d[k] / distance : (k == 1 ? 1.0f : 0.0f);
+    for(int k = 0; k < 3; ++k) contact.point[k] = first.center[k] + contact.normal[k] * (first.radius - 0.5f * depth);
+    contact.depth = depth;
+    contact.a = a;
+    contact.b = b;
+    return true;
+}
+
+bool CollisionWorld::sphereMesh(unsigned int sphere, unsigned int mesh, Contact &contact) const
+{
+    const Body &s = bodies[sphere], &m = bodies[mesh];
+
+    // The sphere in the mesh's model space, where its BVH is
+    const Vec3 center = m.toModel.transformPoint(Vec3(s.center[0], s.center[1], s.center[2]));
+    const float point[3] = { center.x, center.y, center.z };
+    Bvh::Closest closest;
+    if(!m.mesh->closestPoint(point, s.radius / m.scale, closest)) return false;
+
+    const Vec3 world = m.toWorld.transformPoint(Vec3(closest.point[0], closest.point[1], closest.point[2]));
+    const float surface[3] = { world.x, world.y, world.z };
+    float d[3] = { surface[0] - s.center[0], surface[1] - s.center[1], surface[2] - s.center[2] };
+    float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    if(distance <= 0.0f) {
+        // Center on the surface: fall back to the line between the centers
+        for(int k = 0; k < 3; ++k) d[k] = m.center[k] - s.center[k];
+        distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if(distance <= 0.0f) {
+            d[1] = 1.0f;
+            distance = 1.0f;
+        }
+    }
+
+    // Normal from the sphere to the mesh, flipped when the mesh comes first
+    const float sign = sphere < mesh ? 1.0f : -1.0f;
+    const float depth = s.radius - std::sqrt(closest.distanceSquared) * m.scale;
+    for(int k = 0; k < 3; ++k) {
+        const float n = d[k] / distance;
+        contact.normal[k] = sign * n;
+        contact.point[k] = 0.5f * (surface[k] + s.center[k] + n * s.radius);
+    }
+    contact.depth = depth;
+    contact.a = std::min(sphere, mesh);
+    contact.b = std::max(sphere, mesh);
+    return true;
+}
+
+void CollisionWorld::collide(std::vector<Contact> &contacts)
+{
+    boxes.resize(bodies.size());
+    for(size_t i = 0; i < bodies.size(); ++i) {
+        const Body &body = bodies[i];
+        for(int k = 0; k < 3; ++k) {
+            boxes[i].lo[k] = body.center[k] - body.radius;
+            boxes[i].hi[k] = body.center[k] + body.radius;
+        }
+    }
+
+    broad.update(boxes);
+    pairs.clear();
+    broad.findPairs(pairs);
+    std::sort(pairs.begin(), pairs.end(), pairLess);
+
+    // Narrow phase in chunks, whose contacts are appended in order
+    const size_t chunks = (pairs.size() + kNarrowChunk - 1) / kNarrowChunk;
+    std::vector<std::vector<Contact> > results(chunks);
+    parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+        for(size_t c = begin; c < end; ++c) {
+            const size_t first = c * kNarrowChunk, last = std::min(pairs.size(), first + kNarrowChunk);
+            for(size_t p = first; p < last; ++p) {
+                const unsigned int a = pairs[p].a, b = pairs[p].b;
+                Contact contact;
+                if(!sphereSphere(a, b, contact)) continue;
+
+                // Bounding spheres touch; a mesh decides, the smaller body
+                // standing in as its sphere when both have one
+                const Bvh *meshA = bodies[a].mesh, *meshB = bodies[b].mesh;
+                if(meshA || meshB) {
+                    const bool bIsMesh = meshB && (!meshA || bodies[b].radius >= bodies[a].radius);
+                    if(!(bIsMesh ? sphereMesh(a, b, contact) : sphereMesh(b, a, contact))) continue;
+                }
+                results[c].push_back(contact);
+            }
+        }
+    });
+
+    for(size_t c = 0; c < chunks; ++c) contacts.insert(contacts.end(), results[c].begin(), results[c].end());
+}
@@ -0,0 +1,65 @@
+#ifndef COLLISIONWORLD_H
+#define COLLISIONWORLD_H
+
+#include <vector>
+
+#include "BroadPhase.h"
+#include "Drawable.h"
+#include "Matrix4.h"
+
+/*
+ * Collisions between moving bodies: spheres, and objects shaped by their
+ * mesh BVH (see Drawable::meshBvh()).
+ *
+ * collide() bounds every body with its sphere, finds the pairs of boxes
+ * that overlap (BroadPhase) and tests only those, in parallel: sphere
+ * against sphere, or sphere against the triangles nearest to it. Two meshes
+ * are tested as the smaller one's bounding sphere against the other mesh.
+ */
+class CollisionWorld
+{
+public:
+    struct Contact {
+        unsigned int a, b;      // bodies, a < b
+        float point[3];         // world space, halfway between the surfaces
+        float normal[3];        // from a towards b
+        float depth;            // penetration
+    };
+
+    // Returns the body, numbered from 0 in the order they are added
+    unsigned int addSphere(float radius);
+    // The object's bounding sphere, or its mesh when it has a BVH
+    unsigned int addObject(const Drawable *object);
+
+    // Model to world: rotation, translation and a uniform scale
+    void setTransform(unsigned int body, const Matrix4 &modelToWorld);
+
+    // Every touching pair, appended to contacts by increasing body numbers
+    void collide(std::vector<Contact> &contacts);
+
+    size_t bodyCount() const { return bodies.size(); }
+    size_t lastPairCount() const { return pairs.size(); }
+    const BroadPhase &broadPhase() const { return broad; }
+
+private:
+    struct Body {
+        const Bvh *mesh;            // NULL for a sphere
+        float modelCenter[3];       // bounding sphere in model space
+        float modelRadius;
+
+        Matrix4 toWorld, toModel;
+        float scale;                // world units per model unit
+        float center[3];            // bounding sphere in world space
+        float radius;
+    };
+
+    bool sphereSphere(unsigned int a, unsigned int b, Contact &contact) const;
+    bool sphereMesh(unsigned int sphere, unsigned int mesh, Contact &contact) const;
+
+    std::vector<Body> bodies;
+    std::vector<Aabb> boxes;
+    BroadPhase broad;
+    std::vector<BroadPhase::Pair> pairs;
+};
+
+#endif // COLLISIONWORLD_H
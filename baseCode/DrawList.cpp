@@ -0,0 +1,233 @@
+#include "DrawList.h"
+#include "Bvh.h"
+#include "GLState.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+struct NearerFirst {
+    NearerFirst(const std::vector<float> &distances) : distances(distances) {}
+    bool operator () (size_t a, size_t b) const { return distances[a] < distances[b]; }
+    const std::vector<float> &distances;
+};
+
+}
+
+bool DrawList::add(const Matrix4 &modelview, Drawable *object, const TextureHandle *texture, const char *name,
+                   bool heavy, const Frustum *frustum)
+{
+    GLfloat center[3], radius;
+    object->bounds(center, radius);
+
+    const GLfloat *m = modelview.m;
+    float scale = 0.0f;
+    for(int c = 0; c < 3; ++c)
+        scale = std::max(scale, std::sqrt(m[4 * c] * m[4 * c] + m[4 * c + 1] * m[4 * c + 1] + m[4 * c + 2] * m[4 * c + 2]));
+
+    const Vec3 viewCenter = modelview.transformPoint(Vec3(center[0], center[1], center[2]));
+    if(frustum && !frustum->intersectsSphere(viewCenter, radius * scale)) return false;
+
+    Item item;
+    item.modelview = modelview;
+    item.object = object;
+    item.texture = texture;
+    item.region = NULL;
+    item.name = name;
+    item.heavy = heavy;
+    item.lod = object->selectLod(modelview.m);
+    item.distance = -viewCenter.z - radius * scale;
+
+    order.push_back(items.size());
+    items.push_back(item);
+    return true;
+}
+
+bool DrawList::addAtlased(const Matrix4 &modelview, Drawable *object, const AtlasRegion *region, const char *name,
+                          bool heavy, const Frustum *frustum)
+{
+    if(!add(modelview, object, NULL, name, heavy, frustum)) return false;
+    items.back().region = region;
+    return true;
+}
+
+void DrawList::sortFrontToBack()
+{
+    std::vector<float> distances(items.size());
+    for(size_t i = 0; i < items.size(); ++i) distances[i] = items[i].distance;
+    std::stable_sort(order.begin(), order.end(), NearerFirst(distances));
+}
+
+void DrawList::draw(bool depthPrepass)
+{
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    bool prepassed = false;
+    if(depthPrepass) {
+        ProfileScope scope("depth prepass");
+        glState.pushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glState.disable(GL_LIGHTING);
+        glState.disable(GL_TEXTURE_2D);
+
+        for(size_t i = 0; i < order.size(); ++i) {
+            const Item &item = items[order[i]];
+            if(!item.heavy) continue;
+            glLoadMatrixf(item.modelview.m);
+            item.object->draw(item.lod);
+            prepassed = true;
+        }
+
+        glState.popAttrib();
+    }
+
+    profiler.beginSampleCount();
+    const Item *bound = NULL;      // last textured item, its texture is still bound
+    bool remapped = false;
+    for(size_t i = 0; i < order.size(); ++i) {
+        const Item &item = items[order[i]];
+        ProfileScope scope(item.name);
+
+        // The depth is already there, GL_LEQUAL lets the same fragments through
+        const bool depthDone = prepassed && item.heavy;
+        if(depthDone) glDepthMask(GL_FALSE);
+
+        const void *texture = textureOf(item);
+        if(bound && texture != textureOf(*bound)) {
+            unbindTexture(*bound);
+            bound = NULL;
+        }
+        if(texture && !bound) {
+            bindTexture(item);
+            bound = &item;
+        }
+        if(item.region) {
+            TextureAtlas::applyRegion(*item.region);
+            remapped = true;
+        } else if(remapped) {
+            TextureAtlas::resetRegion();
+            remapped = false;
+        }
+
+        glLoadMatrixf(item.modelview.m);
+        item.object->draw(item.lod);
+
+        if(depthDone) glDepthMask(GL_TRUE);
+    }
+    if(bound) unbindTexture(*bound);
+    if(remapped) TextureAtlas::resetRegion();
+    profiler.endSampleCount();
+
+    glPopMatrix();
+}
+
+void DrawList::drawSoftware(SoftRasterizer &raster) const
+{
+    raster.begin();
+    {
+        ProfileScope scope("software setup");
+        for(size_t i = 0; i < order.size(); ++i) {
+            const Item &item = items[order[i]];
+            TriangleMesh mesh;
+            if(!item.object->triangles(item.lod, mesh)) continue;
+
+            const std::string path = imagePath(item);
+            const SoftTexture *texture = path.empty() ? NULL : raster.texture(path);
+            raster.draw(item.modelview, mesh, texture);
+        }
+    }
+
+    ProfileScope scope("software raster");
+    raster.finish();
+}
+
+void DrawList::gather(RayTracer &tracer) const
+{
+    for(size_t i = 0; i < items.size(); ++i) {
+        const Item &item = items[i];
+        TriangleMesh mesh;
+        if(item.object->triangles(item.lod, mesh)) tracer.add(item.modelview, mesh, imagePath(item));
+    }
+}
+
+bool DrawList::pick(const float origin[3], const float direction[3], Pick &picked) const
+{
+    picked.name = NULL;
+    picked.object = NULL;
+    picked.distance = std::numeric_limits<float>::infinity();
+    picked.triangle = Bvh::kNoHit;
+
+    for(size_t i = 0; i < items.size(); ++i) {
+        const Item &item = items[i];
+
+        // The ray in model space; the direction is not renormalized, so
+        // that distances along it stay those of eye space
+        const Matrix4 inverse = item.modelview.inverse();
+        const GLfloat *m = inverse.m;
+        float o[3], d[3];
+        for(int r = 0; r < 3; ++r) {
+            o[r] = m[r] * origin[0] + m[4 + r] * origin[1] + m[8 + r] * origin[2] + m[12 + r];
+            d[r] = m[r] * direction[0] + m[4 + r] * direction[1] + m[8 + r] * direction[2];
+        }
+
+        // Bounding sphere first: most objects are nowhere near the ray
+        GLfloat center[3], radius;
+        item.object->bounds(center, radius);
+        const float oc[3] = { o[0] - center[0], o[1] - center[1], o[2] - center[2] };
+        const float a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        const float b = oc[0] * d[0] + oc[1] * d[1] + oc[2] * d[2];
+        const float c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - radius * radius;
+        const float discriminant = b * b - a * c;
+        if(a <= 0.0f || discriminant < 0.0f) continue;
+        const float root = std::sqrt(discriminant);
+        const float tFar = (-b + root) / a;
+        if(tFar <= 0.0f) continue;
+        float t = std::max(0.0f, (-b - root) / a);
+        if(t >= picked.distance) continue;
+
+        unsigned int triangle = Bvh::kNoHit;
+        if(const Bvh *bvh = item.object->meshBvh()) {
+            Bvh::Hit hit;
+            if(!bvh->intersect(o, d, picked.distance, hit)) continue;
+            t = hit.t;
+            triangle = hit.triangle;
+        }
+
+        picked.name = item.name;
+        picked.object = item.object;
+        picked.distance = t;
+        picked.triangle = triangle;
+        for(int k = 0; k < 3; ++k) picked.point[k] = origin[k] + t * direction[k];
+    }
+    return picked.object != NULL;
+}
+
+std::string DrawList::imagePath(const Item &item)
+{
+    // The image itself, not the atlas: there is no texture matrix on the CPU
+    if(item.region) return item.region->path;
+    if(item.texture && !item.texture->isNull()) return item.texture->path();
+    return std::string();
+}
+
+const void *DrawList::textureOf(const Item &item)
+{
+    if(item.region) return item.region->atlas;
+    return item.texture;
+}
+
+void DrawList::bindTexture(const Item &item)
+{
+    if(item.region) item.region->atlas->bind();
+    else if(item.texture) item.texture->bind();
+}
+
+void DrawList::unbindTexture(const Item &item)
+{
+    if(item.region) item.region->atlas->unbind();
+    else if(item.texture) item.texture->unbind();
+}
@@ -0,0 +1,95 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <QtOpenGL>
+#include <vector>
+
+#include "Drawable.h"
+#include "Matrix4.h"
+#include "RayTracer.h"
+#include "SoftRasterizer.h"
+#include "TextureAtlas.h"
+#include "TextureManager.h"
+
+/*
+ * Opaque pass.
+ *
+ * Objects are recorded with their modelview matrix and level of detail, and
+ * drawn later, nearest first, so that the depth test rejects the fragments
+ * of whatever they hide before shading them. Heavy objects (large on screen,
+ * expensive fragments) can additionally be laid down in a depth only
+ * pre-pass: in the color pass they then shade each covered pixel exactly once.
+ * A texture is only bound when it differs from the previous object's, and
+ * objects textured from the same atlas only change the texture matrix.
+ *
+ * Recording and sorting make no GL call and can run on any thread; only
+ * draw() needs the GL context. drawSoftware() rasterizes the same list on
+ * the CPU instead (see SoftRasterizer), gather() hands it to the ray tracer.
+ */
+class DrawList
+{
+public:
+    void clear() { items.clear(); order.clear(); }
+
+    // texture may be null for untextured objects, it must outlive the list;
+    // name labels the profiler section. Returns false, recording nothing, if
+    // the object is outside the view space frustum (when one is given).
+    bool add(const Matrix4 &modelview, Drawable *object, const TextureHandle *texture, const char *name,
+             bool heavy = false, const Frustum *frustum = NULL);
+
+    // Same, textured from a region of an atlas
+    bool addAtlased(const Matrix4 &modelview, Drawable *object, const AtlasRegion *region, const char *name,
+                    bool heavy = false, const Frustum *frustum = NULL);
+
+    // Nearest first, by the distance to the closest point of the bounds
+    void sortFrontToBack();
+
+    // Draws and keeps the recorded objects; the modelview matrix is restored
+    void draw(bool depthPrepass);
+
+    // Same, into raster's frame, from begin() to finish(). Objects without
+    // triangles on the CPU are skipped.
+    void drawSoftware(SoftRasterizer &raster) const;
+
+    // Adds the objects with triangles on the CPU to tracer's scene
+    void gather(RayTracer &tracer) const;
+
+    struct Pick {
+        const char *name;       // as given to add()
+        Drawable *object;
+        float distance;         // along the ray
+        float point[3];         // eye space
+        unsigned int triangle;  // of the object's BVH, Bvh::kNoHit when hit by its bounds only
+    };
+
+    // Nearest recorded object along the eye space ray origin + t * direction
+    // (direction of unit length). Objects with a BVH are tested against their
+    // triangles, the others against their bounding sphere.
+    bool pick(const float origin[3], const float direction[3], Pick &picked) const;
+
+    size_t size() const { return items.size(); }
+
+private:
+    struct Item;
+
+    static void bindTexture(const Item &item);
+    static void unbindTexture(const Item &item);
+    static const void *textureOf(const Item &item);
+    static std::string imagePath(const Item &item);
+
+    struct Item {
+        Matrix4 modelview;
+        Drawable *object;
+        const TextureHandle *texture;
+        const AtlasRegion *region;
+        const char *name;
+        bool heavy;
+        int lod;
+        float distance;     // from the eye to the nearest point of the bounds
+    };
+
+    std::vector<Item> items;
+    std::vector<size_t> order;
+};
+
+#endif // DRAWLIST_H
@@ -0,0 +1,43 @@
+#ifndef DRAWABLE_H
+#define DRAWABLE_H
+
+#include <QtOpenGL>
+
+class Bvh;
+
+// Triangles of an object as they sit in memory, for the software
+// rasterizer. Nothing is owned or copied.
+struct TriangleMesh
+{
+    const GLfloat *positions;   // x, y, z per vertex
+    const GLfloat *normals;     // x, y, z per vertex, or NULL
+    const GLfloat *uvs;         // u, v per vertex, or NULL
+    const GLuint *indices;      // three per triangle, NULL for consecutive vertices
+    size_t vertexCount;
+    size_t indexCount;          // vertexCount when indices is NULL
+};
+
+// Anything the opaque pass can draw and sort
+class Drawable
+{
+public:
+    virtual ~Drawable() {}
+    virtual void draw() = 0;
+
+    // Optional levels of detail, 0 being the finest
+    virtual int selectLod(const GLfloat [16]) const { return 0; }
+    virtual void draw(int) { draw(); }
+
+    // Bounding sphere in model space
+    virtual void bounds(GLfloat center[3], GLfloat &radius) const = 0;
+
+    // The triangles of the given level, if the object keeps them on the
+    // CPU; mesh stays valid as long as the object
+    virtual bool triangles(int, TriangleMesh &) { return false; }
+
+    // Hierarchy over the finest level's triangles in model space, for ray,
+    // nearest point and overlap queries; NULL when the object has none
+    virtual const Bvh *meshBvh() const { return NULL; }
+};
+
+#endif // DRAWABLE_H
@@ -3,6 +3,7 @@
 #####################################################################
 
 CONFIG += release
+CONFIG += c++11 thread
 
 TEMPLATE = app
 TARGET = GLRender
@@ -24,7 +25,40 @@ HEADERS += ./Base.h \
            ./objloader.hpp \
            ./tinyply.h \
     globals.h \
-    Circle.h
+    Circle.h \
+    GLUtils.h \
+    Profiler.h \
+    Skybox.h \
+    MeshUtils.h \
+    MeshSimplifier.h \
+    MeshOptimizer.h \
+    VertexQuantizer.h \
+    LineBatch.h \
+    Drawable.h \
+    DrawList.h \
+    Matrix4.h \
+    TripleBuffer.h \
+    Parallel.h \
+    MipChain.h \
+    KtxFile.h \
+    TextureManager.h \
+    TextureStreamer.h \
+    TextureAtlas.h \
+    VtexFile.h \
+    VirtualTexture.h \
+    VirtualSphere.h \
+    GLState.h \
+    VecMath.h \
+    PointArrays.h \
+    Log.h \
+    SoftRasterizer.h \
+    SoftTexture.h \
+    Bvh.h \
+    RayTracer.h \
+    BroadPhase.h \
+    CollisionWorld.h \
+    PackFile.h \
+    Vfs.h
 
 # Source files
 SOURCES += ./CCanvas.cpp \
@@ -36,7 +70,37 @@ SOURCES += ./CCanvas.cpp \
            ./objloader.cpp \
            ./tinyply.cpp \
     globals.cpp \
-    Circle.cpp
+    Circle.cpp \
+    GLUtils.cpp \
+    Profiler.cpp \
+    Skybox.cpp \
+    MeshUtils.cpp \
+    MeshSimplifier.cpp \
+    MeshOptimizer.cpp \
+    VertexQuantizer.cpp \
+    LineBatch.cpp \
+    DrawList.cpp \
+    Matrix4.cpp \
+    Parallel.cpp \
+    MipChain.cpp \
+    KtxFile.cpp \
+    TextureManager.cpp \
+    TextureStreamer.cpp \
+    TextureAtlas.cpp \
+    VtexFile.cpp \
+    VirtualTexture.cpp \
+    VirtualSphere.cpp \
+    GLState.cpp \
+    PointArrays.cpp \
+    Log.cpp \
+    SoftRasterizer.cpp \
+    SoftTexture.cpp \
+    Bvh.cpp \
+    RayTracer.cpp \
+    BroadPhase.cpp \
+    CollisionWorld.cpp \
+    PackFile.cpp \
+    Vfs.cpp
 
 # Forms
 FORMS += ./GLRender.ui
@@ -0,0 +1,165 @@
+#include "GLState.h"
+#include "Profiler.h"
+
+#include <cstring>
+
+GLStateCache glState;
+
+bool GLStateCache::update(std::vector<Entry> &entries, GLuint key, GLuint value)
+{
+    for(size_t i = 0; i < entries.size(); ++i) {
+        if(entries[i].key != key) continue;
+        if(entries[i].value == value) {
+            profiler.countFilteredCall();
+            return false;
+        }
+        entries[i].value = value;
+        profiler.countStateChange();
+        return true;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.value = value;
+    entries.push_back(entry);
+    profiler.countStateChange();
+    return true;
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled)
+{
+    // Texture targets are enabled per unit
+    const GLuint key = (cap == GL_TEXTURE_2D || cap == GL_TEXTURE_CUBE_MAP) ? textureKey(cap) : cap;
+    if(!update(enables, key, enabled)) return;
+    if(enabled) glEnable(cap);
+    else glDisable(cap);
+}
+
+void GLStateCache::setClientState(GLenum array, bool enabled)
+{
+    if(!update(clientStates, array, enabled)) return;
+    if(enabled) glEnableClientState(array);
+    else glDisableClientState(array);
+}
+
+void GLStateCache::clientArrays(bool vertex, bool normal, bool texCoord, bool color)
+{
+    setClientState(GL_VERTEX_ARRAY, vertex);
+    setClientState(GL_NORMAL_ARRAY, normal);
+    setClientState(GL_TEXTURE_COORD_ARRAY, texCoord);
+    setClientState(GL_COLOR_ARRAY, color);
+}
+
+GLuint GLStateCache::textureKey(GLenum target) const
+{
+    const GLuint unit = units.empty() ? 0 : units[0].value - GL_TEXTURE0;
+    return (unit << 16) | target;
+}
+
+void GLStateCache::activeTexture(GLenum unit)
+{
+    if(update(units, 0, unit)) glActiveTexture(unit);
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint name)
+{
+    if(update(textures, textureKey(target), name)) glBindTexture(target, name);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint name)
+{
+    if(update(buffers, target, name)) glBindBuffer(target, name);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint *names)
+{
+    // GL unbinds deleted names, and may hand them out again
+    for(GLsizei n = 0; n < count; ++n)
+        for(size_t i = 0; i < textures.size(); ++i)
+            if(textures[i].value == names[n]) textures[i].value = 0;
+    glDeleteTextures(count, names);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint *names)
+{
+    for(GLsizei n = 0; n < count; ++n)
+        for(size_t i = 0; i < buffers.size(); ++i)
+            if(buffers[i].value == names[n]) buffers[i].value = 0;
+    glDeleteBuffers(count, names);
+}
+
+bool GLStateCache::updateMaterial(GLenum face, GLenum pname, const GLfloat *params, int count)
+{
+    for(size_t i = 0; i < materials.size(); ++i) {
+        MaterialEntry &entry = materials[i];
+        if(entry.face != face || entry.pname != pname) continue;
+        if(memcmp(entry.params, params, count * sizeof(GLfloat)) == 0) return false;
+        memcpy(entry.params, params, count * sizeof(GLfloat));
+        return true;
+    }
+
+    MaterialEntry entry;
+    entry.face = face;
+    entry.pname = pname;
+    memset(entry.params, 0, sizeof(entry.params));
+    memcpy(entry.params, params, count * sizeof(GLfloat));
+    materials.push_back(entry);
+    return true;
+}
+
+void GLStateCache::material(GLenum face, GLenum pname, const GLfloat *params)
+{
+    const int count = pname == GL_SHININESS ? 1 : 4;
+
+    // GL_FRONT_AND_BACK is filtered only when both faces already match
+    bool changed = false;
+    if(face != GL_BACK) changed = updateMaterial(GL_FRONT, pname, params, count) || changed;
+    if(face != GL_FRONT) changed = updateMaterial(GL_BACK, pname, params, count) || changed;
+
+    if(!changed) {
+        profiler.countFilteredCall();
+        return;
+    }
+    glMaterialfv(face, pname, params);
+    profiler.countStateChange();
+}
+
+void GLStateCache::pushAttrib(GLbitfield mask)
+{
+    Saved state;
+    state.mask = mask;
+    if(mask & GL_ENABLE_BIT) state.enables = enables;
+    if(mask & GL_TEXTURE_BIT) {
+        state.textures = textures;
+        state.units = units;
+    }
+    if(mask & GL_LIGHTING_BIT) state.materials = materials;
+    saved.push_back(state);
+
+    glPushAttrib(mask);
+}
+
+void GLStateCache::popAttrib()
+{
+    glPopAttrib();
+
+    // Client arrays and buffer bindings are not on the attribute stack
+    Saved &state = saved.back();
+    if(state.mask & GL_ENABLE_BIT) enables.swap(state.enables);
+    if(state.mask & GL_TEXTURE_BIT) {
+        textures.swap(state.textures);
+        units.swap(state.units);
+    }
+    if(state.mask & GL_LIGHTING_BIT) materials.swap(state.materials);
+    saved.pop_back();
+}
+
+void GLStateCache::invalidate()
+{
+    // Materials are left alone: nothing changes them behind the cache's back
+    enables.clear();
+    clientStates.clear();
+    textures.clear();
+    buffers.clear();
+    units.clear();
+}
@@ -0,0 +1,88 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Shadow of the GL state the draw paths change all the time.
+ *
+ * Enables, client arrays, the active texture unit, texture and buffer
+ * bindings and material parameters set through the cache are remembered,
+ * and a call that would set what is already set never reaches GL: the
+ * profiler counts it as filtered rather than as a state change. GL thread
+ * only.
+ *
+ * The shadow must not go stale. Deleting textures and buffers goes through
+ * the cache as well, and so does the attribute stack: popAttrib() puts back
+ * the shadow of what the matching pushAttrib() saved, as GL does with the
+ * state. After anything else changing state behind its back
+ * (QGLWidget::renderText), invalidate() makes the next call of each kind go
+ * through.
+ */
+class GLStateCache
+{
+public:
+    void enable(GLenum cap) { setEnabled(cap, true); }
+    void disable(GLenum cap) { setEnabled(cap, false); }
+    void enableClientState(GLenum array) { setClientState(array, true); }
+    void disableClientState(GLenum array) { setClientState(array, false); }
+    // The arrays the next array draw reads, every other one disabled.
+    // Array draws state all four instead of disabling theirs afterwards.
+    void clientArrays(bool vertex, bool normal, bool texCoord, bool color);
+
+    void activeTexture(GLenum unit);
+    // On the active unit
+    void bindTexture(GLenum target, GLuint name);
+    void bindBuffer(GLenum target, GLuint name);
+
+    void deleteTextures(GLsizei count, const GLuint *names);
+    void deleteBuffers(GLsizei count, const GLuint *names);
+
+    // glMaterialfv, for the colors and the shininess
+    void material(GLenum face, GLenum pname, const GLfloat *params);
+
+    // glPushAttrib and glPopAttrib
+    void pushAttrib(GLbitfield mask);
+    void popAttrib();
+
+    void invalidate();
+
+private:
+    // Last value set for a key, linear search: only a handful are in use
+    struct Entry {
+        GLuint key;
+        GLuint value;
+    };
+    struct MaterialEntry {
+        GLenum face;
+        GLenum pname;
+        GLfloat params[4];
+    };
+    // Shadow of what a glPushAttrib saved, for the bits the cache knows
+    struct Saved {
+        GLbitfield mask;
+        std::vector<Entry> enables;
+        std::vector<Entry> textures;
+        std::vector<Entry> units;
+        std::vector<MaterialEntry> materials;
+    };
+
+    static bool update(std::vector<Entry> &entries, GLuint key, GLuint value);
+    bool updateMaterial(GLenum face, GLenum pname, const GLfloat *params, int count);
+    void setEnabled(GLenum cap, bool enabled);
+    void setClientState(GLenum array, bool enabled);
+    GLuint textureKey(GLenum target) const;
+
+    std::vector<Entry> enables;
+    std::vector<Entry> clientStates;
+    std::vector<Entry> textures;        // per unit and target
+    std::vector<Entry> buffers;
+    std::vector<Entry> units;           // a single entry, the active unit
+    std::vector<MaterialEntry> materials;
+    std::vector<Saved> saved;
+};
+
+extern GLStateCache glState;
+
+#endif // GLSTATE_H
@@ -0,0 +1,31 @@
+#include "GLUtils.h"
+
+#include <cstdio>
+#include <cstring>
+
+bool hasGLVersion(int major, int minor)
+{
+    const char *version = (const char *)glGetString(GL_VERSION);
+    if(version == NULL) return false;
+
+    // "OpenGL ES" prefixes are not expected here, the string starts with "major.minor"
+    int maj = 0, min = 0;
+    if(sscanf(version, "%d.%d", &maj, &min) != 2) return false;
+
+    return maj > major || (maj == major && min >= minor);
+}
+
+bool hasGLExtension(const char *name)
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if(extensions == NULL || name == NULL) return false;
+
+    // Match whole tokens only, GL_EXT_foo must not match GL_EXT_foo_bar
+    const size_t length = strlen(name);
+    for(const char *p = strstr(extensions, name); p != NULL; p = strstr(p + length, name)) {
+        const bool startsToken = (p == extensions || p[-1] == ' ');
+        const bool endsToken = (p[length] == ' ' || p[length] == '\0');
+        if(startsToken && endsToken) return true;
+    }
+    return false;
+}
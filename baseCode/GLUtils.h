@@ -0,0 +1,17 @@
+#ifndef GLUTILS_H
+#define GLUTILS_H
+
+#include <QtOpenGL>
+
+/*
+ * Small helpers to query what the current GL context supports. They must be
+ * called with a current context (i.e. from initializeGL/paintGL).
+ */
+
+// True if the context version is at least major.minor.
+bool hasGLVersion(int major, int minor);
+
+// True if the extension is advertised by the current context.
+bool hasGLExtension(const char *name);
+
+#endif // GLUTILS_H
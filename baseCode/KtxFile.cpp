@@ -0,0 +1,117 @@
+#include "KtxFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const unsigned char kIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const unsigned int kEndianness = 0x04030201;
+
+// Header fields after the identifier, in file order
+enum {
+    Endianness, GlType, GlTypeSize, GlFormat, GlInternalFormat, GlBaseInternalFormat,
+    PixelWidth, PixelHeight, PixelDepth, ArrayElements, Faces, MipLevels, KeyValueBytes,
+    HeaderFields
+};
+
+// Bytes per 4x4 block of the formats the texture compressor writes, 0 for
+// any other
+unsigned int blockBytes(GLenum internalFormat)
+{
+    switch(internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return 16;
+    default: return 0;
+    }
+}
+
+unsigned int readWord(const unsigned char *p, bool swap)
+{
+    unsigned int word;
+    memcpy(&word, p, sizeof(word));
+    if(swap) word = (word >> 24) | ((word >> 8) & 0xff00u) | ((word << 8) & 0xff0000u) | (word << 24);
+    return word;
+}
+
+}
+
+bool parseKtx(const unsigned char *data, size_t size, KtxTexture &texture)
+{
+    const size_t headerSize = sizeof(kIdentifier) + 4 * HeaderFields;
+    if(data == NULL || size < headerSize || memcmp(data, kIdentifier, sizeof(kIdentifier)) != 0) return false;
+
+    const unsigned char *fields = data + sizeof(kIdentifier);
+    const bool swap = readWord(fields, false) != kEndianness;
+    unsigned int header[HeaderFields];
+    for(int i = 0; i < HeaderFields; ++i) header[i] = readWord(fields + 4 * i, swap);
+    if(header[Endianness] != kEndianness) return false;
+
+    // BC1 or BC3 compressed 2D textures only
+    const unsigned int bytesPerBlock = blockBytes(header[GlInternalFormat]);
+    if(header[GlType] != 0 || header[GlFormat] != 0 || header[PixelDepth] > 1 ||
+       header[ArrayElements] > 0 || header[Faces] != 1 || bytesPerBlock == 0) return false;
+    if(header[PixelWidth] == 0 || header[PixelHeight] == 0 ||
+       header[PixelWidth] > 65536 || header[PixelHeight] > 65536) return false;
+
+    texture.internalFormat = header[GlInternalFormat];
+    texture.baseInternalFormat = header[GlBaseInternalFormat];
+    texture.width = (int)header[PixelWidth];
+    texture.height = (int)header[PixelHeight];
+    texture.levels.clear();
+
+    size_t offset = headerSize + header[KeyValueBytes];
+    const unsigned int levelCount = std::max(1u, header[MipLevels]);
+    for(unsigned int i = 0; i < levelCount; ++i) {
+        if(offset + 4 > size) return false;
+        const unsigned int imageSize = readWord(data + offset, swap);
+        offset += 4;
+        if(offset + imageSize > size) return false;
+
+        KtxLevel level;
+        level.width = std::max(1, texture.width >> std::min(i, 31u));
+        level.height = std::max(1, texture.height >> std::min(i, 31u));
+
+        // Exactly the blocks covering the level, as glCompressedTexImage2D
+        // expects them
+        const size_t blocks = (size_t)((level.width + 3) / 4) * ((level.height + 3) / 4);
+        if(imageSize != blocks * bytesPerBlock) return false;
+
+        level.data = data + offset;
+        level.size = (GLsizei)imageSize;
+        texture.levels.push_back(level);
+
+        offset += (imageSize + 3) & ~3u;
+    }
+    return true;
+}
+
+bool writeKtx(const std::string &path, GLenum internalFormat, GLenum baseInternalFormat,
+              int width, int height, const std::vector<std::vector<unsigned char> > &levels)
+{
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out.is_open()) return false;
+
+    unsigned int header[HeaderFields] = { 0 };
+    header[Endianness] = kEndianness;
+    header[GlTypeSize] = 1;
+    header[GlInternalFormat] = internalFormat;
+    header[GlBaseInternalFormat] = baseInternalFormat;
+    header[PixelWidth] = (unsigned int)width;
+    header[PixelHeight] = (unsigned int)height;
+    header[Faces] = 1;
+    header[MipLevels] = (unsigned int)levels.size();
+
+    out.write((const char*)kIdentifier, sizeof(kIdentifier));
+    out.write((const char*)header, sizeof(header));
+
+    const char padding[4] = { 0, 0, 0, 0 };
+    for(size_t i = 0; i < levels.size(); ++i) {
+        const unsigned int imageSize = (unsigned int)levels[i].size();
+        out.write((const char*)&imageSize, sizeof(imageSize));
+        if(imageSize) out.write((const char*)&levels[i][0], imageSize);
+        out.write(padding, (4 - imageSize % 4) % 4);
+    }
+    return out.good();
+}
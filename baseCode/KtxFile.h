@@ -0,0 +1,44 @@
+#ifndef KTXFILE_H
+#define KTXFILE_H
+
+#include <QtOpenGL>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/*
+ * KTX 1.1 container, 2D textures with a mip chain and no key/value data.
+ * Only what the texture compressor writes and Texture reads is supported:
+ * BC1 (DXT1) or BC3 (DXT5) blocks, one face, no array.
+ */
+struct KtxLevel {
+    int width;
+    int height;
+    const unsigned char *data;  // points into the parsed file
+    GLsizei size;
+};
+
+struct KtxTexture {
+    GLenum internalFormat;
+    GLenum baseInternalFormat;
+    int width;
+    int height;
+    std::vector<KtxLevel> levels;
+};
+
+// Parses a KTX file held in memory (typically mapped). The levels point
+// into data, which must outlive them. Returns false on malformed files,
+// other formats, or levels not holding exactly their blocks.
+bool parseKtx(const unsigned char *data, size_t size, KtxTexture &texture);
+
+// Writes a compressed texture, level 0 first
+bool writeKtx(const std::string &path, GLenum internalFormat, GLenum baseInternalFormat,
+              int width, int height, const std::vector<std::vector<unsigned char> > &levels);
+
+#endif // KTXFILE_H
@@ -0,0 +1,172 @@
+#include "LineBatch.h"
+#include "GLUtils.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+GLfloat LineBatch::unitCircle[LineBatch::kCircleSegments + 1][2];
+bool LineBatch::unitCircleReady = false;
+
+LineBatch::LineBatch(size_t capacity) :
+    capacity(capacity),
+    buffer(0),
+    persistent(false),
+    region(0),
+    mapped(NULL),
+    cursor(NULL),
+    used(0),
+    overflowWarned(false)
+{
+#ifdef GL_MAP_PERSISTENT_BIT
+    for(int i = 0; i < kRegions; ++i) fences[i] = 0;
+#endif
+
+    if(!unitCircleReady) {
+        for(int i = 0; i <= kCircleSegments; ++i) {
+            const double angle = 2.0 * 3.14159265358979 * (i % kCircleSegments) / kCircleSegments;
+            unitCircle[i][0] = (GLfloat)std::cos(angle);
+            unitCircle[i][1] = (GLfloat)std::sin(angle);
+        }
+        unitCircleReady = true;
+    }
+}
+
+LineBatch::~LineBatch()
+{
+    // The GL context may already be gone, the buffer goes with it
+}
+
+void LineBatch::init()
+{
+    const GLsizeiptr regionBytes = capacity * sizeof(Vertex);
+    glGenBuffers(1, &buffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    if(hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, kRegions * regionBytes, NULL, flags);
+        mapped = (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, kRegions * regionBytes, flags);
+        persistent = mapped != NULL;
+    }
+#endif
+
+    if(!persistent) {
+        glBufferData(GL_ARRAY_BUFFER, regionBytes, NULL, GL_STREAM_DRAW);
+        staging.resize(capacity);
+    }
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    region = 0;
+    beginRegion();
+}
+
+void LineBatch::beginRegion()
+{
+    used = 0;
+    firsts.clear();
+    counts.clear();
+
+    if(!persistent) {
+        cursor = staging.empty() ? NULL : &staging[0];
+        return;
+    }
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    // Wait until the GPU is done with what was drawn from this region three flushes ago
+    if(fences[region]) {
+        while(glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+#endif
+    cursor = mapped + region * capacity;
+}
+
+LineBatch::Vertex *LineBatch::reserve(GLsizei count)
+{
+    if(cursor == NULL || used + count > capacity) {
+        if(!overflowWarned && cursor != NULL) {
+            LOG_WARNING("LineBatch: more than %u vertices in one flush, extra primitives dropped", (unsigned int)capacity);
+            overflowWarned = true;
+        }
+        return NULL;
+    }
+
+    firsts.push_back((GLint)(persistent ? region * capacity + used : used));
+    counts.push_back(count);
+
+    Vertex *out = cursor;
+    cursor += count;
+    used += count;
+    return out;
+}
+
+void LineBatch::addLine(const GLfloat a[3], const GLfloat b[3], const GLubyte color[4])
+{
+    Vertex *out = reserve(2);
+    if(!out) return;
+
+    memcpy(out[0].position, a, sizeof(out[0].position));
+    memcpy(out[1].position, b, sizeof(out[1].position));
+    memcpy(out[0].color, color, sizeof(out[0].color));
+    memcpy(out[1].color, color, sizeof(out[1].color));
+}
+
+void LineBatch::addCircle(const GLfloat center[3], const GLfloat u[3], const GLfloat v[3], GLfloat radius, const GLubyte color[4])
+{
+    // The last entry of the table repeats the first one and closes the strip
+    Vertex *out = reserve(kCircleSegments + 1);
+    if(!out) return;
+
+    GLfloat ru[3], rv[3];
+    for(int k = 0; k < 3; ++k) {
+        ru[k] = radius * u[k];
+        rv[k] = radius * v[k];
+    }
+
+    for(int i = 0; i <= kCircleSegments; ++i) {
+        const GLfloat c = unitCircle[i][0];
+        const GLfloat s = unitCircle[i][1];
+        for(int k = 0; k < 3; ++k) out[i].position[k] = center[k] + c * ru[k] + s * rv[k];
+        memcpy(out[i].color, color, sizeof(out[i].color));
+    }
+}
+
+void LineBatch::flush()
+{
+    if(counts.empty()) return;
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    if(!persistent) {
+        // Orphan the previous contents instead of waiting for the draws reading them
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, used * sizeof(Vertex), &staging[0]);
+    }
+
+    glState.pushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_TEXTURE_2D);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+    glState.clientArrays(true, false, false, true);
+
+    glMultiDrawArrays(GL_LINE_STRIP, &firsts[0], &counts[0], (GLsizei)counts.size());
+    profiler.countDraw(0);
+
+    glState.popAttrib();
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    if(persistent) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+    region = (region + 1) % kRegions;
+    beginRegion();
+}
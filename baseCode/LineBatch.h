@@ -0,0 +1,76 @@
+#ifndef LINEBATCH_H
+#define LINEBATCH_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Batched lines and circles.
+ *
+ * Primitives are appended as line strips, straight into a vertex stream, and
+ * flush() draws all of them with one glMultiDrawArrays call. The stream is a
+ * buffer split in three regions, persistently mapped when the context has
+ * ARB_buffer_storage: the CPU writes one region while the GPU still reads
+ * the two previous ones, and a fence per region guarantees it never
+ * overwrites data in flight. Without persistent mapping the region is
+ * staged in memory and uploaded on flush.
+ *
+ * Vertices are in whatever space the matrices current at flush() expect,
+ * one batch per space (world, screen...).
+ */
+class LineBatch
+{
+public:
+    // Maximum number of vertices between two flushes
+    explicit LineBatch(size_t capacity = 1 << 16);
+    ~LineBatch();
+
+    // Needs a current GL context
+    void init();
+
+    void addLine(const GLfloat a[3], const GLfloat b[3], const GLubyte color[4]);
+
+    // Circle around center in the plane spanned by the unit vectors u and v
+    void addCircle(const GLfloat center[3], const GLfloat u[3], const GLfloat v[3], GLfloat radius, const GLubyte color[4]);
+
+    // Draws everything appended since the last flush
+    void flush();
+
+    // Segments used for a full circle
+    static const int kCircleSegments = 128;
+
+private:
+    struct Vertex {
+        GLfloat position[3];
+        GLubyte color[4];
+    };
+
+    Vertex *reserve(GLsizei count);
+    void beginRegion();
+
+    const size_t capacity;
+    static const int kRegions = 3;
+
+    GLuint buffer;
+    bool persistent;
+    int region;
+
+    Vertex *mapped;                 // start of the buffer (persistent) or null
+    std::vector<Vertex> staging;    // CPU region when not persistent
+    Vertex *cursor;                 // write position in the current region
+    size_t used;                    // vertices in the current region
+    bool overflowWarned;
+
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    GLsync fences[kRegions];
+#endif
+
+    // cos/sin of the circle segments, shared by all batches
+    static GLfloat unitCircle[kCircleSegments + 1][2];
+    static bool unitCircleReady;
+};
+
+#endif // LINEBATCH_H
@@ -0,0 +1,336 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+long long nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const unsigned long long kNoSequence = std::numeric_limits<unsigned long long>::max();
+
+// Single producer (its thread), single consumer (the writer)
+struct LogRing {
+    static const size_t kCapacity = 256;
+
+    LogRing() : head(0), tail(0), writing(kNoSequence), dropped(0), orphaned(false) {}
+
+    LogRecord records[kCapacity];
+    std::atomic<size_t> head;           // next slot written, producer
+    std::atomic<size_t> tail;           // next slot read, writer
+    // While a message is being written, at most its sequence
+    std::atomic<unsigned long long> writing;
+    std::atomic<unsigned long> dropped;
+    std::atomic<bool> orphaned;         // its thread is gone
+};
+
+std::atomic<unsigned long long> nextSequence(0);
+
+class LogWriter
+{
+public:
+    LogWriter() : flushRequested(0), flushDone(0)
+    {
+        std::thread(&LogWriter::loop, this).detach();
+    }
+
+    LogRing *addRing()
+    {
+        LogRing *ring = new LogRing;
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        const unsigned long ticket = ++flushRequested;
+        wake.notify_all();
+        done.wait(lock, [&] { return flushDone >= ticket; });
+    }
+
+private:
+    struct Pending {
+        unsigned long long sequence;
+        int level;
+        std::string text;
+        bool operator < (const Pending &other) const { return sequence < other.sequence; }
+    };
+
+    void loop();
+    // Returns false when messages wait on an earlier one still being written
+    bool drain();
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned long flushRequested, flushDone;
+    std::vector<LogRing*> rings;
+    std::vector<Pending> pending;
+};
+
+void flushAtExit()
+{
+    logFlush();
+}
+
+// Never destroyed: threads and static destructors may still log while the
+// program exits. What was logged before exit() is written out.
+LogWriter &writer()
+{
+    static LogWriter *instance = NULL;
+    static std::once_flag created;
+    std::call_once(created, [] {
+        instance = new LogWriter;
+        atexit(flushAtExit);
+    });
+    return *instance;
+}
+
+// The ring of the calling thread, created on its first message
+struct RingOwner {
+    RingOwner() : ring(NULL) {}
+    ~RingOwner() { if(ring) ring->orphaned.store(true, std::memory_order_release); }
+    LogRing *ring;
+};
+
+thread_local RingOwner owner;
+
+// Argument index as the conversion wants it
+long long asSigned(const LogRecord &r, int i)
+{
+    switch(r.types[i]) {
+    case LogRecord::Double: return (long long)r.values[i].d;
+    case LogRecord::Text: return 0;
+    default: return r.values[i].i;
+    }
+}
+
+double asDouble(const LogRecord &r, int i)
+{
+    switch(r.types[i]) {
+    case LogRecord::Double: return r.values[i].d;
+    case LogRecord::Signed: return (double)r.values[i].i;
+    case LogRecord::Unsigned: return (double)r.values[i].u;
+    default: return 0.0;
+    }
+}
+
+void formatRecord(const LogRecord &r, std::string &out)
+{
+    char buffer[256];
+    int arg = 0;
+    const char *f = r.format;
+
+    while(*f) {
+        if(*f != '%') {
+            out += *f++;
+            continue;
+        }
+        if(f[1] == '%') {
+            out += '%';
+            f += 2;
+            continue;
+        }
+
+        // Flags, width and precision are kept, the length modifier is
+        // replaced by the one of the stored value
+        const char *start = f++;
+        while(*f && strchr("-+ #0", *f)) ++f;
+        while(isdigit((unsigned char)*f) || *f == '.') ++f;
+        std::string spec(start, f - start);
+        while(*f && strchr("hlLqjzt", *f)) ++f;
+        const char conversion = *f;
+        if(conversion) ++f;
+
+        if(arg >= r.argCount) {
+            out += "(missing)";
+            continue;
+        }
+        const int i = arg++;
+
+        switch(conversion) {
+        case 'd': case 'i':
+            snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), asSigned(r, i));
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), (unsigned long long)asSigned(r, i));
+            break;
+        case 'c':
+            snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)asSigned(r, i));
+            break;
+        case 'p':
+            snprintf(buffer, sizeof(buffer), (spec + "p").c_str(), r.types[i] == LogRecord::Pointer ? r.values[i].p : NULL);
+            break;
+        case 's':
+            snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), r.types[i] == LogRecord::Text ? r.text + r.values[i].text : "?");
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), asDouble(r, i));
+            break;
+        default:
+            snprintf(buffer, sizeof(buffer), "%s", spec.c_str());
+            break;
+        }
+        out += buffer;
+    }
+}
+
+void LogWriter::loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        // Producers never wake the writer, it polls
+        wake.wait_for(lock, std::chrono::milliseconds(10));
+        const unsigned long ticket = flushRequested;
+
+        // A flush waits out the few messages held back, if it can
+        lock.unlock();
+        for(int tries = 0; !drain() && ticket > flushDone && tries < 100; ++tries) std::this_thread::yield();
+        lock.lock();
+
+        flushDone = ticket;
+        done.notify_all();
+    }
+}
+
+bool LogWriter::drain()
+{
+    // Messages below bound are all committed or in a ring already: the
+    // sequence is read first, so any message taking a lower one after that
+    // has marked its ring as writing by the time the rings are read below
+    unsigned long long bound = nextSequence.load();
+    std::vector<LogRing*> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = rings;
+    }
+    for(size_t k = 0; k < current.size(); ++k) bound = std::min(bound, current[k]->writing.load());
+
+    for(size_t k = 0; k < current.size(); ++k) {
+        LogRing *ring = current[k];
+        const size_t head = ring->head.load(std::memory_order_acquire);
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+        for(; tail != head; ++tail) {
+            const LogRecord &record = ring->records[tail % LogRing::kCapacity];
+            Pending message;
+            message.sequence = record.sequence;
+            message.level = record.level;
+            formatRecord(record, message.text);
+            if(record.skipped > 0) {
+                char note[64];
+                snprintf(note, sizeof(note), " (%u similar messages skipped)", record.skipped);
+                message.text += note;
+            }
+            pending.push_back(message);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        const unsigned long dropped = ring->dropped.exchange(0);
+        if(dropped > 0) {
+            Pending message;
+            message.sequence = nextSequence.fetch_add(1);
+            message.level = LogWarning;
+            message.text = "log: " + std::to_string(dropped) + " messages dropped, ring full";
+            pending.push_back(message);
+        }
+    }
+
+    // Threads that are gone and whose messages are all out
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t k = 0; k < rings.size();) {
+            LogRing *ring = rings[k];
+            if(ring->orphaned.load(std::memory_order_acquire) &&
+               ring->tail.load() == ring->head.load(std::memory_order_acquire)) {
+                delete ring;
+                rings.erase(rings.begin() + k);
+            } else {
+                ++k;
+            }
+        }
+    }
+
+    // Anything from bound on waits for the next drain, behind the message
+    // still being written
+    std::sort(pending.begin(), pending.end());
+    size_t ready = 0;
+    while(ready < pending.size() && pending[ready].sequence < bound) ++ready;
+
+    bool toOut = false, toErr = false;
+    for(size_t i = 0; i < ready; ++i) {
+        FILE *stream = pending[i].level >= LogWarning ? stderr : stdout;
+        fputs(pending[i].text.c_str(), stream);
+        fputc('\n', stream);
+        (stream == stderr ? toErr : toOut) = true;
+    }
+    if(toOut) fflush(stdout);
+    if(toErr) fflush(stderr);
+    pending.erase(pending.begin(), pending.begin() + ready);
+    return pending.empty();
+}
+
+}
+
+bool LogRateLimit::allow(unsigned int &skippedBefore)
+{
+    const long long now = nowMs();
+    long long start = windowStart.load(std::memory_order_relaxed);
+    if(now - start >= 1000 && windowStart.compare_exchange_strong(start, now)) count.store(0);
+
+    if(count.fetch_add(1) < kLogPerSecond) {
+        skippedBefore = skipped.exchange(0);
+        return true;
+    }
+    skipped.fetch_add(1);
+    return false;
+}
+
+LogRecord *logBegin(LogLevel level, unsigned int skipped, const char *format)
+{
+    if(!owner.ring) owner.ring = writer().addRing();
+    LogRing *ring = owner.ring;
+
+    const size_t head = ring->head.load(std::memory_order_relaxed);
+    if(head - ring->tail.load(std::memory_order_acquire) >= LogRing::kCapacity) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    // Marked before the sequence is taken, see LogWriter::drain()
+    ring->writing.store(nextSequence.load());
+    LogRecord &record = ring->records[head % LogRing::kCapacity];
+    record.sequence = nextSequence.fetch_add(1);
+    record.format = format;
+    record.level = (unsigned char)level;
+    record.argCount = 0;
+    record.skipped = skipped;
+    record.textUsed = 0;
+    return &record;
+}
+
+void logCommit()
+{
+    LogRing *ring = owner.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    ring->writing.store(kNoSequence);
+}
+
+void logFlush()
+{
+    writer().flush();
+}
@@ -0,0 +1,181 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/*
+ * Logging that never blocks the caller on I/O.
+ *
+ * LOG_INFO("loaded %s in %.1f ms", path, ms) copies the arguments, not the
+ * text, into a ring owned by the calling thread; a writer thread drains the
+ * rings of all threads, formats the messages and writes them, in the order
+ * they were logged: a message waits for any earlier one still being
+ * written, even past the current drain. A thread only ever writes to its
+ * own ring, so logging takes no lock: when the ring is full the message is
+ * dropped, and the drop is reported later.
+ *
+ * The format must be a string literal, with printf conversions. Strings
+ * are copied (up to a total of kLogTextBytes per message), so temporaries
+ * are fine; '*' widths are not supported.
+ *
+ * Levels below LOG_MIN_LEVEL compile out, arguments included: debug
+ * messages are gone from release builds. Each call site also logs at most
+ * kLogPerSecond messages a second, the next one says how many were
+ * skipped.
+ */
+
+enum LogLevel {
+    LogDebug = 0,
+    LogInfo,
+    LogWarning,     // this and above go to stderr
+    LogError
+};
+
+#ifndef LOG_MIN_LEVEL
+#if defined(NDEBUG) || defined(QT_NO_DEBUG)
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+#define LOG_AT(level, format, ...) \
+    do { \
+        if((level) >= LOG_MIN_LEVEL) { \
+            static LogRateLimit logLimit_; \
+            unsigned int logSkipped_; \
+            if(logLimit_.allow(logSkipped_)) logWrite((LogLevel)(level), logSkipped_, "" format, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#define LOG_DEBUG(format, ...) LOG_AT(LogDebug, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LogInfo, format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...) LOG_AT(LogWarning, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LogError, format, ##__VA_ARGS__)
+
+const int kLogPerSecond = 20;
+const int kLogMaxArgs = 8;
+const int kLogTextBytes = 160;
+
+// Per call site, shared by the threads logging from there
+class LogRateLimit
+{
+public:
+    constexpr LogRateLimit() : windowStart(0), count(0), skipped(0) {}
+
+    // skippedBefore: messages dropped since the last one allowed
+    bool allow(unsigned int &skippedBefore);
+
+private:
+    std::atomic<long long> windowStart;     // ms
+    std::atomic<int> count;
+    std::atomic<unsigned int> skipped;
+};
+
+// One message, as the writer thread receives it
+struct LogRecord
+{
+    enum Type { Signed, Unsigned, Double, Pointer, Text };
+
+    unsigned long long sequence;
+    const char *format;
+    unsigned char level;
+    unsigned char argCount;
+    unsigned char types[kLogMaxArgs];
+    unsigned int skipped;
+    union Value {
+        long long i;
+        unsigned long long u;
+        double d;
+        const void *p;
+        unsigned short text;    // offset in text
+    } values[kLogMaxArgs];
+    unsigned short textUsed;
+    char text[kLogTextBytes];
+};
+
+// Slot for the next message of the calling thread, NULL when its ring is full
+LogRecord *logBegin(LogLevel level, unsigned int skipped, const char *format);
+// Hands the slot to the writer
+void logCommit();
+
+// Writes out everything logged so far, and waits for it. Not for the hot paths.
+void logFlush();
+
+// Argument capture, by kind of type
+inline LogRecord::Value *logNextArg(LogRecord &record, LogRecord::Type type)
+{
+    if(record.argCount >= kLogMaxArgs) return NULL;
+    record.types[record.argCount] = type;
+    return &record.values[record.argCount++];
+}
+
+inline void logEncode(LogRecord &record, const char *text)
+{
+    LogRecord::Value *value = logNextArg(record, LogRecord::Text);
+    if(!value) return;
+    if(!text) text = "(null)";
+
+    // Truncated to what is left, always terminated. With no room left at
+    // all, the terminator of the previous string makes it empty.
+    const size_t room = kLogTextBytes - record.textUsed;
+    if(room == 0) {
+        value->text = kLogTextBytes - 1;
+        return;
+    }
+    const size_t length = std::min(strlen(text), room - 1);
+    value->text = record.textUsed;
+    memcpy(record.text + record.textUsed, text, length);
+    record.text[record.textUsed + length] = '\0';
+    record.textUsed += (unsigned short)(length + 1);
+}
+
+inline void logEncode(LogRecord &record, char *text) { logEncode(record, (const char*)text); }
+inline void logEncode(LogRecord &record, const std::string &text) { logEncode(record, text.c_str()); }
+
+template <typename T>
+inline void logEncode(LogRecord &record, T *pointer)
+{
+    LogRecord::Value *value = logNextArg(record, LogRecord::Pointer);
+    if(value) value->p = pointer;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+logEncode(LogRecord &record, T number)
+{
+    if(std::is_floating_point<T>::value) {
+        LogRecord::Value *value = logNextArg(record, LogRecord::Double);
+        if(value) value->d = (double)number;
+    } else if(std::is_signed<T>::value || std::is_enum<T>::value) {
+        LogRecord::Value *value = logNextArg(record, LogRecord::Signed);
+        if(value) value->i = (long long)number;
+    } else {
+        LogRecord::Value *value = logNextArg(record, LogRecord::Unsigned);
+        if(value) value->u = (unsigned long long)number;
+    }
+}
+
+inline void logEncodeAll(LogRecord &) {}
+
+template <typename T, typename... Rest>
+inline void logEncodeAll(LogRecord &record, const T &first, const Rest &... rest)
+{
+    logEncode(record, first);
+    logEncodeAll(record, rest...);
+}
+
+template <typename... Args>
+void logWrite(LogLevel level, unsigned int skipped, const char *format, const Args &... args)
+{
+    LogRecord *record = logBegin(level, skipped, format);
+    if(!record) return;
+    logEncodeAll(*record, args...);
+    logCommit();
+}
+
+#endif // LOG_H
@@ -0,0 +1,202 @@
+#include "Matrix4.h"
+#include "Base.h"
+
+#include <cmath>
+
+#ifdef VECMATH_SSE
+
+namespace {
+
+inline __m128 column(const Matrix4 &matrix, int c) { return _mm_load_ps(matrix.m + 4 * c); }
+
+// Column combination c0 * v.x + c1 * v.y + c2 * v.z + c3 * v.w
+inline __m128 combine(const Matrix4 &matrix, __m128 v)
+{
+    __m128 r = _mm_mul_ps(column(matrix, 0), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(column(matrix, 1), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r, _mm_mul_ps(column(matrix, 2), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    return _mm_add_ps(r, _mm_mul_ps(column(matrix, 3), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+}
+
+}
+
+#endif
+
+Matrix4 Matrix4::identity()
+{
+    Matrix4 result;
+    for(int i = 0; i < 16; ++i) result.m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    return result;
+}
+
+Matrix4 Matrix4::lookAt(const Vec3 &eye, const Vec3 &center, const Vec3 &up)
+{
+    // The camera looks down its -z axis
+    const Vec3 z = normalized(eye - center);
+    const Vec3 x = normalized(cross(up, z));
+    const Vec3 y = cross(z, x);
+
+    Matrix4 result;
+    result.m[0] = x.x; result.m[4] = x.y; result.m[8]  = x.z; result.m[12] = -dot(x, eye);
+    result.m[1] = y.x; result.m[5] = y.y; result.m[9]  = y.z; result.m[13] = -dot(y, eye);
+    result.m[2] = z.x; result.m[6] = z.y; result.m[10] = z.z; result.m[14] = -dot(z, eye);
+    result.m[3] = 0.0f; result.m[7] = 0.0f; result.m[11] = 0.0f; result.m[15] = 1.0f;
+    return result;
+}
+
+Matrix4 Matrix4::perspective(GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar)
+{
+    const GLfloat d = 1.0f / std::tan(fovy * (GLfloat)(PI / 360.0));
+    const GLfloat delta = zNear - zFar;
+
+    Matrix4 result;
+    for(int i = 0; i < 16; ++i) result.m[i] = 0.0f;
+    result.m[0] = d / aspect;
+    result.m[5] = d;
+    result.m[10] = (zNear + zFar) / delta;
+    result.m[11] = -1.0f;
+    result.m[14] = 2.0f * zNear * zFar / delta;
+    return result;
+}
+
+Matrix4 Matrix4::rotation(const Quat &q)
+{
+    const GLfloat xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const GLfloat xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const GLfloat wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    Matrix4 result = identity();
+    result.m[0] = 1.0f - 2.0f * (yy + zz);
+    result.m[1] = 2.0f * (xy + wz);
+    result.m[2] = 2.0f * (xz - wy);
+    result.m[4] = 2.0f * (xy - wz);
+    result.m[5] = 1.0f - 2.0f * (xx + zz);
+    result.m[6] = 2.0f * (yz + wx);
+    result.m[8] = 2.0f * (xz + wy);
+    result.m[9] = 2.0f * (yz - wx);
+    result.m[10] = 1.0f - 2.0f * (xx + yy);
+    return result;
+}
+
+void Matrix4::multiply(const Matrix4 &other)
+{
+#ifdef VECMATH_SSE
+    // Column c of the product combines the columns of this with column c of other
+    __m128 result[4];
+    for(int c = 0; c < 4; ++c) result[c] = combine(*this, column(other, c));
+    for(int c = 0; c < 4; ++c) _mm_store_ps(m + 4 * c, result[c]);
+#else
+    GLfloat result[16];
+    for(int column = 0; column < 4; ++column)
+        for(int row = 0; row < 4; ++row) {
+            GLfloat sum = 0.0f;
+            for(int k = 0; k < 4; ++k) sum += m[4 * k + row] * other.m[4 * column + k];
+            result[4 * column + row] = sum;
+        }
+    for(int i = 0; i < 16; ++i) m[i] = result[i];
+#endif
+}
+
+void Matrix4::translate(GLfloat x, GLfloat y, GLfloat z)
+{
+    // Only the last column changes
+#ifdef VECMATH_SSE
+    _mm_store_ps(m + 12, combine(*this, _mm_setr_ps(x, y, z, 1.0f)));
+#else
+    for(int row = 0; row < 4; ++row) m[12 + row] += m[row] * x + m[4 + row] * y + m[8 + row] * z;
+#endif
+}
+
+void Matrix4::rotate(GLfloat degrees, GLfloat x, GLfloat y, GLfloat z)
+{
+    rotate(Quat::fromAxisAngle(degrees, Vec3(x, y, z)));
+}
+
+void Matrix4::rotate(const Quat &q)
+{
+    multiply(rotation(q));
+}
+
+void Matrix4::scale(GLfloat x, GLfloat y, GLfloat z)
+{
+#ifdef VECMATH_SSE
+    _mm_store_ps(m, _mm_mul_ps(column(*this, 0), _mm_set1_ps(x)));
+    _mm_store_ps(m + 4, _mm_mul_ps(column(*this, 1), _mm_set1_ps(y)));
+    _mm_store_ps(m + 8, _mm_mul_ps(column(*this, 2), _mm_set1_ps(z)));
+#else
+    for(int row = 0; row < 4; ++row) {
+        m[row] *= x;
+        m[4 + row] *= y;
+        m[8 + row] *= z;
+    }
+#endif
+}
+
+Matrix4 Matrix4::inverse() const
+{
+    // Adjugate over determinant, cofactors expanded as in MESA's gluInvertMatrix
+    Matrix4 inv;
+    GLfloat *r = inv.m;
+    r[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    r[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    r[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    r[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    r[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    r[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    r[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    r[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    r[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    r[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    r[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    r[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    r[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    r[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    r[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    r[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    const GLfloat det = m[0] * r[0] + m[1] * r[4] + m[2] * r[8] + m[3] * r[12];
+    const GLfloat scale = det != 0.0f ? 1.0f / det : 0.0f;
+    for(int i = 0; i < 16; ++i) r[i] *= scale;
+    return inv;
+}
+
+Vec4 Matrix4::transform(const Vec4 &v) const
+{
+#ifdef VECMATH_SSE
+    return toVec4(combine(*this, load(v)));
+#else
+    return Vec4(m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w,
+                m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+                m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w,
+                m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w);
+#endif
+}
+
+Vec3 Matrix4::transformPoint(const Vec3 &p) const
+{
+    return transform(Vec4(p, 1.0f)).xyz();
+}
+
+void Frustum::extract(const Matrix4 &clip)
+{
+    // Gribb and Hartmann: each plane is the last row of the matrix plus or minus another one
+    Vec4 rows[4];
+    for(int row = 0; row < 4; ++row)
+        rows[row] = Vec4(clip.m[row], clip.m[4 + row], clip.m[8 + row], clip.m[12 + row]);
+
+    for(int i = 0; i < 6; ++i) {
+        const Vec4 &other = rows[i / 2];
+        planes[i] = (i % 2 == 0) ? rows[3] + other : rows[3] - other;
+
+        const GLfloat length = std::sqrt(dot(planes[i].xyz(), planes[i].xyz()));
+        if(length > 0.0f) planes[i] = planes[i] * (1.0f / length);
+    }
+}
+
+bool Frustum::intersectsSphere(const Vec3 &center, GLfloat radius) const
+{
+    const Vec4 point(center, 1.0f);
+    for(int i = 0; i < 6; ++i)
+        if(dot(planes[i], point) < -radius) return false;
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef MATRIX4_H
+#define MATRIX4_H
+
+#include <QtOpenGL>
+
+#include "VecMath.h"
+
+/*
+ * Column major 4x4 matrix, laid out like the OpenGL matrix stacks, with the
+ * same post-multiplying helpers as glTranslate/glRotate/glScale. Lets the
+ * scene be transformed away from the GL thread. Columns are 16 byte
+ * aligned and multiplied with SSE when the target has it.
+ */
+struct alignas(16) Matrix4
+{
+    GLfloat m[16];
+
+    static Matrix4 identity();
+
+    // Same matrices as gluLookAt and gluPerspective (fovy in degrees)
+    static Matrix4 lookAt(const Vec3 &eye, const Vec3 &center, const Vec3 &up);
+    static Matrix4 perspective(GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar);
+    static Matrix4 rotation(const Quat &q);
+
+    // this = this * other, like glMultMatrix
+    void multiply(const Matrix4 &other);
+
+    void translate(GLfloat x, GLfloat y, GLfloat z);
+    void rotate(GLfloat degrees, GLfloat x, GLfloat y, GLfloat z);
+    void rotate(const Quat &q);
+    void scale(GLfloat x, GLfloat y, GLfloat z);
+
+    // All zero when the matrix is singular
+    Matrix4 inverse() const;
+
+    Vec4 transform(const Vec4 &v) const;
+    // w = 1, the result is not divided by its w
+    Vec3 transformPoint(const Vec3 &p) const;
+};
+
+inline Matrix4 operator * (const Matrix4 &a, const Matrix4 &b)
+{
+    Matrix4 result = a;
+    result.multiply(b);
+    return result;
+}
+
+// Clip planes of a projection * modelview matrix, normalized, pointing inside
+struct Frustum
+{
+    Vec4 planes[6];
+
+    void extract(const Matrix4 &clip);
+
+    // False when the sphere is entirely outside one of the planes
+    bool intersectsSphere(const Vec3 &center, GLfloat radius) const;
+};
+
+#endif // MATRIX4_H
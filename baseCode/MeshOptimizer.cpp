@@ -0,0 +1,278 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Tuning of Forsyth's scoring function, values from the original article
+const int kCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, unsigned int remaining)
+{
+    if(remaining == 0) return -1.0f; // no triangle left needs this vertex
+
+    float score = 0.0f;
+    if(cachePosition >= 0) {
+        if(cachePosition < 3) {
+            // Used by the last triangle: slightly penalised so that the next
+            // triangle does not simply walk back over the same edge
+            score = kLastTriangleScore;
+        } else {
+            const float scale = 1.0f / (kCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, kCacheDecayPower);
+        }
+    }
+
+    // Favour vertices with few triangles left, to finish them off
+    score += kValenceBoostScale * std::pow((float)remaining, -kValenceBoostPower);
+    return score;
+}
+
+}
+
+VertexCacheStats analyzeVertexCache(const GLuint *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if(indexCount < 3) return stats;
+
+    // FIFO: a vertex is in the cache if it was inserted less than cacheSize misses ago
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    unsigned int misses = 0;
+    size_t unique = 0;
+
+    for(size_t i = 0; i < indexCount; ++i) {
+        const GLuint v = indices[i];
+        if(!referenced[v]) {
+            referenced[v] = true;
+            ++unique;
+        }
+        if(insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize) {
+            ++misses;
+            insertedAt[v] = misses; // 1-based, 0 means never
+        }
+    }
+
+    stats.acmr = (float)misses / (indexCount / 3);
+    stats.atvr = (float)misses / unique;
+    return stats;
+}
+
+void optimizeVertexCache(GLuint *indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0) return;
+
+    // Triangles around each vertex, in one flat array
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < indexCount; ++i) ++offsets[indices[i] + 1];
+    for(size_t v = 0; v < vertexCount; ++v) offsets[v + 1] += offsets[v];
+
+    std::vector<unsigned int> remaining(vertexCount, 0);     // live triangles per vertex
+    std::vector<unsigned int> adjacency(indexCount);
+    for(size_t t = 0; t < triangleCount; ++t)
+        for(int k = 0; k < 3; ++k) {
+            const GLuint v = indices[3 * t + k];
+            adjacency[offsets[v] + remaining[v]++] = (unsigned int)t;
+        }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v) score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    for(size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<GLuint> output;
+    output.reserve(indexCount);
+
+    std::vector<GLuint> cache, nextCache;
+    cache.reserve(kCacheSize + 3);
+    nextCache.reserve(kCacheSize + 3);
+
+    size_t cursor = 0;      // first triangle that may not be emitted yet
+    long best = 0;
+
+    while(output.size() < indexCount) {
+        if(best < 0) {
+            // Nothing adjacent to the cache: restart from the next triangle in input order
+            while(emitted[cursor]) ++cursor;
+            best = (long)cursor;
+        }
+
+        const GLuint *tri = &indices[3 * best];
+        output.insert(output.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        // Drop the triangle from the adjacency of its vertices
+        for(int k = 0; k < 3; ++k) {
+            const GLuint v = tri[k];
+            unsigned int *list = &adjacency[offsets[v]];
+            for(unsigned int i = 0; i < remaining[v]; ++i) {
+                if(list[i] == (unsigned int)best) {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        // The triangle vertices go to the front of the LRU cache
+        nextCache.assign(tri, tri + 3);
+        for(size_t i = 0; i < cache.size(); ++i)
+            if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2]) nextCache.push_back(cache[i]);
+
+        // Rescore the vertices whose cache position changed, evicted ones included
+        for(size_t i = 0; i < nextCache.size(); ++i) {
+            const GLuint v = nextCache[i];
+            cachePosition[v] = i < (size_t)kCacheSize ? (int)i : -1;
+
+            const float updated = vertexScore(cachePosition[v], remaining[v]);
+            const float delta = updated - score[v];
+            score[v] = updated;
+
+            const unsigned int *list = &adjacency[offsets[v]];
+            for(unsigned int j = 0; j < remaining[v]; ++j) triangleScore[list[j]] += delta;
+        }
+
+        if(nextCache.size() > (size_t)kCacheSize) nextCache.resize(kCacheSize);
+        cache.swap(nextCache);
+
+        // Next triangle: the best scored one around the cached vertices
+        best = -1;
+        float bestScore = -1.0f;
+        for(size_t i = 0; i < cache.size(); ++i) {
+            const GLuint v = cache[i];
+            const unsigned int *list = &adjacency[offsets[v]];
+            for(unsigned int j = 0; j < remaining[v]; ++j) {
+                if(triangleScore[list[j]] > bestScore) {
+                    bestScore = triangleScore[list[j]];
+                    best = (long)list[j];
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(GLuint *indices, size_t indexCount, const std::vector<GLfloat> &positions)
+{
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2) return;
+
+    const size_t vertexCount = positions.size() / 3;
+    const unsigned int cacheSize = 16;
+
+    // Cluster boundaries: triangles missing the cache on all three vertices,
+    // moving such a run around costs no extra transform
+    std::vector<size_t> clusterStart;
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int misses = 0;
+
+    for(size_t t = 0; t < triangleCount; ++t) {
+        int triangleMisses = 0;
+        for(int k = 0; k < 3; ++k) {
+            const GLuint v = indices[3 * t + k];
+            if(insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize) {
+                ++misses;
+                ++triangleMisses;
+                insertedAt[v] = misses;
+            }
+        }
+        if(t == 0 || triangleMisses == 3) clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+
+    const size_t clusterCount = clusterStart.size() - 1;
+    if(clusterCount < 2) return;
+
+    // Area weighted centroid and normal of every cluster, and of the mesh
+    std::vector<double> centroid(3 * clusterCount, 0.0), normal(3 * clusterCount, 0.0);
+    std::vector<double> area(clusterCount, 0.0);
+    double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+
+    for(size_t c = 0; c < clusterCount; ++c) {
+        for(size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t) {
+            const GLfloat *a = &positions[3 * indices[3 * t]];
+            const GLfloat *b = &positions[3 * indices[3 * t + 1]];
+            const GLfloat *d = &positions[3 * indices[3 * t + 2]];
+
+            const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const double v[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            const double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+            const double w = 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for(int k = 0; k < 3; ++k) {
+                centroid[3 * c + k] += w * (a[k] + b[k] + d[k]) / 3.0;
+                normal[3 * c + k] += n[k];
+            }
+            area[c] += w;
+        }
+
+        for(int k = 0; k < 3; ++k) meshCentroid[k] += centroid[3 * c + k];
+        meshArea += area[c];
+    }
+
+    if(meshArea <= 0.0) return;
+    for(int k = 0; k < 3; ++k) meshCentroid[k] /= meshArea;
+
+    // Clusters far out along their own normal are likely to occlude the rest
+    std::vector<std::pair<double, size_t> > order(clusterCount);
+    for(size_t c = 0; c < clusterCount; ++c) {
+        double key = 0.0;
+        const double *n = &normal[3 * c];
+        const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(area[c] > 0.0 && length > 0.0) {
+            for(int k = 0; k < 3; ++k) key += (centroid[3 * c + k] / area[c] - meshCentroid[k]) * n[k] / length;
+        }
+        order[c] = std::make_pair(-key, c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(indexCount);
+    for(size_t i = 0; i < clusterCount; ++i) {
+        const size_t c = order[i].second;
+        sorted.insert(sorted.end(), indices + 3 * clusterStart[c], indices + 3 * clusterStart[c + 1]);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+void optimizeVertexFetch(std::vector<GLuint> &indices,
+                         std::vector<GLfloat> &positions,
+                         std::vector<GLfloat> &uvs,
+                         std::vector<GLfloat> &normals)
+{
+    const size_t vertexCount = positions.size() / 3;
+    const GLuint unused = (GLuint)-1;
+
+    std::vector<GLuint> remap(vertexCount, unused);
+    GLuint next = 0;
+    for(size_t i = 0; i < indices.size(); ++i) {
+        GLuint &slot = remap[indices[i]];
+        if(slot == unused) slot = next++;
+        indices[i] = slot;
+    }
+
+    std::vector<GLfloat> outPositions(3 * next), outUvs(2 * next), outNormals(3 * next);
+    for(size_t v = 0; v < vertexCount; ++v) {
+        const GLuint to = remap[v];
+        if(to == unused) continue;
+        std::copy(&positions[3 * v], &positions[3 * v] + 3, &outPositions[3 * to]);
+        std::copy(&uvs[2 * v], &uvs[2 * v] + 2, &outUvs[2 * to]);
+        std::copy(&normals[3 * v], &normals[3 * v] + 3, &outNormals[3 * to]);
+    }
+
+    positions.swap(outPositions);
+    uvs.swap(outUvs);
+    normals.swap(outNormals);
+}
@@ -0,0 +1,41 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Index and vertex buffer reordering for indexed triangle lists.
+ *
+ * The usual pipeline is optimizeVertexCache, then optimizeOverdraw, then
+ * optimizeVertexFetch once every index buffer using the vertices is final.
+ */
+
+// Post-transform cache efficiency of an index buffer, measured by simulating
+// a FIFO cache of the given size.
+struct VertexCacheStats {
+    float acmr;     // average cache miss ratio: transformed vertices per triangle (0.5 is ideal)
+    float atvr;     // average transform to vertex ratio: transformed / referenced vertices (1 is ideal)
+};
+
+VertexCacheStats analyzeVertexCache(const GLuint *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders the triangles for post-transform cache locality (Forsyth's
+// linear-speed vertex cache optimisation).
+void optimizeVertexCache(GLuint *indices, size_t indexCount, size_t vertexCount);
+
+// Reorders clusters of cache-optimised triangles so that the ones facing
+// outwards, away from the mesh center, come first (Sander et al., view
+// independent overdraw reduction). Clusters start where the simulated cache
+// misses all three vertices, so the cache efficiency is left untouched.
+void optimizeOverdraw(GLuint *indices, size_t indexCount, const std::vector<GLfloat> &positions);
+
+// Renumbers the vertices in the order the index buffer first uses them, so
+// fetches walk the vertex buffers forward. Unreferenced vertices are dropped.
+// The attribute arrays have 3, 2 and 3 floats per vertex.
+void optimizeVertexFetch(std::vector<GLuint> &indices,
+                         std::vector<GLfloat> &positions,
+                         std::vector<GLfloat> &uvs,
+                         std::vector<GLfloat> &normals);
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,300 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+namespace {
+
+// Symmetric 4x4 matrix of the plane equations: a2 ab ac ad b2 bc bd c2 cd d2
+struct Quadric {
+    double q[10];
+
+    Quadric() { memset(q, 0, sizeof(q)); }
+
+    Quadric(double a, double b, double c, double d) {
+        q[0] = a * a; q[1] = a * b; q[2] = a * c; q[3] = a * d;
+        q[4] = b * b; q[5] = b * c; q[6] = b * d;
+        q[7] = c * c; q[8] = c * d;
+        q[9] = d * d;
+    }
+
+    void operator += (const Quadric &o) {
+        for(int i = 0; i < 10; ++i) q[i] += o.q[i];
+    }
+
+    // Sum of the squared distances of p to the accumulated planes
+    double evaluate(const double *p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+             + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+             + q[7] * z * z + 2 * q[8] * z
+             + q[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    GLuint from, to;            // position ids
+    unsigned int fromVersion, toVersion;
+
+    bool operator < (const Collapse &o) const { return cost > o.cost; } // min-heap
+};
+
+void triangleNormal(const double *a, const double *b, const double *c, double *n)
+{
+    const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+double length(const double *n)
+{
+    return std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+unsigned long long edgeKey(GLuint a, GLuint b)
+{
+    if(a > b) std::swap(a, b);
+    return ((unsigned long long)a << 32) | b;
+}
+
+}
+
+MeshSimplifier::MeshSimplifier(std::vector<GLfloat> &_positions, std::vector<GLfloat> &_uvs, std::vector<GLfloat> &_normals)
+    : positions(_positions), uvs(_uvs), normals(_normals)
+{
+    const size_t vertexCount = positions.size() / 3;
+    vertexIndex.reserve(vertexCount);
+    positionOf.resize(vertexCount);
+
+    // Same key type for positions alone, with the attributes zeroed
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> positionIndex;
+    positionIndex.reserve(vertexCount);
+
+    for(size_t v = 0; v < vertexCount; ++v) {
+        vertexIndex.insert(std::make_pair(keyOf((GLuint)v), (GLuint)v));
+
+        VertexKey key;
+        memset(key.data, 0, sizeof(key.data));
+        memcpy(key.data, &positions[3 * v], 3 * sizeof(GLfloat));
+
+        std::pair<std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator, bool> inserted =
+                positionIndex.insert(std::make_pair(key, (GLuint)verticesAt.size()));
+        if(inserted.second) {
+            verticesAt.push_back(std::vector<GLuint>());
+            uvSeam.push_back(false);
+        }
+
+        const GLuint p = inserted.first->second;
+        positionOf[v] = p;
+
+        // A second uv at the same position is a uv seam
+        for(size_t i = 0; i < verticesAt[p].size(); ++i) {
+            const GLuint other = verticesAt[p][i];
+            if(uvs[2 * other] != uvs[2 * v] || uvs[2 * other + 1] != uvs[2 * v + 1]) uvSeam[p] = true;
+        }
+        verticesAt[p].push_back((GLuint)v);
+    }
+}
+
+VertexKey MeshSimplifier::keyOf(GLuint vertex) const
+{
+    return vertexKey(positions, uvs, normals, vertex);
+}
+
+GLuint MeshSimplifier::moveCorner(GLuint corner, GLuint at)
+{
+    const std::vector<GLuint> &candidates = verticesAt[at];
+
+    GLuint best = candidates[0];
+    float bestDistance = FLT_MAX;
+    for(size_t i = 0; i < candidates.size(); ++i) {
+        const float du = uvs[2 * candidates[i]] - uvs[2 * corner];
+        const float dv = uvs[2 * candidates[i] + 1] - uvs[2 * corner + 1];
+        if(du * du + dv * dv < bestDistance) {
+            bestDistance = du * du + dv * dv;
+            best = candidates[i];
+        }
+    }
+
+    VertexKey key;
+    memcpy(key.data, &positions[3 * best], 3 * sizeof(GLfloat));
+    memcpy(key.data + 3, &uvs[2 * best], 2 * sizeof(GLfloat));
+    memcpy(key.data + 5, &normals[3 * corner], 3 * sizeof(GLfloat));
+
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash>::const_iterator found = vertexIndex.find(key);
+    if(found != vertexIndex.end()) return found->second;
+
+    const GLuint created = (GLuint)(positions.size() / 3);
+    positions.insert(positions.end(), key.data, key.data + 3);
+    uvs.insert(uvs.end(), key.data + 3, key.data + 5);
+    normals.insert(normals.end(), key.data + 5, key.data + 8);
+    vertexIndex.insert(std::make_pair(key, created));
+    positionOf.push_back(at);
+    verticesAt[at].push_back(created);
+    return created;
+}
+
+float MeshSimplifier::simplify(const std::vector<GLuint> &indices, size_t targetTriangles, std::vector<GLuint> &result)
+{
+    const size_t positionCount = verticesAt.size();
+    std::vector<GLuint> triangles(indices);
+    const size_t triangleCount = triangles.size() / 3;
+
+    // Positions are read often and the vertex arrays may grow: keep a copy
+    std::vector<double> point(3 * positionCount);
+    for(size_t p = 0; p < positionCount; ++p)
+        for(int k = 0; k < 3; ++k) point[3 * p + k] = positions[3 * verticesAt[p][0] + k];
+
+    std::vector<bool> alive(triangleCount, true);
+    size_t liveTriangles = triangleCount;
+
+    // Per position data: incident triangles, error quadric, lock and version
+    std::vector<std::vector<GLuint> > incident(positionCount);
+    std::vector<Quadric> quadrics(positionCount);
+    std::vector<bool> locked(uvSeam);
+    std::vector<unsigned int> version(positionCount, 0);
+
+    std::unordered_map<unsigned long long, int> edgeUse;
+    edgeUse.reserve(triangles.size());
+
+    for(size_t t = 0; t < triangleCount; ++t) {
+        const GLuint p[3] = { positionOf[triangles[3 * t]], positionOf[triangles[3 * t + 1]], positionOf[triangles[3 * t + 2]] };
+        if(p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+            alive[t] = false;
+            --liveTriangles;
+            continue;
+        }
+
+        double n[3];
+        triangleNormal(&point[3 * p[0]], &point[3 * p[1]], &point[3 * p[2]], n);
+        const double len = length(n);
+        if(len > 0.0) {
+            n[0] /= len; n[1] /= len; n[2] /= len;
+            const double *o = &point[3 * p[0]];
+            const Quadric plane(n[0], n[1], n[2], -(n[0] * o[0] + n[1] * o[1] + n[2] * o[2]));
+            for(int k = 0; k < 3; ++k) quadrics[p[k]] += plane;
+        }
+
+        for(int k = 0; k < 3; ++k) {
+            incident[p[k]].push_back((GLuint)t);
+            ++edgeUse[edgeKey(p[k], p[(k + 1) % 3])];
+        }
+    }
+
+    // Border edges belong to a single triangle, keep them where they are
+    for(std::unordered_map<unsigned long long, int>::const_iterator it = edgeUse.begin(); it != edgeUse.end(); ++it) {
+        if(it->second != 1) continue;
+        locked[(GLuint)(it->first >> 32)] = true;
+        locked[(GLuint)(it->first & 0xffffffffu)] = true;
+    }
+
+    std::priority_queue<Collapse> queue;
+    const auto pushCollapse = [&](GLuint from, GLuint to) {
+        if(locked[from] || from == to) return;
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        Collapse c;
+        c.cost = std::max(0.0, q.evaluate(&point[3 * to]));
+        c.from = from;
+        c.to = to;
+        c.fromVersion = version[from];
+        c.toVersion = version[to];
+        queue.push(c);
+    };
+
+    for(std::unordered_map<unsigned long long, int>::const_iterator it = edgeUse.begin(); it != edgeUse.end(); ++it) {
+        const GLuint a = (GLuint)(it->first >> 32);
+        const GLuint b = (GLuint)(it->first & 0xffffffffu);
+        pushCollapse(a, b);
+        pushCollapse(b, a);
+    }
+
+    const auto cornerOf = [&](GLuint t, GLuint position) {
+        for(int k = 0; k < 3; ++k)
+            if(positionOf[triangles[3 * t + k]] == position) return k;
+        return -1;
+    };
+
+    double maxCost = 0.0;
+
+    while(liveTriangles > targetTriangles && !queue.empty()) {
+        const Collapse c = queue.top();
+        queue.pop();
+
+        if(c.fromVersion != version[c.from] || c.toVersion != version[c.to]) continue; // stale
+
+        // Reject the collapse if one of the remaining triangles would flip
+        bool valid = true;
+        for(size_t i = 0; i < incident[c.from].size() && valid; ++i) {
+            const GLuint t = incident[c.from][i];
+            if(!alive[t] || cornerOf(t, c.to) >= 0) continue; // dead or about to vanish
+
+            const double *corners[3];
+            const double *moved[3];
+            for(int k = 0; k < 3; ++k) {
+                const GLuint p = positionOf[triangles[3 * t + k]];
+                corners[k] = &point[3 * p];
+                moved[k] = p == c.from ? &point[3 * c.to] : corners[k];
+            }
+
+            double before[3], after[3];
+            triangleNormal(corners[0], corners[1], corners[2], before);
+            triangleNormal(moved[0], moved[1], moved[2], after);
+            const double lb = length(before), la = length(after);
+            if(la <= 0.0 || (lb > 0.0 && (before[0] * after[0] + before[1] * after[1] + before[2] * after[2]) < 0.2 * lb * la))
+                valid = false;
+        }
+        if(!valid) continue;
+
+        // Move the triangles of `from` onto `to`, dropping the degenerate ones
+        for(size_t i = 0; i < incident[c.from].size(); ++i) {
+            const GLuint t = incident[c.from][i];
+            if(!alive[t]) continue;
+            if(cornerOf(t, c.to) >= 0) {
+                alive[t] = false;
+                --liveTriangles;
+                continue;
+            }
+            const int k = cornerOf(t, c.from);
+            triangles[3 * t + k] = moveCorner(triangles[3 * t + k], c.to);
+            incident[c.to].push_back(t);
+        }
+        incident[c.from].clear();
+
+        quadrics[c.to] += quadrics[c.from];
+        maxCost = std::max(maxCost, c.cost);
+        ++version[c.from];
+        ++version[c.to];
+
+        // The cost of every edge around `to` changed
+        std::vector<GLuint> &around = incident[c.to];
+        size_t kept = 0;
+        for(size_t i = 0; i < around.size(); ++i) {
+            const GLuint t = around[i];
+            if(!alive[t]) continue;
+            around[kept++] = t;
+            for(int k = 0; k < 3; ++k) {
+                const GLuint p = positionOf[triangles[3 * t + k]];
+                if(p == c.to) continue;
+                pushCollapse(p, c.to);
+                pushCollapse(c.to, p);
+            }
+        }
+        around.resize(kept);
+    }
+
+    result.clear();
+    result.reserve(3 * liveTriangles);
+    for(size_t t = 0; t < triangleCount; ++t) {
+        if(!alive[t]) continue;
+        result.insert(result.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+    }
+
+    return (float)std::sqrt(maxCost);
+}
@@ -0,0 +1,55 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <QtOpenGL>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshUtils.h"
+
+/*
+ * Quadric error metric simplification (Garland & Heckbert) of an indexed
+ * triangle mesh.
+ *
+ * Collapses work on positions: all the vertices sitting at one position move
+ * together, so hard edges (vertices split by their normal) never crack. Edges
+ * are collapsed onto one of their endpoints (half-edge collapse) and every
+ * moved corner keeps its own normal, which preserves hard edges and flat
+ * shading. Positions carrying more than one uv (uv seams) and positions on a
+ * border are locked, which keeps seams and borders in place.
+ *
+ * Moved corners may need a vertex that does not exist yet (old normal at the
+ * new position); it is appended to the vertex arrays, so index buffers of
+ * every level keep referencing the same, shared, vertex buffer.
+ */
+class MeshSimplifier
+{
+public:
+    // The arrays (3, 2 and 3 floats per vertex) are the buffer the indices
+    // refer to. They must outlive the simplifier, which may append to them.
+    MeshSimplifier(std::vector<GLfloat> &positions, std::vector<GLfloat> &uvs, std::vector<GLfloat> &normals);
+
+    // Simplifies the triangles of `indices` down to at most targetTriangles
+    // (or as far as the locked positions allow). Returns the geometric error
+    // of the result, i.e. how far (in model units) the surface may have moved.
+    float simplify(const std::vector<GLuint> &indices, size_t targetTriangles, std::vector<GLuint> &result);
+
+private:
+    VertexKey keyOf(GLuint vertex) const;
+    // Vertex with the position of `at` and the uv closest to the one of
+    // `corner`, keeping the normal of `corner`
+    GLuint moveCorner(GLuint corner, GLuint at);
+
+    std::vector<GLfloat> &positions;
+    std::vector<GLfloat> &uvs;
+    std::vector<GLfloat> &normals;
+
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> vertexIndex;
+
+    // Position id of every vertex, and the vertices found at every position
+    std::vector<GLuint> positionOf;
+    std::vector<std::vector<GLuint> > verticesAt;
+    std::vector<bool> uvSeam;
+};
+
+#endif // MESHSIMPLIFIER_H
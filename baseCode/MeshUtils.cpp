@@ -0,0 +1,94 @@
+#include "MeshUtils.h"
+#include "PointArrays.h"
+
+#include <cstring>
+#include <unordered_map>
+
+bool VertexKey::operator == (const VertexKey &other) const
+{
+    return memcmp(data, other.data, sizeof(data)) == 0;
+}
+
+size_t VertexKeyHash::operator () (const VertexKey &key) const
+{
+    // FNV-1a over the raw bytes, equal floats have equal bits here
+    const unsigned char *bytes = (const unsigned char *)key.data;
+    size_t hash = 2166136261u;
+    for(size_t i = 0; i < sizeof(key.data); ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+VertexKey vertexKey(const std::vector<GLfloat> &positions, const std::vector<GLfloat> &uvs,
+                    const std::vector<GLfloat> &normals, size_t vertex)
+{
+    VertexKey key;
+    memcpy(key.data, &positions[3 * vertex], 3 * sizeof(GLfloat));
+    memcpy(key.data + 3, &uvs[2 * vertex], 2 * sizeof(GLfloat));
+    memcpy(key.data + 5, &normals[3 * vertex], 3 * sizeof(GLfloat));
+    return key;
+}
+
+void weldVertices(std::vector<GLfloat> &positions,
+                  std::vector<GLfloat> &uvs,
+                  std::vector<GLfloat> &normals,
+                  std::vector<GLuint> &indices)
+{
+    const size_t corners = positions.size() / 3;
+
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> unique;
+    unique.reserve(corners);
+
+    std::vector<GLfloat> outPositions, outUvs, outNormals;
+    outPositions.reserve(positions.size());
+    outUvs.reserve(uvs.size());
+    outNormals.reserve(normals.size());
+
+    indices.clear();
+    indices.reserve(corners);
+
+    for(size_t i = 0; i < corners; ++i) {
+        const VertexKey key = vertexKey(positions, uvs, normals, i);
+
+        const GLuint next = (GLuint)(outPositions.size() / 3);
+        std::pair<std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator, bool> inserted =
+                unique.insert(std::make_pair(key, next));
+
+        if(inserted.second) {
+            outPositions.insert(outPositions.end(), key.data, key.data + 3);
+            outUvs.insert(outUvs.end(), key.data + 3, key.data + 5);
+            outNormals.insert(outNormals.end(), key.data + 5, key.data + 8);
+        }
+        indices.push_back(inserted.first->second);
+    }
+
+    positions.swap(outPositions);
+    uvs.swap(outUvs);
+    normals.swap(outNormals);
+}
+
+void boundingSphere(const std::vector<GLfloat> &positions, GLfloat center[3], GLfloat &radius)
+{
+    PointArrays points;
+    points.assignInterleaved(positions.empty() ? NULL : &positions[0], positions.size() / 3);
+    if(points.size() == 0) {
+        center[0] = center[1] = center[2] = 0.0f;
+        radius = 0.0f;
+        return;
+    }
+
+    GLfloat lo[3], hi[3];
+    pointBounds(points, lo, hi);
+    for(int k = 0; k < 3; ++k) center[k] = 0.5f * (lo[k] + hi[k]);
+    radius = maxDistance(points, center);
+}
+
+void normalizeVectors(std::vector<GLfloat> &vectors)
+{
+    PointArrays soa;
+    soa.assignInterleaved(vectors.empty() ? NULL : &vectors[0], vectors.size() / 3);
+    normalizePoints(soa);
+    if(soa.size() > 0) soa.toInterleaved(&vectors[0]);
+}
@@ -0,0 +1,40 @@
+#ifndef MESHUTILS_H
+#define MESHUTILS_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Helpers shared by the mesh import path.
+ */
+
+// Raw bits of one vertex: 3 floats of position, 2 of uv and 3 of normal.
+// Equal keys are bit for bit equal vertices, for hashing.
+struct VertexKey {
+    GLfloat data[8];
+    bool operator == (const VertexKey &other) const;
+};
+
+struct VertexKeyHash {
+    size_t operator () (const VertexKey &key) const;
+};
+
+// Key of the given vertex of the parallel attribute arrays
+VertexKey vertexKey(const std::vector<GLfloat> &positions, const std::vector<GLfloat> &uvs,
+                    const std::vector<GLfloat> &normals, size_t vertex);
+
+// Turns a triangle soup (3 floats of position, 2 of uv and 3 of normal per
+// corner) into unique vertices and an index buffer. Only corners with exactly
+// the same attributes are merged, so uv and normal seams are kept.
+void weldVertices(std::vector<GLfloat> &positions,
+                  std::vector<GLfloat> &uvs,
+                  std::vector<GLfloat> &normals,
+                  std::vector<GLuint> &indices);
+
+// Bounding sphere of the positions (center of the bounding box, not the minimal sphere)
+void boundingSphere(const std::vector<GLfloat> &positions, GLfloat center[3], GLfloat &radius);
+
+// Scales x, y, z triples to unit length, zero ones stay zero
+void normalizeVectors(std::vector<GLfloat> &vectors);
+
+#endif // MESHUTILS_H
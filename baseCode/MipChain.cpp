@@ -0,0 +1,101 @@
+#include "MipChain.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPCHAIN_SSE2 1
+#endif
+
+namespace {
+
+// Output pixels [from, to) of one row: average of the 2x2 block below each
+void filterRowScalar(const unsigned char *row0, const unsigned char *row1, int srcWidth,
+                     unsigned char *out, int from, int to)
+{
+    for(int x = from; x < to; ++x) {
+        const int x0 = 2 * x;
+        const int x1 = std::min(x0 + 1, srcWidth - 1);
+        for(int c = 0; c < 4; ++c) {
+            const int sum = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+            out[4 * x + c] = (unsigned char)((sum + 2) >> 2);
+        }
+    }
+}
+
+#ifdef MIPCHAIN_SSE2
+// Two output pixels from four source pixels of each row
+inline __m128i filterQuad(__m128i a, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));   // p0 | p1
+    const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));   // p2 | p3
+    const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi)); // p0+p1 | p2+p3
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+#endif
+
+void filterRow(const unsigned char *row0, const unsigned char *row1, int srcWidth,
+               unsigned char *out, int dstWidth)
+{
+    int x = 0;
+#ifdef MIPCHAIN_SSE2
+    // Four output pixels (16 bytes) per iteration, from eight source pixels.
+    // A single column source (srcWidth 1) goes to the scalar path.
+    if(srcWidth > 1) {
+        for(; x + 4 <= dstWidth; x += 4) {
+            const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x));
+            const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x + 16));
+            const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x));
+            const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x + 16));
+            const __m128i packed = _mm_packus_epi16(filterQuad(a0, b0), filterQuad(a1, b1));
+            _mm_storeu_si128((__m128i*)(out + 4 * x), packed);
+        }
+    }
+#endif
+    filterRowScalar(row0, row1, srcWidth, out, x, dstWidth);
+}
+
+}
+
+void downsampleBox(const unsigned char *src, int width, int height, unsigned char *dst)
+{
+    const int dstWidth = std::max(1, width / 2);
+    const int dstHeight = std::max(1, height / 2);
+    const size_t srcStride = 4 * (size_t)width;
+    const size_t dstStride = 4 * (size_t)dstWidth;
+
+    // Bands of at least 16 rows, below that threads cost more than they save
+    parallelFor(dstHeight, 16, [&](size_t begin, size_t end) {
+        for(size_t y = begin; y < end; ++y) {
+            const size_t y0 = 2 * y;
+            const size_t y1 = std::min<size_t>(y0 + 1, height - 1);
+            filterRow(src + y0 * srcStride, src + y1 * srcStride, width, dst + y * dstStride, dstWidth);
+        }
+    });
+}
+
+void buildMipChain(const unsigned char *rgba, int width, int height, std::vector<MipLevel> &levels)
+{
+    levels.clear();
+
+    int count = 0;
+    for(int w = width, h = height; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2)) ++count;
+    levels.reserve(count);
+
+    const unsigned char *src = rgba;
+    while(width > 1 || height > 1) {
+        MipLevel level;
+        level.width = std::max(1, width / 2);
+        level.height = std::max(1, height / 2);
+        level.pixels.resize(4 * (size_t)level.width * level.height);
+        levels.push_back(level);
+
+        downsampleBox(src, width, height, &levels.back().pixels[0]);
+
+        src = &levels.back().pixels[0];
+        width = levels.back().width;
+        height = levels.back().height;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef MIPCHAIN_H
+#define MIPCHAIN_H
+
+#include <vector>
+
+struct MipLevel {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;  // 4 bytes per pixel, rows packed
+};
+
+// Builds levels 1..n of the pyramid (down to 1x1) below the given image,
+// 4 channels of 8 bits in any order, each level a 2x2 box filter of the previous one. Rows of a level
+// are filtered in parallel, with SSE2 when the target has it.
+void buildMipChain(const unsigned char *rgba, int width, int height, std::vector<MipLevel> &levels);
+
+// Same, for a single level: dst is max(1, width / 2) x max(1, height / 2)
+void downsampleBox(const unsigned char *src, int width, int height, unsigned char *dst);
+
+#endif // MIPCHAIN_H
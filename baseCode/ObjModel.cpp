@@ -3,57 +3,224 @@
 #include <math.h>
 
 #include "objloader.hpp"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshUtils.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "globals.h"
 
-ObjModel::ObjModel(const std::string &_path) {
-    std::vector<Point3d> vertices;
-    std::vector<Point2d> uvs;
-    std::vector<Point3d> normals;
-    bool res = loadOBJ(_path.c_str(), vertices, uvs, normals);
-    vecPoint3dToFloat(vertices, fvertices);
-    vecPoint2dToFloat(uvs, fuvs);
-    vecPoint3dToFloat(normals, fnormals);
+float ObjModel::lodPixelThreshold = 1.0f;
+std::atomic<float> ObjModel::lodProjection(0.0f);
+
+ObjModel::ObjModel(const std::string &_path)
+    : radius(0.0f), vertexBuffer(0), uvBuffer(0), vertexNormals(0), indexBuffer(0), compactValid(false), compactBuffer(0) {
+    bool res;
+    {
+        std::vector<Point3f> vertices;
+        std::vector<Point2f> uvs;
+        std::vector<Point3f> normals;
+        res = loadOBJ(_path.c_str(), vertices, uvs, normals);
+        vecPoint3fToFloat(vertices, fvertices);
+        vecPoint2fToFloat(uvs, fuvs);
+        vecPoint3fToFloat(normals, fnormals);
+    }
+
+    center[0] = center[1] = center[2] = 0.0f;
+    if(!res || fvertices.empty()) return;
+
+    // Exported normals are not always unit length, and corners differing
+    // only by that would not be welded
+    normalizeVectors(fnormals);
+    weldVertices(fvertices, fuvs, fnormals, indices);
+    boundingSphere(fvertices, center, radius);
+    buildLods();
+    optimizeIndices();
+
+    bvh.build(&fvertices[0], &indices[lods[0].first], lods[0].count / 3);
+    LOG_INFO("  BVH: %u nodes over %u triangles", (unsigned)bvh.nodeCount(), (unsigned)bvh.triangleCount());
+
+    compactValid = quantizeVertices(fvertices, fuvs, fnormals, compact);
+    LOG_INFO("  compact vertices %s: %d instead of %d bytes, errors position %g, normal %.2f deg, uv %g",
+           compactValid ? "ok" : "rejected", (int)sizeof(CompactVertex), (int)(8 * sizeof(GLfloat)),
+           compact.positionError, compact.normalError, compact.uvError);
+}
+
+void ObjModel::buildLods() {
+    // Each level halves the triangles of the previous one
+    const size_t maxLods = 5;
+    const size_t minTriangles = 128;
+
+    Lod full = { 0, (GLsizei)indices.size(), 0.0f };
+    lods.push_back(full);
+
+    MeshSimplifier simplifier(fvertices, fuvs, fnormals);
+    std::vector<GLuint> current(indices);
+    std::vector<GLuint> next;
+
+    while(lods.size() < maxLods && current.size() / 3 > minTriangles) {
+        const float error = simplifier.simplify(current, current.size() / 6, next);
+
+        // Mostly locked (seams, borders): another level would not pay off
+        if(next.size() * 4 > current.size() * 3) break;
+
+        // Errors are measured against the previous level, they add up
+        Lod lod = { (GLuint)indices.size(), (GLsizei)next.size(), lods.back().error + error };
+        lods.push_back(lod);
+        indices.insert(indices.end(), next.begin(), next.end());
+        current.swap(next);
+    }
+
+    std::string levels;
+    for(size_t i = 0; i < lods.size(); ++i) {
+        char level[32];
+        snprintf(level, sizeof(level), " %d/%.3g", lods[i].count / 3, lods[i].error);
+        levels += level;
+    }
+    LOG_INFO("  %u vertices, %d levels of detail (triangles/error):%s", (unsigned)(fvertices.size() / 3), (int)lods.size(), levels);
+}
+
+void ObjModel::optimizeIndices() {
+    const size_t vertexCount = fvertices.size() / 3;
+
+    for(size_t i = 0; i < lods.size(); ++i) {
+        GLuint *first = &indices[lods[i].first];
+        const size_t count = lods[i].count;
+
+        const VertexCacheStats before = analyzeVertexCache(first, count, vertexCount);
+        optimizeVertexCache(first, count, vertexCount);
+        optimizeOverdraw(first, count, fvertices);
+        const VertexCacheStats after = analyzeVertexCache(first, count, vertexCount);
+
+        LOG_INFO("  lod %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", (int)i, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+
+    // Last, once every level is final: they all share the vertices
+    optimizeVertexFetch(indices, fvertices, fuvs, fnormals);
 }
 
 void ObjModel::init() {
+    if(indices.empty()) return;
+
+    if(compact_vertices && compactValid && compactVerticesSupported()) {
+        glGenBuffers(1, &compactBuffer);
+        glState.bindBuffer(GL_ARRAY_BUFFER, compactBuffer);
+        glBufferData(GL_ARRAY_BUFFER, compact.vertices.size() * sizeof(CompactVertex), &compact.vertices[0], GL_STATIC_DRAW);
+    } else {
+        initFloatBuffers();
+    }
+    // The GPU has its copy now
+    std::vector<CompactVertex>().swap(compact.vertices);
+
+    glGenBuffers(1, &indexBuffer);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void ObjModel::initFloatBuffers() {
     glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, fvertices.size() * sizeof(GLfloat), &fvertices[0], GL_STATIC_DRAW);
 
     glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, uvBuffer);
     glBufferData(GL_ARRAY_BUFFER, fuvs.size() * sizeof(GLfloat), &fuvs[0], GL_STATIC_DRAW);
 
     glGenBuffers(1, &vertexNormals);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexNormals);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexNormals);
     glBufferData(GL_ARRAY_BUFFER, fnormals.size() * sizeof(GLfloat), &fnormals[0], GL_STATIC_DRAW);
 }
 
+int ObjModel::selectLod(const GLfloat modelview[16]) const {
+    const float projection = lodProjection;
+    if(lods.size() <= 1 || projection <= 0.0f) return 0;
+
+    // Largest axis scale of the model transformation
+    float scale = 0.0f;
+    for(int c = 0; c < 3; ++c) {
+        const GLfloat *column = &modelview[4 * c];
+        scale = std::max(scale, std::sqrt(column[0] * column[0] + column[1] * column[1] + column[2] * column[2]));
+    }
+
+    // Distance to the closest point of the bounding sphere along the view axis
+    const float viewZ = modelview[2] * center[0] + modelview[6] * center[1] + modelview[10] * center[2] + modelview[14];
+    const float distance = -viewZ - radius * scale;
+    if(distance <= 0.0f) return 0;
+
+    for(int lod = (int)lods.size() - 1; lod > 0; --lod) {
+        const float pixels = lods[lod].error * scale / distance * projection;
+        if(pixels <= lodPixelThreshold) return lod;
+    }
+    return 0;
+}
+
+void ObjModel::bounds(GLfloat sphereCenter[3], GLfloat &sphereRadius) const {
+    for(int k = 0; k < 3; ++k) sphereCenter[k] = center[k];
+    sphereRadius = radius;
+}
+
+bool ObjModel::triangles(int lod, TriangleMesh &mesh) {
+    if(lods.empty()) return false;
+    const Lod &level = lods[std::min(std::max(lod, 0), (int)lods.size() - 1)];
+
+    mesh.positions = &fvertices[0];
+    mesh.normals = fnormals.size() == fvertices.size() ? &fnormals[0] : NULL;
+    mesh.uvs = fuvs.size() / 2 == fvertices.size() / 3 ? &fuvs[0] : NULL;
+    mesh.indices = &indices[level.first];
+    mesh.vertexCount = fvertices.size() / 3;
+    mesh.indexCount = level.count;
+    return true;
+}
+
 void ObjModel::draw() {
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    if(lods.empty()) return;
+
+    GLfloat modelview[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    draw(selectLod(modelview));
+}
+
+void ObjModel::draw(int lod) {
+    if(lods.empty()) return;
+    const Lod &level = lods[std::min(std::max(lod, 0), (int)lods.size() - 1)];
+
+    if(compactBuffer != 0) {
+        bindCompactVertices(compactBuffer, compact);
+
+        glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT, (void*)(level.first * sizeof(GLuint)));
+        profiler.countDraw(level.count / 3);
+        profiler.countStateChange(3);
+
+        unbindCompactVertices();
+        return;
+    }
+
+    glState.clientArrays(true, true, true, false);
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glVertexPointer(
                 3,                  // size
                 GL_FLOAT,           // type
                 0,                  // stride
                 (void*)0            // array buffer offset
                 );
-    glEnableClientState(GL_VERTEX_ARRAY);
 
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, uvBuffer);
     glTexCoordPointer(
                 2,                                // size
                 GL_FLOAT,                         // type
                 0,                                // stride
                 (void*)0                          // array buffer offset
                 );
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vertexNormals);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexNormals);
     glNormalPointer(GL_FLOAT,0,(void*)0);
-    glEnableClientState(GL_NORMAL_ARRAY);
-
-    glDrawArrays(GL_TRIANGLES, 0, fvertices.size() / 3);
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT, (void*)(level.first * sizeof(GLuint)));
+    profiler.countDraw(level.count / 3);
+    profiler.countStateChange(3);
 }
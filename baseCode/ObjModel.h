@@ -2,24 +2,76 @@
 #define OBJMODEL_H
 
 #include <QtOpenGL>
+#include <atomic>
 #include "Point3.h"
 #include "Point2.h"
+#include "VertexQuantizer.h"
+#include "Bvh.h"
+#include "Drawable.h"
 
-class ObjModel
+class ObjModel : public Drawable
 {
 public:
     ObjModel(const std::string &_path);
     void init();
+
+    // Draws the level of detail picked for the current modelview matrix
     void draw();
+    // Draws the given level of detail (0 is the full resolution mesh)
+    void draw(int lod);
+
+    void bounds(GLfloat center[3], GLfloat &radius) const;
+    bool triangles(int lod, TriangleMesh &mesh);
+    const Bvh *meshBvh() const { return bvh.empty() ? NULL : &bvh; }
+
+    // Coarsest level whose simplification error stays under
+    // lodPixelThreshold once projected with the given modelview matrix
+    int selectLod(const GLfloat modelview[16]) const;
+    int lodCount() const { return (int)lods.size(); }
+
+    // Pixels covered by one unit at distance one in front of the camera,
+    // i.e. viewport height / (2 tan(fovy / 2)). Set from resizeGL, read by
+    // the scene builder thread.
+    static void setLodProjection(float pixelsPerUnit) { lodProjection = pixelsPerUnit; }
+    static float lodPixelThreshold;
 
 private:
+    void buildLods();
+    // Triangle order for the vertex cache and overdraw, vertex order for fetches
+    void optimizeIndices();
+    void initFloatBuffers();
+
+    struct Lod {
+        GLuint first;       // offset in the index buffer
+        GLsizei count;      // number of indices
+        float error;        // geometric error in model units
+    };
+
     std::vector<GLfloat> fvertices;
     std::vector<GLfloat> fuvs;
     std::vector<GLfloat> fnormals; // Won't be used at the moment
 
+    // All the levels, one after the other, indexing the same vertices
+    std::vector<GLuint> indices;
+    std::vector<Lod> lods;
+
+    GLfloat center[3];
+    GLfloat radius;
+
+    // Over the full resolution triangles, built at load
+    Bvh bvh;
+
     GLuint vertexBuffer;
     GLuint uvBuffer;
     GLuint vertexNormals;
+    GLuint indexBuffer;
+
+    // Compact copy of the vertices, used instead of the float buffers when valid
+    QuantizedVertices compact;
+    bool compactValid;
+    GLuint compactBuffer;
+
+    static std::atomic<float> lodProjection;
 };
 
 #endif // SPHERE_H
@@ -0,0 +1,100 @@
+#include "PackFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = { 'G', 'P', 'A', 'K' };
+const unsigned int kVersion = 1;
+
+// Header words after the magic, in file order; the index offset takes two
+enum { Version, EntryCount, IndexLow, IndexHigh, HeaderWords = 7 };
+
+// Fixed part of a table of contents record, the path follows
+struct IndexRecord {
+    unsigned long long offset;
+    unsigned long long storedSize;
+    unsigned long long size;
+    unsigned int compression;
+    unsigned int pathLength;
+};
+
+bool pathLess(const PackEntry &a, const PackEntry &b)
+{
+    return a.path < b.path;
+}
+
+}
+
+bool readPackIndex(const unsigned char *data, size_t size, std::vector<PackEntry> &entries)
+{
+    entries.clear();
+    if(data == NULL || size < kPackHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0) return false;
+
+    unsigned int words[HeaderWords];
+    memcpy(words, data + sizeof(kMagic), sizeof(words));
+    if(words[Version] != kVersion) return false;
+
+    const unsigned long long indexOffset = words[IndexLow] | ((unsigned long long)words[IndexHigh] << 32);
+    if(indexOffset < kPackHeaderSize || indexOffset > size) return false;
+
+    // The count is not trusted further than the records the index can hold
+    size_t cursor = (size_t)indexOffset;
+    entries.reserve(std::min((size_t)words[EntryCount], (size - cursor) / sizeof(IndexRecord)));
+    for(unsigned int i = 0; i < words[EntryCount]; ++i) {
+        IndexRecord record;
+        if(size - cursor < sizeof(record)) return false;
+        memcpy(&record, data + cursor, sizeof(record));
+        cursor += sizeof(record);
+        if(size - cursor < record.pathLength) return false;
+
+        // Data inside the archive, before the table of contents
+        if(record.compression > PackDeflated || record.offset < kPackHeaderSize ||
+           record.offset > indexOffset || record.storedSize > indexOffset - record.offset) return false;
+        if(record.compression == PackStored && record.size != record.storedSize) return false;
+
+        PackEntry entry;
+        entry.path.assign((const char*)data + cursor, record.pathLength);
+        entry.offset = record.offset;
+        entry.storedSize = record.storedSize;
+        entry.size = record.size;
+        entry.compression = record.compression;
+        entries.push_back(entry);
+        cursor += record.pathLength;
+    }
+
+    std::sort(entries.begin(), entries.end(), pathLess);
+    return true;
+}
+
+bool writePackHeader(std::ostream &out, size_t entryCount, unsigned long long indexOffset)
+{
+    unsigned int words[HeaderWords] = { 0 };
+    words[Version] = kVersion;
+    words[EntryCount] = (unsigned int)entryCount;
+    words[IndexLow] = (unsigned int)(indexOffset & 0xffffffffu);
+    words[IndexHigh] = (unsigned int)(indexOffset >> 32);
+
+    out.write(kMagic, sizeof(kMagic));
+    out.write((const char*)words, sizeof(words));
+    return out.good();
+}
+
+bool writePackIndex(std::ostream &out, const std::vector<PackEntry> &entries)
+{
+    for(size_t i = 0; i < entries.size(); ++i) {
+        const PackEntry &entry = entries[i];
+        IndexRecord record;
+        memset(&record, 0, sizeof(record));
+        record.offset = entry.offset;
+        record.storedSize = entry.storedSize;
+        record.size = entry.size;
+        record.compression = entry.compression;
+        record.pathLength = (unsigned int)entry.path.size();
+
+        out.write((const char*)&record, sizeof(record));
+        out.write(entry.path.data(), entry.path.size());
+    }
+    return out.good();
+}
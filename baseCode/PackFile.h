@@ -0,0 +1,45 @@
+#ifndef PACKFILE_H
+#define PACKFILE_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Packed asset archive (.pak), written by tools/pack and read through Vfs.
+ *
+ * A 32 byte header, the data of every entry, each starting on a multiple
+ * of kPackAlignment so that a mapped entry can be used in place, then the
+ * table of contents: per entry its offset, stored and original sizes,
+ * compression and path, relative to the packed directory with '/'
+ * separators. Deflated entries hold what qCompress writes (a 4 byte big
+ * endian size, then a zlib stream). Words are in the byte order of the
+ * machine that wrote the file.
+ */
+enum PackCompression {
+    PackStored = 0,
+    PackDeflated = 1
+};
+
+struct PackEntry {
+    std::string path;
+    unsigned long long offset;      // from the start of the archive
+    unsigned long long storedSize;
+    unsigned long long size;        // once decompressed
+    unsigned int compression;
+};
+
+const size_t kPackAlignment = 64;
+const size_t kPackHeaderSize = 32;
+
+// Reads the table of contents of an archive held in memory (typically
+// mapped), sorted by path. Returns false on malformed or truncated files,
+// or entries reaching past the end.
+bool readPackIndex(const unsigned char *data, size_t size, std::vector<PackEntry> &entries);
+
+// The header, and the table of contents starting at indexOffset
+bool writePackHeader(std::ostream &out, size_t entryCount, unsigned long long indexOffset);
+bool writePackIndex(std::ostream &out, const std::vector<PackEntry> &entries);
+
+#endif // PACKFILE_H
@@ -0,0 +1,125 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// One parallelFor call, cut into chunks that any thread may claim
+struct Job {
+    const std::function<void(size_t, size_t)> *body;
+    size_t count;
+    size_t chunks;
+    std::atomic<size_t> next;   // first chunk nobody claimed yet
+    size_t finished;            // under the pool's mutex, as are users
+    unsigned int users;         // workers holding a pointer to the job
+};
+
+// workerCount() - 1 threads started on the first parallelFor, sleeping
+// between jobs. The caller works on its own job too, so a job started from
+// inside another (or from several threads at once) always progresses.
+class WorkerPool
+{
+public:
+    WorkerPool()
+    {
+        for(unsigned int i = 1; i < workerCount(); ++i) threads.push_back(std::thread(&WorkerPool::loop, this));
+    }
+
+    void run(Job &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        wake.notify_all();
+
+        for(;;) {
+            const size_t chunk = job.next++;
+            if(chunk >= job.chunks) break;
+            runChunk(job, chunk);
+            std::lock_guard<std::mutex> lock(mutex);
+            ++job.finished;
+        }
+
+        // Every chunk is claimed; wait for those still running elsewhere
+        std::unique_lock<std::mutex> lock(mutex);
+        remove(&job);
+        done.wait(lock, [&] { return job.finished == job.chunks && job.users == 0; });
+    }
+
+private:
+    static void runChunk(const Job &job, size_t chunk)
+    {
+        (*job.body)(job.count * chunk / job.chunks, job.count * (chunk + 1) / job.chunks);
+    }
+
+    void remove(Job *job)
+    {
+        std::deque<Job*>::iterator found = std::find(jobs.begin(), jobs.end(), job);
+        if(found != jobs.end()) jobs.erase(found);
+    }
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            wake.wait(lock, [&] { return !jobs.empty(); });
+            Job *job = jobs.front();
+            ++job->users;
+            lock.unlock();
+
+            const size_t chunk = job->next++;
+            if(chunk < job->chunks) runChunk(*job, chunk);
+
+            lock.lock();
+            --job->users;
+            if(chunk < job->chunks) ++job->finished;
+            else remove(job);
+            if(job->finished == job->chunks && job->users == 0) done.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::deque<Job*> jobs;
+    std::vector<std::thread> threads;
+};
+
+}
+
+unsigned int workerCount()
+{
+    // Asking costs a system call, and the answer does not change
+    static const unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 2;
+}
+
+void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)> &body)
+{
+    if(count == 0) return;
+
+    const size_t chunks = std::min<size_t>(workerCount(), std::max<size_t>(1, count / std::max<size_t>(1, minChunk)));
+    if(chunks <= 1) {
+        body(0, count);
+        return;
+    }
+
+    // Never destroyed: threads outside main (texture decoding) may still be
+    // inside a parallelFor while static objects are torn down at exit
+    static WorkerPool *pool = new WorkerPool;
+
+    Job job;
+    job.body = &body;
+    job.count = count;
+    job.chunks = chunks;
+    job.next = 0;
+    job.finished = 0;
+    job.users = 0;
+    pool->run(job);
+}
@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads parallelFor spreads the work on
+unsigned int workerCount();
+
+// Calls body(begin, end) on consecutive ranges covering [0, count), from
+// several threads, and returns once all of them are done. Ranges hold at
+// least minChunk items, so small jobs stay on the calling thread. The other
+// threads are a pool started once; calls may nest or come from any thread.
+void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)> &body);
+
+#endif // PARALLEL_H
@@ -1,32 +1,39 @@
 #include "PlyModel.h"
 #include "Base.h"
 #include <math.h>
-#include <fstream>
+#include <istream>
 
 #include "tinyply.h"
-
-PlyModel::PlyModel(const std::string &_path) {
-    // Read the file and create a std::istringstream suitable
+#include "GLState.h"
+#include "MeshUtils.h"
+#include "Profiler.h"
+#include "globals.h"
+#include "Log.h"
+#include "Vfs.h"
+
+PlyModel::PlyModel(const std::string &_path)
+    : vertexBuffer(0), uvBuffer(0), normalBuffer(0), colorBuffer(0), compactValid(false), compactBuffer(0) {
+    // Read the file and create a std::istream suitable
     // for the lib -- tinyply does not perform any file i/o.
-    std::ifstream ss(_path, std::ios::binary);
+    VfsFile contents;
+    if(!vfs.open(_path, contents)) {
+        LOG_ERROR("cannot open %s", _path);
+        boundingSphere(fvertices, center, radius);
+        return;
+    }
+    MemoryStreamBuf buffer(contents.data(), contents.size());
+    std::istream ss(&buffer);
 
     // Parse the ASCII header fields
     tinyply::PlyFile file(ss);
 
-    /*for (auto e : file.get_elements())
-    {
-        std::cout << "element - " << e.name << " (" << e.size << ")" << std::endl;
-        for (auto p : e.properties)
-        {
-            std::cout << "\tproperty - " << p.name << " (" << PropertyTable[p.propertyType].str << ")" << std::endl;
-        }
+    // Header dump, debug builds only
+    for(const auto &e : file.get_elements()) {
+        LOG_DEBUG("%s: element - %s (%d)", _path, e.name, (int)e.size);
+        for(const auto &p : e.properties)
+            LOG_DEBUG("%s:     property - %s (%s)", _path, p.name, tinyply::PropertyTable[p.propertyType].str);
     }
-    std::cout << std::endl;
-
-    for (auto c : file.comments)
-    {
-        std::cout << "Comment: " << c << std::endl;
-    }*/
+    for(const auto &c : file.comments) LOG_DEBUG("%s: comment: %s", _path, c);
 
     // Define containers to hold the extracted data. The type must match
     // the property type given in the header. Tinyply will interally allocate the
@@ -59,11 +66,11 @@ PlyModel::PlyModel(const std::string &_path) {
     // Now populate the vectors...
     file.read(ss);
 
-    //std::cout << "Vertices: " << vertexCount << ", " << verts.size() << std::endl;
-    //std::cout << "Normals: " << normalCount << ", " << norms.size() << std::endl;
-    //std::cout << "Colors: " << colorCount << ", " << colors.size() << std::endl;
-    //std::cout << "Faces: " << faceCount << ", " << faces.size() << std::endl;
-    //std::cout << "TexCoords: " << faceTexcoordCount << ", " << uvCoords.size() << std::endl;
+    LOG_DEBUG("%s: vertices: %u, %d", _path, vertexCount, (int)verts.size());
+    LOG_DEBUG("%s: normals: %u, %d", _path, normalCount, (int)norms.size());
+    LOG_DEBUG("%s: colors: %u, %d", _path, colorCount, (int)colors.size());
+    LOG_DEBUG("%s: faces: %u, %d", _path, faceCount, (int)faces.size());
+    LOG_DEBUG("%s: texcoords: %u, %d", _path, faceTexcoordCount, (int)uvCoords.size());
 
     // Copy red values into opengl arrays
     for(auto i = faces.begin(); i != faces.end(); i++) {
@@ -78,32 +85,80 @@ PlyModel::PlyModel(const std::string &_path) {
         fcolors.push_back((GLfloat)(colors.at(*i * 4 + 2)) / 255.0f);
         fcolors.push_back((GLfloat)(colors.at(*i * 4 + 3)) / 255.0f);
     }
-    for(auto i = uvCoords.begin(); i != uvCoords.end(); i++) {
-        fuvs.push_back(*i);
+    // u, v pairs; textures are uploaded top row first (see TexturePixels)
+    for(size_t i = 0; i < uvCoords.size(); i++) {
+        fuvs.push_back(i % 2 == 0 ? uvCoords[i] : 1.0f - uvCoords[i]);
     }
+
+    boundingSphere(fvertices, center, radius);
+    bvh.build(fvertices.empty() ? NULL : &fvertices[0], NULL, fvertices.size() / 9);
+    compactValid = quantizeVertices(fvertices, fuvs, fnormals, compact);
 }
 
 void PlyModel::init() {
+    if(fvertices.empty()) return;
+
+    if(compact_vertices && compactValid && compactVerticesSupported()) {
+        glGenBuffers(1, &compactBuffer);
+        glState.bindBuffer(GL_ARRAY_BUFFER, compactBuffer);
+        glBufferData(GL_ARRAY_BUFFER, compact.vertices.size() * sizeof(CompactVertex), &compact.vertices[0], GL_STATIC_DRAW);
+    } else {
+        initFloatBuffers();
+    }
+    std::vector<CompactVertex>().swap(compact.vertices);
+}
+
+void PlyModel::initFloatBuffers() {
     glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, fvertices.size() * sizeof(GLfloat), &fvertices[0], GL_STATIC_DRAW);
 
     glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, uvBuffer);
     glBufferData(GL_ARRAY_BUFFER, fuvs.size() * sizeof(GLfloat), &fuvs[0], GL_STATIC_DRAW);
 
     glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, normalBuffer);
     glBufferData(GL_ARRAY_BUFFER, fnormals.size() * sizeof(GLfloat), &fnormals[0], GL_STATIC_DRAW);
 
     glGenBuffers(1, &colorBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, colorBuffer);
     glBufferData(GL_ARRAY_BUFFER, fcolors.size() * sizeof(GLfloat), &fcolors[0], GL_STATIC_DRAW);
 }
 
+void PlyModel::bounds(GLfloat sphereCenter[3], GLfloat &sphereRadius) const {
+    for(int k = 0; k < 3; ++k) sphereCenter[k] = center[k];
+    sphereRadius = radius;
+}
+
+bool PlyModel::triangles(int, TriangleMesh &mesh) {
+    if(fvertices.empty()) return false;
+
+    // Triangle soup, three vertices per face
+    mesh.positions = &fvertices[0];
+    mesh.normals = fnormals.size() == fvertices.size() ? &fnormals[0] : NULL;
+    mesh.uvs = fuvs.size() / 2 == fvertices.size() / 3 ? &fuvs[0] : NULL;
+    mesh.indices = NULL;
+    mesh.vertexCount = fvertices.size() / 3;
+    mesh.indexCount = mesh.vertexCount;
+    return true;
+}
+
 void PlyModel::draw() {
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    if(fvertices.empty()) return;
+
+    if(compactBuffer != 0) {
+        bindCompactVertices(compactBuffer, compact);
+        glDrawArrays(GL_TRIANGLES, 0, fvertices.size() / 3);
+        profiler.countDraw(fvertices.size() / 9);
+        profiler.countStateChange(3);
+        unbindCompactVertices();
+        return;
+    }
+
+    glState.clientArrays(true, true, true, false);
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glVertexPointer(
                 3,                  // size
                 GL_FLOAT,           // type
@@ -111,8 +166,7 @@ void PlyModel::draw() {
                 (void*)0            // array buffer offset
             );
 
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, uvBuffer);
     glTexCoordPointer(
         2,                                // size
         GL_FLOAT,                         // type
@@ -120,8 +174,7 @@ void PlyModel::draw() {
         (void*)0                          // array buffer offset
     );
 
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, normalBuffer);
     glNormalPointer(
         GL_FLOAT,                         // type
         0,                                // stride
@@ -142,9 +195,6 @@ void PlyModel::draw() {
     );*/
 
     glDrawArrays(GL_TRIANGLES, 0, fvertices.size() / 3);
-
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    //glDisableClientState(GL_COLOR_ARRAY);
+    profiler.countDraw(fvertices.size() / 9);
+    profiler.countStateChange(3);
 }
@@ -4,24 +4,44 @@
 #include <QtOpenGL>
 #include "Point3.h"
 #include "Point2.h"
+#include "VertexQuantizer.h"
+#include "Bvh.h"
+#include "Drawable.h"
 
-class PlyModel
+class PlyModel : public Drawable
 {
 public:
     PlyModel(const std::string &_path);
     void init();
     void draw();
 
+    void bounds(GLfloat center[3], GLfloat &radius) const;
+    bool triangles(int lod, TriangleMesh &mesh);
+    const Bvh *meshBvh() const { return bvh.empty() ? NULL : &bvh; }
+
 private:
+    void initFloatBuffers();
+
     std::vector<GLfloat> fvertices;
     std::vector<GLfloat> fuvs;
     std::vector<GLfloat> fnormals;
     std::vector<GLfloat> fcolors;
 
+    GLfloat center[3];
+    GLfloat radius;
+
+    // Over the full resolution triangles, built at load
+    Bvh bvh;
+
     GLuint vertexBuffer;
     GLuint uvBuffer;
     GLuint normalBuffer;
     GLuint colorBuffer;
+
+    // Compact copy of the vertices, used when valid
+    QuantizedVertices compact;
+    bool compactValid;
+    GLuint compactBuffer;
 };
 
 #endif // SPHERE_H
@@ -0,0 +1,401 @@
+#include "PointArrays.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Wide kernels need the GCC/Clang target attribute and CPU detection builtins
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define POINTARRAYS_X86 1
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace {
+
+typedef void (*TransformKernel)(const float *m, const float *x, const float *y, const float *z, size_t n,
+                                float *ox, float *oy, float *oz);
+typedef void (*ProjectKernel)(const float *m, const float *x, const float *y, const float *z, size_t n,
+                              float *ox, float *oy, float *oz, float *ow);
+// Widens lo and hi
+typedef void (*BoundsKernel)(const float *x, const float *y, const float *z, size_t n, float lo[3], float hi[3]);
+// Largest squared distance
+typedef float (*DistanceKernel)(const float *x, const float *y, const float *z, size_t n, const float c[3]);
+typedef void (*NormalizeKernel)(float *x, float *y, float *z, size_t n);
+
+struct Kernels {
+    const char *name;
+    TransformKernel transform;
+    ProjectKernel project;
+    BoundsKernel bounds;
+    DistanceKernel distance;
+    NormalizeKernel normalize;
+};
+
+// Scalar versions, also used for the tails of the wide ones
+
+void transformScalar(const float *m, const float *x, const float *y, const float *z, size_t n,
+                     float *ox, float *oy, float *oz)
+{
+    for(size_t i = 0; i < n; ++i) {
+        const float px = x[i], py = y[i], pz = z[i];
+        ox[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+        oy[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+        oz[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+    }
+}
+
+void projectScalar(const float *m, const float *x, const float *y, const float *z, size_t n,
+                   float *ox, float *oy, float *oz, float *ow)
+{
+    for(size_t i = 0; i < n; ++i) {
+        const float px = x[i], py = y[i], pz = z[i];
+        const float w = m[3] * px + m[7] * py + m[11] * pz + m[15];
+        const float inv = 1.0f / w;
+        ox[i] = (m[0] * px + m[4] * py + m[8] * pz + m[12]) * inv;
+        oy[i] = (m[1] * px + m[5] * py + m[9] * pz + m[13]) * inv;
+        oz[i] = (m[2] * px + m[6] * py + m[10] * pz + m[14]) * inv;
+        ow[i] = w;
+    }
+}
+
+void boundsScalar(const float *x, const float *y, const float *z, size_t n, float lo[3], float hi[3])
+{
+    for(size_t i = 0; i < n; ++i) {
+        lo[0] = std::min(lo[0], x[i]); hi[0] = std::max(hi[0], x[i]);
+        lo[1] = std::min(lo[1], y[i]); hi[1] = std::max(hi[1], y[i]);
+        lo[2] = std::min(lo[2], z[i]); hi[2] = std::max(hi[2], z[i]);
+    }
+}
+
+float distanceScalar(const float *x, const float *y, const float *z, size_t n, const float c[3])
+{
+    float best = 0.0f;
+    for(size_t i = 0; i < n; ++i) {
+        const float dx = x[i] - c[0], dy = y[i] - c[1], dz = z[i] - c[2];
+        best = std::max(best, dx * dx + dy * dy + dz * dz);
+    }
+    return best;
+}
+
+void normalizeScalar(float *x, float *y, float *z, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) {
+        const float length = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        const float inv = length > 0.0f ? 1.0f / length : 0.0f;
+        x[i] *= inv;
+        y[i] *= inv;
+        z[i] *= inv;
+    }
+}
+
+const Kernels scalarKernels = { "scalar", transformScalar, projectScalar, boundsScalar, distanceScalar, normalizeScalar };
+
+#ifdef POINTARRAYS_X86
+
+// AVX2 + FMA, 8 points per iteration
+
+TARGET_AVX2 inline __m256 rowAvx2(const __m256 *m, int row, __m256 px, __m256 py, __m256 pz)
+{
+    return _mm256_fmadd_ps(m[row], px, _mm256_fmadd_ps(m[4 + row], py, _mm256_fmadd_ps(m[8 + row], pz, m[12 + row])));
+}
+
+TARGET_AVX2 void transformAvx2(const float *m, const float *x, const float *y, const float *z, size_t n,
+                               float *ox, float *oy, float *oz)
+{
+    __m256 columns[16];
+    for(int k = 0; k < 16; ++k) columns[k] = _mm256_set1_ps(m[k]);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        _mm256_storeu_ps(ox + i, rowAvx2(columns, 0, px, py, pz));
+        _mm256_storeu_ps(oy + i, rowAvx2(columns, 1, px, py, pz));
+        _mm256_storeu_ps(oz + i, rowAvx2(columns, 2, px, py, pz));
+    }
+    transformScalar(m, x + i, y + i, z + i, n - i, ox + i, oy + i, oz + i);
+}
+
+TARGET_AVX2 void projectAvx2(const float *m, const float *x, const float *y, const float *z, size_t n,
+                             float *ox, float *oy, float *oz, float *ow)
+{
+    __m256 columns[16];
+    for(int k = 0; k < 16; ++k) columns[k] = _mm256_set1_ps(m[k]);
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        const __m256 w = rowAvx2(columns, 3, px, py, pz);
+        const __m256 inv = _mm256_div_ps(one, w);
+        _mm256_storeu_ps(ox + i, _mm256_mul_ps(rowAvx2(columns, 0, px, py, pz), inv));
+        _mm256_storeu_ps(oy + i, _mm256_mul_ps(rowAvx2(columns, 1, px, py, pz), inv));
+        _mm256_storeu_ps(oz + i, _mm256_mul_ps(rowAvx2(columns, 2, px, py, pz), inv));
+        _mm256_storeu_ps(ow + i, w);
+    }
+    projectScalar(m, x + i, y + i, z + i, n - i, ox + i, oy + i, oz + i, ow + i);
+}
+
+TARGET_AVX2 void boundsAvx2(const float *x, const float *y, const float *z, size_t n, float lo[3], float hi[3])
+{
+    __m256 lx = _mm256_set1_ps(lo[0]), ly = _mm256_set1_ps(lo[1]), lz = _mm256_set1_ps(lo[2]);
+    __m256 hx = _mm256_set1_ps(hi[0]), hy = _mm256_set1_ps(hi[1]), hz = _mm256_set1_ps(hi[2]);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        lx = _mm256_min_ps(lx, px); hx = _mm256_max_ps(hx, px);
+        ly = _mm256_min_ps(ly, py); hy = _mm256_max_ps(hy, py);
+        lz = _mm256_min_ps(lz, pz); hz = _mm256_max_ps(hz, pz);
+    }
+
+    float lanes[6][8];
+    _mm256_storeu_ps(lanes[0], lx); _mm256_storeu_ps(lanes[1], ly); _mm256_storeu_ps(lanes[2], lz);
+    _mm256_storeu_ps(lanes[3], hx); _mm256_storeu_ps(lanes[4], hy); _mm256_storeu_ps(lanes[5], hz);
+    for(int k = 0; k < 3; ++k) {
+        lo[k] = *std::min_element(lanes[k], lanes[k] + 8);
+        hi[k] = *std::max_element(lanes[3 + k], lanes[3 + k] + 8);
+    }
+    boundsScalar(x + i, y + i, z + i, n - i, lo, hi);
+}
+
+TARGET_AVX2 float distanceAvx2(const float *x, const float *y, const float *z, size_t n, const float c[3])
+{
+    const __m256 cx = _mm256_set1_ps(c[0]), cy = _mm256_set1_ps(c[1]), cz = _mm256_set1_ps(c[2]);
+    __m256 best = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+        const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), cy);
+        const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), cz);
+        best = _mm256_max_ps(best, _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz))));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, best);
+    return std::max(*std::max_element(lanes, lanes + 8), distanceScalar(x + i, y + i, z + i, n - i, c));
+}
+
+TARGET_AVX2 void normalizeAvx2(float *x, float *y, float *z, size_t n)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        const __m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(px, px, _mm256_fmadd_ps(py, py, _mm256_mul_ps(pz, pz))));
+        // 1 / 0 is masked out, zero vectors stay zero
+        const __m256 inv = _mm256_and_ps(_mm256_cmp_ps(length, zero, _CMP_GT_OQ), _mm256_div_ps(one, length));
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(px, inv));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(py, inv));
+        _mm256_storeu_ps(z + i, _mm256_mul_ps(pz, inv));
+    }
+    normalizeScalar(x + i, y + i, z + i, n - i);
+}
+
+const Kernels avx2Kernels = { "avx2", transformAvx2, projectAvx2, boundsAvx2, distanceAvx2, normalizeAvx2 };
+
+// AVX-512, 16 points per iteration. FMA is part of AVX-512F.
+//
+// GCC 12 warns about the _mm512_undefined_ps() in its own header once the
+// intrinsics are inlined here, a known false positive
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TARGET_AVX512 inline __m512 rowAvx512(const __m512 *m, int row, __m512 px, __m512 py, __m512 pz)
+{
+    return _mm512_fmadd_ps(m[row], px, _mm512_fmadd_ps(m[4 + row], py, _mm512_fmadd_ps(m[8 + row], pz, m[12 + row])));
+}
+
+TARGET_AVX512 void transformAvx512(const float *m, const float *x, const float *y, const float *z, size_t n,
+                                   float *ox, float *oy, float *oz)
+{
+    __m512 columns[16];
+    for(int k = 0; k < 16; ++k) columns[k] = _mm512_set1_ps(m[k]);
+
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+        _mm512_storeu_ps(ox + i, rowAvx512(columns, 0, px, py, pz));
+        _mm512_storeu_ps(oy + i, rowAvx512(columns, 1, px, py, pz));
+        _mm512_storeu_ps(oz + i, rowAvx512(columns, 2, px, py, pz));
+    }
+    transformScalar(m, x + i, y + i, z + i, n - i, ox + i, oy + i, oz + i);
+}
+
+TARGET_AVX512 void projectAvx512(const float *m, const float *x, const float *y, const float *z, size_t n,
+                                 float *ox, float *oy, float *oz, float *ow)
+{
+    __m512 columns[16];
+    for(int k = 0; k < 16; ++k) columns[k] = _mm512_set1_ps(m[k]);
+    const __m512 one = _mm512_set1_ps(1.0f);
+
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+        const __m512 w = rowAvx512(columns, 3, px, py, pz);
+        const __m512 inv = _mm512_div_ps(one, w);
+        _mm512_storeu_ps(ox + i, _mm512_mul_ps(rowAvx512(columns, 0, px, py, pz), inv));
+        _mm512_storeu_ps(oy + i, _mm512_mul_ps(rowAvx512(columns, 1, px, py, pz), inv));
+        _mm512_storeu_ps(oz + i, _mm512_mul_ps(rowAvx512(columns, 2, px, py, pz), inv));
+        _mm512_storeu_ps(ow + i, w);
+    }
+    projectScalar(m, x + i, y + i, z + i, n - i, ox + i, oy + i, oz + i, ow + i);
+}
+
+TARGET_AVX512 void boundsAvx512(const float *x, const float *y, const float *z, size_t n, float lo[3], float hi[3])
+{
+    __m512 lx = _mm512_set1_ps(lo[0]), ly = _mm512_set1_ps(lo[1]), lz = _mm512_set1_ps(lo[2]);
+    __m512 hx = _mm512_set1_ps(hi[0]), hy = _mm512_set1_ps(hi[1]), hz = _mm512_set1_ps(hi[2]);
+
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+        lx = _mm512_min_ps(lx, px); hx = _mm512_max_ps(hx, px);
+        ly = _mm512_min_ps(ly, py); hy = _mm512_max_ps(hy, py);
+        lz = _mm512_min_ps(lz, pz); hz = _mm512_max_ps(hz, pz);
+    }
+
+    float lanes[6][16];
+    _mm512_storeu_ps(lanes[0], lx); _mm512_storeu_ps(lanes[1], ly); _mm512_storeu_ps(lanes[2], lz);
+    _mm512_storeu_ps(lanes[3], hx); _mm512_storeu_ps(lanes[4], hy); _mm512_storeu_ps(lanes[5], hz);
+    for(int k = 0; k < 3; ++k) {
+        lo[k] = *std::min_element(lanes[k], lanes[k] + 16);
+        hi[k] = *std::max_element(lanes[3 + k], lanes[3 + k] + 16);
+    }
+    boundsScalar(x + i, y + i, z + i, n - i, lo, hi);
+}
+
+TARGET_AVX512 float distanceAvx512(const float *x, const float *y, const float *z, size_t n, const float c[3])
+{
+    const __m512 cx = _mm512_set1_ps(c[0]), cy = _mm512_set1_ps(c[1]), cz = _mm512_set1_ps(c[2]);
+    __m512 best = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + i), cx);
+        const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + i), cy);
+        const __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + i), cz);
+        best = _mm512_max_ps(best, _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz))));
+    }
+
+    float lanes[16];
+    _mm512_storeu_ps(lanes, best);
+    return std::max(*std::max_element(lanes, lanes + 16), distanceScalar(x + i, y + i, z + i, n - i, c));
+}
+
+TARGET_AVX512 void normalizeAvx512(float *x, float *y, float *z, size_t n)
+{
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+        const __m512 length = _mm512_sqrt_ps(_mm512_fmadd_ps(px, px, _mm512_fmadd_ps(py, py, _mm512_mul_ps(pz, pz))));
+        const __mmask16 nonZero = _mm512_cmp_ps_mask(length, zero, _CMP_GT_OQ);
+        const __m512 inv = _mm512_maskz_div_ps(nonZero, one, length);
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(px, inv));
+        _mm512_storeu_ps(y + i, _mm512_mul_ps(py, inv));
+        _mm512_storeu_ps(z + i, _mm512_mul_ps(pz, inv));
+    }
+    normalizeScalar(x + i, y + i, z + i, n - i);
+}
+
+const Kernels avx512Kernels = { "avx512", transformAvx512, projectAvx512, boundsAvx512, distanceAvx512, normalizeAvx512 };
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // POINTARRAYS_X86
+
+const Kernels &selectKernels()
+{
+#ifdef POINTARRAYS_X86
+    // Also checks that the OS saves the wide registers
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return avx512Kernels;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return avx2Kernels;
+#endif
+    return scalarKernels;
+}
+
+const Kernels &kernels()
+{
+    static const Kernels &selected = selectKernels();
+    return selected;
+}
+
+}
+
+void PointArrays::resize(size_t count)
+{
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+}
+
+void PointArrays::assignInterleaved(const float *xyz, size_t count)
+{
+    resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        x[i] = xyz[3 * i];
+        y[i] = xyz[3 * i + 1];
+        z[i] = xyz[3 * i + 2];
+    }
+}
+
+void PointArrays::toInterleaved(float *xyz) const
+{
+    for(size_t i = 0; i < size(); ++i) {
+        xyz[3 * i] = x[i];
+        xyz[3 * i + 1] = y[i];
+        xyz[3 * i + 2] = z[i];
+    }
+}
+
+void transformPoints(const Matrix4 &matrix, const PointArrays &in, PointArrays &out)
+{
+    const size_t n = in.size();
+    out.resize(n);
+    if(n == 0) return;
+    kernels().transform(matrix.m, &in.x[0], &in.y[0], &in.z[0], n, &out.x[0], &out.y[0], &out.z[0]);
+}
+
+void projectPoints(const Matrix4 &clip, const PointArrays &in, PointArrays &out, std::vector<float> &w)
+{
+    const size_t n = in.size();
+    out.resize(n);
+    w.resize(n);
+    if(n == 0) return;
+    kernels().project(clip.m, &in.x[0], &in.y[0], &in.z[0], n, &out.x[0], &out.y[0], &out.z[0], &w[0]);
+}
+
+void pointBounds(const PointArrays &in, float lo[3], float hi[3])
+{
+    lo[0] = lo[1] = lo[2] = FLT_MAX;
+    hi[0] = hi[1] = hi[2] = -FLT_MAX;
+    if(in.size() == 0) return;
+    kernels().bounds(&in.x[0], &in.y[0], &in.z[0], in.size(), lo, hi);
+}
+
+float maxDistance(const PointArrays &in, const float center[3])
+{
+    if(in.size() == 0) return 0.0f;
+    return std::sqrt(kernels().distance(&in.x[0], &in.y[0], &in.z[0], in.size(), center));
+}
+
+void normalizePoints(PointArrays &v)
+{
+    if(v.size() == 0) return;
+    kernels().normalize(&v.x[0], &v.y[0], &v.z[0], v.size());
+}
+
+const char *pointKernelName()
+{
+    return kernels().name;
+}
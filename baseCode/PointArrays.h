@@ -0,0 +1,49 @@
+#ifndef POINTARRAYS_H
+#define POINTARRAYS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Matrix4.h"
+
+/*
+ * Points or vectors as three float arrays (structure of arrays), for work
+ * on whole meshes at a time: a wide register then holds 8 or 16 values of
+ * the same coordinate, and no shuffling is needed.
+ *
+ * The kernels below pick their implementation once, on first use, from
+ * what the running CPU supports: AVX-512, AVX2 with FMA, or plain scalar
+ * code on anything else (other compilers and architectures included).
+ */
+struct PointArrays
+{
+    std::vector<float> x, y, z;
+
+    size_t size() const { return x.size(); }
+    void resize(size_t count);
+
+    // From and to x, y, z triples, as in the GL vertex buffers
+    void assignInterleaved(const float *xyz, size_t count);
+    void toInterleaved(float *xyz) const;
+};
+
+// out = matrix * (in, 1), out is resized as needed and may be in
+void transformPoints(const Matrix4 &matrix, const PointArrays &in, PointArrays &out);
+
+// Clip coordinates divided by w. w is kept as well: points at w <= 0 are
+// behind the eye and their divided coordinates mean nothing.
+void projectPoints(const Matrix4 &clip, const PointArrays &in, PointArrays &out, std::vector<float> &w);
+
+// Bounding box, lo > hi on an empty array
+void pointBounds(const PointArrays &in, float lo[3], float hi[3]);
+
+// Largest distance from center to any of the points, 0 on an empty array
+float maxDistance(const PointArrays &in, const float center[3]);
+
+// Every vector scaled to unit length, zero vectors stay zero
+void normalizePoints(PointArrays &v);
+
+// "avx512", "avx2" or "scalar"
+const char *pointKernelName();
+
+#endif // POINTARRAYS_H
@@ -0,0 +1,377 @@
+#include "Profiler.h"
+#include "GLUtils.h"
+#include "GLState.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Apple and older headers only expose the EXT flavour of timer queries
+#if !defined(GL_TIME_ELAPSED) && defined(GL_TIME_ELAPSED_EXT)
+#define GL_TIME_ELAPSED GL_TIME_ELAPSED_EXT
+#define glGetQueryObjectui64v glGetQueryObjectui64vEXT
+#endif
+
+FrameProfiler profiler;
+
+namespace {
+
+double millisecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}
+
+FrameProfiler::FrameProfiler()
+    : gpuTimers(false), sampleQueries(false), countingSamples(false), overlayVisible(false), inFrame(false), frameIndex(0), queryOwner(-1),
+      smoothedIntervalMs(0.0)
+{
+    for(int i = 0; i < kFrameLatency; ++i) {
+        frames[i].pending = false;
+        frames[i].queriesUsed = 0;
+        frames[i].samplesQuery = 0;
+        frames[i].samplesIssued = false;
+    }
+    shown.index = 0;
+    shown.pending = false;
+    shown.cpuMs = shown.intervalMs = shown.gpuMs = 0.0;
+    shown.drawCalls = shown.triangles = shown.stateChanges = shown.filteredCalls = 0;
+    shown.queriesUsed = 0;
+    shown.samplesQuery = 0;
+    shown.samplesIssued = false;
+    shown.samples = shown.pixels = -1;
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    // The queries die with the GL context, nothing to release here
+    stopCsv();
+}
+
+void FrameProfiler::init()
+{
+#ifdef GL_TIME_ELAPSED
+    gpuTimers = hasGLVersion(3, 3) || hasGLExtension("GL_ARB_timer_query") || hasGLExtension("GL_EXT_timer_query");
+#else
+    gpuTimers = false;
+#endif
+    sampleQueries = hasGLVersion(1, 5) || hasGLExtension("GL_ARB_occlusion_query");
+    lastFrameStart = Clock::now();
+}
+
+void FrameProfiler::beginFrame()
+{
+    const Clock::time_point now = Clock::now();
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    if(frame.pending) resolve(frame);
+
+    frame.index = frameIndex;
+    frame.pending = true;
+    frame.cpuMs = 0.0;
+    frame.intervalMs = frameIndex > 0 ? millisecondsBetween(lastFrameStart, now) : 0.0;
+    frame.gpuMs = 0.0;
+    frame.drawCalls = frame.triangles = frame.stateChanges = frame.filteredCalls = 0;
+    frame.sections.clear();
+    frame.queriesUsed = 0;
+    frame.samplesIssued = false;
+    frame.samples = frame.pixels = -1;
+
+    openSections.clear();
+    queryOwner = -1;
+    frameStart = lastFrameStart = now;
+    inFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+    if(!inFrame) return;
+
+    // Close whatever the caller forgot to close
+    while(!openSections.empty()) endSection();
+    endSampleCount();
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    frame.cpuMs = millisecondsBetween(frameStart, Clock::now());
+
+    inFrame = false;
+    ++frameIndex;
+}
+
+void FrameProfiler::beginSection(const char *name)
+{
+    if(!inFrame) return;
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+
+    SectionRecord section;
+    section.name = name;
+    section.depth = (int)openSections.size();
+    section.cpuMs = 0.0;
+    section.gpuMs = -1.0;
+    section.query = 0;
+    section.drawCalls = section.triangles = section.stateChanges = section.filteredCalls = 0;
+
+#ifdef GL_TIME_ELAPSED
+    if(gpuTimers && queryOwner < 0) {
+        section.query = nextQuery(frame);
+        glBeginQuery(GL_TIME_ELAPSED, section.query);
+        queryOwner = (int)frame.sections.size();
+    }
+#endif
+
+    openSections.push_back((int)frame.sections.size());
+    frame.sections.push_back(section);
+
+    // Start the clock last so the query setup is not charged to the section
+    frame.sections.back().start = Clock::now();
+}
+
+void FrameProfiler::endSection()
+{
+    if(!inFrame || openSections.empty()) return;
+
+    const Clock::time_point now = Clock::now();
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    const int index = openSections.back();
+    openSections.pop_back();
+
+    SectionRecord &section = frame.sections[index];
+    section.cpuMs = millisecondsBetween(section.start, now);
+
+#ifdef GL_TIME_ELAPSED
+    if(queryOwner == index) {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryOwner = -1;
+    }
+#endif
+}
+
+void FrameProfiler::countDraw(GLsizei triangles)
+{
+    if(!inFrame) return;
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    frame.drawCalls += 1;
+    frame.triangles += triangles;
+
+    // Counters are inclusive, a nested section also adds to its parents
+    for(size_t i = 0; i < openSections.size(); ++i) {
+        SectionRecord &section = frame.sections[openSections[i]];
+        section.drawCalls += 1;
+        section.triangles += triangles;
+    }
+}
+
+void FrameProfiler::countStateChange(int count)
+{
+    if(!inFrame) return;
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    frame.stateChanges += count;
+
+    for(size_t i = 0; i < openSections.size(); ++i)
+        frame.sections[openSections[i]].stateChanges += count;
+}
+
+void FrameProfiler::countFilteredCall(int count)
+{
+    if(!inFrame) return;
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    frame.filteredCalls += count;
+
+    for(size_t i = 0; i < openSections.size(); ++i)
+        frame.sections[openSections[i]].filteredCalls += count;
+}
+
+void FrameProfiler::beginSampleCount()
+{
+    if(!inFrame || !sampleQueries || countingSamples) return;
+
+    FrameRecord &frame = frames[frameIndex % kFrameLatency];
+    if(frame.samplesIssued) return;
+
+    if(frame.samplesQuery == 0) glGenQueries(1, &frame.samplesQuery);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    frame.pixels = (long long)viewport[2] * viewport[3];
+
+    glBeginQuery(GL_SAMPLES_PASSED, frame.samplesQuery);
+    frame.samplesIssued = true;
+    countingSamples = true;
+}
+
+void FrameProfiler::endSampleCount()
+{
+    if(!countingSamples) return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    countingSamples = false;
+}
+
+GLuint FrameProfiler::nextQuery(FrameRecord &frame)
+{
+    if(frame.queriesUsed == frame.queryPool.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        frame.queryPool.push_back(query);
+    }
+    return frame.queryPool[frame.queriesUsed++];
+}
+
+void FrameProfiler::resolve(FrameRecord &frame)
+{
+    frame.pending = false;
+
+#ifdef GL_TIME_ELAPSED
+    for(size_t i = 0; i < frame.sections.size(); ++i) {
+        SectionRecord &section = frame.sections[i];
+        if(section.query == 0) continue;
+
+        // The slot is kFrameLatency frames old, the result is almost always
+        // there. If it is not, drop it rather than stalling the pipeline.
+        GLint available = 0;
+        glGetQueryObjectiv(section.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) continue;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(section.query, GL_QUERY_RESULT, &nanoseconds);
+        section.gpuMs = nanoseconds / 1.0e6;
+        frame.gpuMs += section.gpuMs;
+    }
+#endif
+
+    if(frame.samplesIssued) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame.samplesQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available) {
+            GLuint samples = 0;
+            glGetQueryObjectuiv(frame.samplesQuery, GL_QUERY_RESULT, &samples);
+            frame.samples = samples;
+        }
+    }
+
+    const double weight = 0.1;
+    smoothedIntervalMs = (smoothedIntervalMs == 0.0) ? frame.intervalMs
+                                                     : smoothedIntervalMs + weight * (frame.intervalMs - smoothedIntervalMs);
+
+    shown.index = frame.index;
+    shown.cpuMs = frame.cpuMs;
+    shown.intervalMs = frame.intervalMs;
+    shown.gpuMs = frame.gpuMs;
+    shown.drawCalls = frame.drawCalls;
+    shown.triangles = frame.triangles;
+    shown.stateChanges = frame.stateChanges;
+    shown.filteredCalls = frame.filteredCalls;
+    shown.samples = frame.samples;
+    shown.pixels = frame.pixels;
+    shown.sections = frame.sections;
+
+    if(csv.is_open()) writeCsv(frame);
+}
+
+bool FrameProfiler::startCsv(const std::string &path)
+{
+    stopCsv();
+
+    csv.open(path.c_str(), std::ios::out | std::ios::trunc);
+    if(!csv.is_open()) {
+        LOG_WARNING("Failed to open profiler output: %s", path);
+        return false;
+    }
+
+    csv << "frame,section,depth,interval_ms,cpu_ms,gpu_ms,draw_calls,triangles,state_changes,filtered_calls,samples_passed\n";
+    return true;
+}
+
+void FrameProfiler::stopCsv()
+{
+    if(csv.is_open()) csv.close();
+}
+
+void FrameProfiler::writeCsv(const FrameRecord &frame)
+{
+    char line[256];
+
+    for(size_t i = 0; i < frame.sections.size(); ++i) {
+        const SectionRecord &section = frame.sections[i];
+        char gpu[32] = "";
+        if(section.gpuMs >= 0.0) snprintf(gpu, sizeof(gpu), "%.4f", section.gpuMs);
+
+        snprintf(line, sizeof(line), "%lu,%s,%d,,%.4f,%s,%d,%d,%d,%d,\n",
+                 frame.index, section.name, section.depth, section.cpuMs, gpu,
+                 section.drawCalls, section.triangles, section.stateChanges, section.filteredCalls);
+        csv << line;
+    }
+
+    char samples[32] = "";
+    if(frame.samples >= 0) snprintf(samples, sizeof(samples), "%lld", frame.samples);
+
+    snprintf(line, sizeof(line), "%lu,frame,,%.4f,%.4f,%.4f,%d,%d,%d,%d,%s\n",
+             frame.index, frame.intervalMs, frame.cpuMs, frame.gpuMs,
+             frame.drawCalls, frame.triangles, frame.stateChanges, frame.filteredCalls, samples);
+    csv << line;
+}
+
+void FrameProfiler::drawOverlay(QGLWidget *widget)
+{
+    if(!overlayVisible || widget == NULL) return;
+
+    glState.pushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_TEXTURE_2D);
+    glState.disable(GL_DEPTH_TEST);
+    glColor3f(1.0f, 1.0f, 0.4f);
+
+    const int lineHeight = 14;
+    int y = lineHeight + 4;
+    char line[256];
+
+    const double fps = smoothedIntervalMs > 0.0 ? 1000.0 / smoothedIntervalMs : 0.0;
+    snprintf(line, sizeof(line), "frame %lu: %.2f ms (%.1f fps)  cpu %.2f ms  gpu %s",
+             shown.index, smoothedIntervalMs, fps, shown.cpuMs, gpuTimers ? "" : "n/a");
+    if(gpuTimers) snprintf(line + strlen(line), sizeof(line) - strlen(line), "%.2f ms", shown.gpuMs);
+    widget->renderText(10, y, QString(line));
+    y += lineHeight;
+
+    snprintf(line, sizeof(line), "draws %d  triangles %d  state changes %d  filtered %d%s",
+             shown.drawCalls, shown.triangles, shown.stateChanges, shown.filteredCalls, csv.is_open() ? "  [csv]" : "");
+    widget->renderText(10, y, QString(line));
+    y += lineHeight;
+
+    if(shown.samples >= 0 && shown.pixels > 0) {
+        snprintf(line, sizeof(line), "opaque samples %lld  (%.2f per pixel)",
+                 shown.samples, (double)shown.samples / shown.pixels);
+        widget->renderText(10, y, QString(line));
+        y += lineHeight;
+    }
+
+    for(size_t i = 0; i < shown.sections.size(); ++i) {
+        const SectionRecord &section = shown.sections[i];
+        char gpu[32] = "   -  ";
+        if(section.gpuMs >= 0.0) snprintf(gpu, sizeof(gpu), "%6.3f", section.gpuMs);
+
+        snprintf(line, sizeof(line), "%*s%-16s cpu %6.3f  gpu %s  draws %4d  tris %7d",
+                 2 * section.depth, "", section.name, section.cpuMs, gpu, section.drawCalls, section.triangles);
+        widget->renderText(10, y, QString(line));
+        y += lineHeight;
+    }
+
+    // renderText binds its glyph textures and buffers behind the cache
+    glState.popAttrib();
+    glState.invalidate();
+}
+
+ProfileScope::ProfileScope(const char *name)
+{
+    profiler.beginSection(name);
+}
+
+ProfileScope::~ProfileScope()
+{
+    profiler.endSection();
+}
@@ -0,0 +1,141 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QtOpenGL>
+#include <QGLWidget>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Per-frame CPU and GPU timing.
+ *
+ * paintGL is split in named sections (skybox, ship parts, planets...). Each
+ * section is timed on the CPU and, when the context supports GL_TIME_ELAPSED
+ * queries, on the GPU as well. Queries are kept in a ring of kFrameLatency
+ * frames and are only read back when the ring slot is reused, so reading the
+ * results never waits for the GPU. A frame whose queries are still not
+ * available at that point simply has no GPU time.
+ *
+ * A GL_SAMPLES_PASSED query can also wrap one part of the frame (the opaque
+ * pass) to count the fragments that reached the framebuffer, which divided
+ * by the viewport size gives the average overdraw.
+ *
+ * Resolved frames feed the on-screen overlay and, optionally, a CSV file.
+ */
+class FrameProfiler
+{
+public:
+    FrameProfiler();
+    ~FrameProfiler();
+
+    // Needs a current GL context
+    void init();
+
+    void beginFrame();
+    void endFrame();
+
+    // Sections can be nested on the CPU side. GL_TIME_ELAPSED queries cannot,
+    // so only the outermost open section gets a GPU query.
+    void beginSection(const char *name);
+    void endSection();
+
+    // Counters, accumulated in the current frame and the open section
+    void countDraw(GLsizei triangles);
+    void countStateChange(int count = 1);
+    // State calls dropped because they changed nothing (see GLStateCache)
+    void countFilteredCall(int count = 1);
+
+    // Counts the samples passing the depth test in between, once per frame
+    void beginSampleCount();
+    void endSampleCount();
+
+    void setOverlayVisible(bool visible) { overlayVisible = visible; }
+    bool isOverlayVisible() const { return overlayVisible; }
+
+    // Draws the overlay with the results of the last resolved frame
+    void drawOverlay(QGLWidget *widget);
+
+    // Streams one row per section and one row per frame to the given file
+    bool startCsv(const std::string &path);
+    void stopCsv();
+    bool isCsvRecording() const { return csv.is_open(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int kFrameLatency = 4;
+
+    struct SectionRecord {
+        const char *name;
+        int depth;
+        Clock::time_point start;
+        double cpuMs;
+        double gpuMs;       // < 0 when not measured
+        GLuint query;       // 0 when no query was issued
+        int drawCalls;
+        int triangles;
+        int stateChanges;
+        int filteredCalls;
+    };
+
+    struct FrameRecord {
+        unsigned long index;
+        bool pending;       // waiting to be resolved
+        double cpuMs;       // time spent between beginFrame and endFrame
+        double intervalMs;  // time since the previous beginFrame
+        double gpuMs;       // sum of the sections measured on the GPU
+        int drawCalls;
+        int triangles;
+        int stateChanges;
+        int filteredCalls;
+        std::vector<SectionRecord> sections;
+        std::vector<GLuint> queryPool;
+        size_t queriesUsed;
+        GLuint samplesQuery;    // 0 until first used
+        bool samplesIssued;
+        long long samples;      // < 0 when not measured
+        long long pixels;       // viewport size when the samples were counted
+    };
+
+    void resolve(FrameRecord &frame);
+    void writeCsv(const FrameRecord &frame);
+    GLuint nextQuery(FrameRecord &frame);
+
+    bool gpuTimers;
+    bool sampleQueries;
+    bool countingSamples;
+    bool overlayVisible;
+    bool inFrame;
+    unsigned long frameIndex;
+    int queryOwner;             // index of the section owning the running query, -1 if none
+
+    Clock::time_point frameStart;
+    Clock::time_point lastFrameStart;
+
+    FrameRecord frames[kFrameLatency];
+    std::vector<int> openSections;
+
+    // Last resolved frame, shown by the overlay
+    FrameRecord shown;
+    double smoothedIntervalMs;
+
+    std::ofstream csv;
+};
+
+// RAII helper timing the enclosing block as one section
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name);
+    ~ProfileScope();
+
+private:
+    ProfileScope(const ProfileScope &);
+    ProfileScope &operator = (const ProfileScope &);
+};
+
+extern FrameProfiler profiler;
+
+#endif // PROFILER_H
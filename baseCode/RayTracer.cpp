@@ -0,0 +1,369 @@
+#include "RayTracer.h"
+#include "Parallel.h"
+#include "Skybox.h"
+#include "VecMath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+// GL's default global ambient light
+const float kSceneAmbient = 0.2f;
+
+const int kTileSize = 16;
+
+// Subpixel positions of the four rays of a pixel
+const float kSampleX[4] = { 0.25f, 0.75f, 0.25f, 0.75f };
+const float kSampleY[4] = { 0.25f, 0.25f, 0.75f, 0.75f };
+
+inline unsigned int toByte(float value)
+{
+    return (unsigned int)std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f));
+}
+
+// Eye space point of window coordinates (in [-1, 1]) at depth ndcZ
+Vec3 unproject(const Matrix4 &inverseProjection, float ndcX, float ndcY, float ndcZ)
+{
+    const GLfloat *m = inverseProjection.m;
+    const float x = m[0] * ndcX + m[4] * ndcY + m[8] * ndcZ + m[12];
+    const float y = m[1] * ndcX + m[5] * ndcY + m[9] * ndcZ + m[13];
+    const float z = m[2] * ndcX + m[6] * ndcY + m[10] * ndcZ + m[14];
+    const float w = m[3] * ndcX + m[7] * ndcY + m[11] * ndcZ + m[15];
+    return Vec3(x / w, y / w, z / w);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+RayTracer::RayTracer() : inverseProjection(Matrix4::identity()), shininess(0.0f), sky(NULL), footprint(0.0f)
+{
+    // GL's defaults
+    light[0] = 0.0f; light[1] = 0.0f; light[2] = 1.0f; light[3] = 0.0f;
+    for(int c = 0; c < 3; ++c) {
+        ambient[c] = 0.2f;
+        diffuse[c] = 0.8f;
+        specular[c] = 0.0f;
+    }
+    for(int k = 0; k < 9; ++k) skyRotation[k] = k % 4 == 0 ? 1.0f : 0.0f;
+}
+
+void RayTracer::setProjection(const Matrix4 &projection)
+{
+    inverseProjection = projection.inverse();
+}
+
+void RayTracer::setLight(const GLfloat position[4])
+{
+    for(int k = 0; k < 4; ++k) light[k] = position[k];
+}
+
+void RayTracer::setMaterial(const GLfloat materialAmbient[4], const GLfloat materialDiffuse[4],
+                            const GLfloat materialSpecular[4], GLfloat materialShininess)
+{
+    for(int c = 0; c < 3; ++c) {
+        ambient[c] = materialAmbient[c];
+        diffuse[c] = materialDiffuse[c];
+        specular[c] = materialSpecular[c];
+    }
+    shininess = materialShininess;
+}
+
+void RayTracer::setEnvironment(const std::string &equirectPath, const Matrix4 &view)
+{
+    sky = equirectPath.empty() ? NULL : texture(equirectPath);
+
+    // The view is a rotation and a translation: its upper 3x3 transposed
+    // takes eye directions back to the world
+    for(int r = 0; r < 3; ++r)
+        for(int c = 0; c < 3; ++c) skyRotation[3 * r + c] = view.m[4 * r + c];
+}
+
+const SoftTexture *RayTracer::texture(const std::string &path)
+{
+    std::map<std::string, SoftTexture>::iterator found = cache.find(path);
+    if(found == cache.end()) {
+        found = cache.insert(std::make_pair(path, SoftTexture())).first;
+        found->second.load(path);
+    }
+    return found->second.levels.empty() ? NULL : &found->second;
+}
+
+void RayTracer::clear()
+{
+    positions.clear();
+    normals.clear();
+    uvs.clear();
+    indices.clear();
+    triangleMesh.clear();
+    meshTextures.clear();
+}
+
+void RayTracer::add(const Matrix4 &modelview, const TriangleMesh &mesh, const std::string &texturePath)
+{
+    if(mesh.vertexCount == 0) return;
+    const size_t first = positions.size() / 3;
+    const unsigned int meshIndex = (unsigned int)meshTextures.size();
+    meshTextures.push_back(texturePath.empty() ? NULL : texture(texturePath));
+
+    // Inverse transpose of the upper 3x3 for the normals, as GL does
+    const Matrix4 inverse = modelview.inverse();
+    const GLfloat *m = modelview.m;
+
+    for(size_t i = 0; i < mesh.vertexCount; ++i) {
+        const GLfloat *p = &mesh.positions[3 * i];
+        for(int r = 0; r < 3; ++r)
+            positions.push_back(m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r]);
+
+        Vec3 n(0.0f, 0.0f, 1.0f);
+        if(mesh.normals) {
+            const GLfloat *q = &mesh.normals[3 * i];
+            const GLfloat *w = inverse.m;
+            n = normalized(Vec3(w[0] * q[0] + w[1] * q[1] + w[2] * q[2],
+                                w[4] * q[0] + w[5] * q[1] + w[6] * q[2],
+                                w[8] * q[0] + w[9] * q[1] + w[10] * q[2]));
+        }
+        normals.push_back(n.x);
+        normals.push_back(n.y);
+        normals.push_back(n.z);
+
+        uvs.push_back(mesh.uvs ? mesh.uvs[2 * i] : 0.0f);
+        uvs.push_back(mesh.uvs ? mesh.uvs[2 * i + 1] : 0.0f);
+    }
+
+    const size_t count = mesh.indices ? mesh.indexCount : mesh.vertexCount;
+    for(size_t t = 0; t + 2 < count; t += 3) {
+        bool valid = true;
+        GLuint corner[3];
+        for(int k = 0; k < 3; ++k) {
+            corner[k] = mesh.indices ? mesh.indices[t + k] : (GLuint)(t + k);
+            valid = valid && corner[k] < mesh.vertexCount;
+        }
+        if(!valid) continue;
+        for(int k = 0; k < 3; ++k) indices.push_back((GLuint)(first + corner[k]));
+        triangleMesh.push_back(meshIndex);
+    }
+}
+
+void RayTracer::environment(const float direction[3], float color[3]) const
+{
+    if(!sky) {
+        color[0] = color[1] = color[2] = 0.0f;
+        return;
+    }
+    const float *r = skyRotation;
+    double x = r[0] * direction[0] + r[1] * direction[1] + r[2] * direction[2];
+    double y = r[3] * direction[0] + r[4] * direction[1] + r[5] * direction[2];
+    double z = r[6] * direction[0] + r[7] * direction[1] + r[8] * direction[2];
+    const double length = std::sqrt(x * x + y * y + z * z);
+    x /= length; y /= length; z /= length;
+
+    double u, v;
+    Skybox::directionToEquirect(x, y, z, u, v);
+    // Clamped so that the poles do not wrap to the other end of the image
+    const double halfTexel = 0.5 / sky->levels[0].height;
+    v = std::min(std::max(v, halfTexel), 1.0 - halfTexel);
+
+    float texel[4];
+    sky->sample(0, (float)u, (float)v, texel);
+    for(int c = 0; c < 3; ++c) color[c] = texel[2 - c] / 255.0f;
+}
+
+void RayTracer::shade(const Bvh::Hit &hit, const float origin[3], const float direction[3], Shading &out) const
+{
+    const GLuint *corner = &indices[3 * hit.triangle];
+    const float w[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+
+    Vec3 p[3];
+    Vec3 n(0.0f, 0.0f, 0.0f);
+    float uv[3][2], u = 0.0f, v = 0.0f;
+    for(int k = 0; k < 3; ++k) {
+        const size_t i = corner[k];
+        p[k] = Vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+        n = n + Vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]) * w[k];
+        uv[k][0] = uvs[2 * i];
+        uv[k][1] = uvs[2 * i + 1];
+        u += uv[k][0] * w[k];
+        v += uv[k][1] * w[k];
+    }
+    n = normalized(n);
+
+    const Vec3 position = Vec3(origin[0], origin[1], origin[2]) + Vec3(direction[0], direction[1], direction[2]) * hit.t;
+    Vec3 l(light[0], light[1], light[2]);
+    float distance = 1e30f;
+    if(light[3] != 0.0f) {
+        l = l * (1.0f / light[3]) - position;
+        distance = length(l);
+    }
+    l = normalized(l);
+
+    // GL's lighting terms, evaluated per pixel rather than per vertex
+    const float nDotL = dot(n, l);
+    float highlight = 0.0f;
+    if(nDotL > 0.0f) {
+        const float nDotH = std::max(0.0f, dot(n, normalized(l + Vec3(0.0f, 0.0f, 1.0f))));
+        highlight = std::pow(nDotH, shininess);
+    }
+    for(int c = 0; c < 3; ++c) {
+        out.ambient[c] = kSceneAmbient * ambient[c];
+        out.direct[c] = std::max(nDotL, 0.0f) * diffuse[c] + highlight * specular[c];
+        out.texel[c] = 1.0f;
+    }
+
+    // The shadow ray leaves from just off the surface, on the side of the
+    // light, far enough for float positions of this magnitude
+    const Vec3 face = cross(p[1] - p[0], p[2] - p[0]);
+    const float faceArea = length(face);
+    out.lightDistance = 0.0f;
+    if(nDotL > 0.0f && faceArea > 0.0f) {
+        Vec3 geometric = face * (1.0f / faceArea);
+        if(dot(geometric, l) < 0.0f) geometric = geometric * -1.0f;
+        const float offset = 1e-4f * (1.0f + length(position));
+        const Vec3 start = position + geometric * offset;
+        out.shadowOrigin[0] = start.x; out.shadowOrigin[1] = start.y; out.shadowOrigin[2] = start.z;
+        out.toLight[0] = l.x; out.toLight[1] = l.y; out.toLight[2] = l.z;
+        out.lightDistance = distance - offset;
+    }
+
+    const SoftTexture *tex = meshTextures[triangleMesh[hit.triangle]];
+    if(!tex) return;
+
+    // Mip level from the texels the sample covers on the triangle
+    int level = 0;
+    if(tex->levels.size() > 1 && faceArea > 0.0f) {
+        const MipLevel &base = tex->levels[0];
+        const float du1 = uv[1][0] - uv[0][0], dv1 = uv[1][1] - uv[0][1];
+        const float du2 = uv[2][0] - uv[0][0], dv2 = uv[2][1] - uv[0][1];
+        const float texelArea = std::fabs(du1 * dv2 - du2 * dv1) * base.width * base.height;
+        const float side = hit.t * footprint;
+        const float ratio = texelArea / faceArea * side * side;
+        if(ratio > 1.0f) level = std::min((int)tex->levels.size() - 1, (int)(0.5f * std::log2(ratio)));
+    }
+    float texel[4];
+    tex->sample(level, u, v, texel);
+    for(int c = 0; c < 3; ++c) out.texel[c] = texel[2 - c] / 255.0f;
+}
+
+void RayTracer::traceTile(int x0, int y0, int x1, int y1, int width, int height, unsigned int *pixels,
+                          unsigned long long &rays) const
+{
+    Bvh::RayPacket camera, shadow;
+    Bvh::HitPacket hits, blocked;
+    Shading shading[4];
+
+    for(int y = y0; y < y1; ++y) {
+        for(int x = x0; x < x1; ++x) {
+            // Four rays from the near plane to the far plane, so that the
+            // frustum clips the scene as in GL
+            for(int lane = 0; lane < 4; ++lane) {
+                const float ndcX = 2.0f * (x + kSampleX[lane]) / width - 1.0f;
+                const float ndcY = 1.0f - 2.0f * (y + kSampleY[lane]) / height;
+                const Vec3 nearPoint = unproject(inverseProjection, ndcX, ndcY, -1.0f);
+                const Vec3 farPoint = unproject(inverseProjection, ndcX, ndcY, 1.0f);
+                const Vec3 span = farPoint - nearPoint;
+                const float spanLength = length(span);
+                const Vec3 direction = span * (1.0f / spanLength);
+                camera.origin[0][lane] = nearPoint.x;
+                camera.origin[1][lane] = nearPoint.y;
+                camera.origin[2][lane] = nearPoint.z;
+                camera.direction[0][lane] = direction.x;
+                camera.direction[1][lane] = direction.y;
+                camera.direction[2][lane] = direction.z;
+                camera.tMax[lane] = spanLength;
+            }
+            bvh.intersect(camera, hits);
+            rays += 4;
+
+            int shadowRays = 0;
+            for(int lane = 0; lane < 4; ++lane) {
+                shadow.tMax[lane] = 0.0f;
+                for(int a = 0; a < 3; ++a) {
+                    shadow.origin[a][lane] = 0.0f;
+                    shadow.direction[a][lane] = 1.0f;
+                }
+                const Bvh::Hit &hit = hits.hits[lane];
+                if(hit.triangle == Bvh::kNoHit) continue;
+
+                const float origin[3] = { camera.origin[0][lane], camera.origin[1][lane], camera.origin[2][lane] };
+                const float direction[3] = { camera.direction[0][lane], camera.direction[1][lane],
+                                             camera.direction[2][lane] };
+                Shading &s = shading[lane];
+                shade(hit, origin, direction, s);
+                if(s.lightDistance > 0.0f) {
+                    for(int a = 0; a < 3; ++a) {
+                        shadow.origin[a][lane] = s.shadowOrigin[a];
+                        shadow.direction[a][lane] = s.toLight[a];
+                    }
+                    shadow.tMax[lane] = s.lightDistance;
+                    ++shadowRays;
+                }
+            }
+            if(shadowRays > 0) {
+                bvh.occluded(shadow, blocked);
+                rays += shadowRays;
+            }
+
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            for(int lane = 0; lane < 4; ++lane) {
+                float color[3];
+                if(hits.hits[lane].triangle == Bvh::kNoHit) {
+                    const float direction[3] = { camera.direction[0][lane], camera.direction[1][lane],
+                                                 camera.direction[2][lane] };
+                    environment(direction, color);
+                } else {
+                    const Shading &s = shading[lane];
+                    const bool lit = shadow.tMax[lane] > 0.0f && blocked.hits[lane].triangle == Bvh::kNoHit;
+                    for(int c = 0; c < 3; ++c)
+                        color[c] = std::min(1.0f, s.ambient[c] + (lit ? s.direct[c] : 0.0f)) * s.texel[c];
+                }
+                for(int c = 0; c < 3; ++c) sum[c] += color[c];
+            }
+            pixels[(size_t)y * width + x] = 0xff000000u | toByte(0.25f * sum[0]) << 16 |
+                                            toByte(0.25f * sum[1]) << 8 | toByte(0.25f * sum[2]);
+        }
+    }
+}
+
+void RayTracer::render(int width, int height, std::vector<unsigned int> &pixels, TraceStats &stats)
+{
+    stats = TraceStats();
+    pixels.assign((size_t)std::max(width, 0) * std::max(height, 0), 0xff000000u);
+    if(pixels.empty()) return;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const size_t triangleCount = indices.size() / 3;
+    bvh.build(triangleCount ? &positions[0] : NULL, triangleCount ? &indices[0] : NULL, triangleCount);
+    stats.buildMs = millisecondsSince(start);
+    stats.triangles = bvh.triangleCount();
+    stats.nodes = bvh.nodeCount();
+
+    // Angle between two samples at the center of the image
+    const Vec3 center = unproject(inverseProjection, 0.0f, 0.0f, -1.0f);
+    const Vec3 aside = unproject(inverseProjection, 1.0f / width, 0.0f, -1.0f);
+    footprint = length(aside - center) / length(center);
+
+    // Tiles handed out one at a time: the sky is cheap, the ship is not
+    start = std::chrono::steady_clock::now();
+    const int tilesX = (width + kTileSize - 1) / kTileSize, tilesY = (height + kTileSize - 1) / kTileSize;
+    const int tileCount = tilesX * tilesY;
+    std::atomic<int> next(0);
+    std::atomic<unsigned long long> totalRays(0);
+    unsigned int *out = &pixels[0];
+    parallelFor(workerCount(), 1, [&](size_t, size_t) {
+        unsigned long long rays = 0;
+        for(int tile = next++; tile < tileCount; tile = next++) {
+            const int x0 = (tile % tilesX) * kTileSize, y0 = (tile / tilesX) * kTileSize;
+            traceTile(x0, y0, std::min(width, x0 + kTileSize), std::min(height, y0 + kTileSize), width, height,
+                      out, rays);
+        }
+        totalRays += rays;
+    });
+    stats.traceMs = millisecondsSince(start);
+    stats.rays = totalRays;
+}
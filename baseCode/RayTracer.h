@@ -0,0 +1,95 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <QtOpenGL>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Bvh.h"
+#include "Drawable.h"
+#include "Matrix4.h"
+#include "SoftTexture.h"
+
+// What one render() cost
+struct TraceStats {
+    size_t triangles;
+    size_t nodes;
+    double buildMs;
+    unsigned long long rays;    // camera and shadow rays
+    double traceMs;
+
+    double raysPerSecond() const { return traceMs > 0.0 ? rays * 1000.0 / traceMs : 0.0; }
+};
+
+/*
+ * Offline renderer for stills: ray traces a frame of the scene as the GL
+ * path draws it, with per pixel lighting, shadows and 4 samples per pixel.
+ *
+ * Meshes are added in eye space, as DrawList records them, and flattened
+ * into a single BVH. Each pixel is one packet of four rays on a 2x2 grid
+ * (see Bvh::RayPacket), its shadow rays another; the image is cut in tiles
+ * handed to all cores. Rays that leave the scene see the sky, sampled from
+ * the same equirectangular image the skybox is baked from.
+ *
+ * Makes no GL call: any thread can render.
+ */
+class RayTracer
+{
+public:
+    RayTracer();
+
+    void setProjection(const Matrix4 &projection);
+    // GL_LIGHT0 position, in eye space
+    void setLight(const GLfloat position[4]);
+    // Front material, RGBA
+    void setMaterial(const GLfloat ambient[4], const GLfloat diffuse[4], const GLfloat specular[4], GLfloat shininess);
+    // Sky image, and the world to eye transformation it is seen with
+    void setEnvironment(const std::string &equirectPath, const Matrix4 &view);
+
+    // Empties the scene, the textures stay loaded
+    void clear();
+    // Copies the triangles, transformed to eye space; texturePath may be empty
+    void add(const Matrix4 &modelview, const TriangleMesh &mesh, const std::string &texturePath);
+
+    // Builds the BVH and traces the frame: ARGB words, top row first
+    void render(int width, int height, std::vector<unsigned int> &pixels, TraceStats &stats);
+
+private:
+    // Lighting at a hit, split by what its shadow ray decides
+    struct Shading {
+        float ambient[3];
+        float direct[3];            // diffuse and specular, when the light is not blocked
+        float texel[3];             // modulates both, white without texture
+        float shadowOrigin[3];
+        float toLight[3];
+        float lightDistance;        // 0 when facing away from the light
+    };
+
+    const SoftTexture *texture(const std::string &path);
+    void environment(const float direction[3], float color[3]) const;
+    void traceTile(int x0, int y0, int x1, int y1, int width, int height, unsigned int *pixels,
+                   unsigned long long &rays) const;
+    void shade(const Bvh::Hit &hit, const float origin[3], const float direction[3], Shading &out) const;
+
+    Matrix4 inverseProjection;
+    GLfloat light[4];
+    GLfloat ambient[3], diffuse[3], specular[3], shininess;
+
+    const SoftTexture *sky;
+    float skyRotation[9];       // eye to world, row major
+    float footprint;            // width of a sample at distance 1 from the eye
+
+    // The scene, in eye space
+    std::vector<GLfloat> positions;
+    std::vector<GLfloat> normals;
+    std::vector<GLfloat> uvs;
+    std::vector<GLuint> indices;
+    std::vector<unsigned int> triangleMesh;         // mesh of each triangle
+    std::vector<const SoftTexture*> meshTextures;   // texture of each mesh, or NULL
+
+    Bvh bvh;
+    std::map<std::string, SoftTexture> cache;
+};
+
+#endif // RAYTRACER_H
@@ -0,0 +1,183 @@
+#include "Skybox.h"
+#include "Base.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "Vfs.h"
+
+namespace {
+
+// Unit cube as 12 triangles, positions double as cube map directions
+const GLfloat cubeVertices[] = {
+    // +X
+     1, -1, -1,   1, -1,  1,   1,  1,  1,
+     1, -1, -1,   1,  1,  1,   1,  1, -1,
+    // -X
+    -1, -1,  1,  -1, -1, -1,  -1,  1, -1,
+    -1, -1,  1,  -1,  1, -1,  -1,  1,  1,
+    // +Y
+    -1,  1, -1,   1,  1, -1,   1,  1,  1,
+    -1,  1, -1,   1,  1,  1,  -1,  1,  1,
+    // -Y
+    -1, -1,  1,   1, -1,  1,   1, -1, -1,
+    -1, -1,  1,   1, -1, -1,  -1, -1, -1,
+    // +Z
+     1, -1,  1,  -1, -1,  1,  -1,  1,  1,
+     1, -1,  1,  -1,  1,  1,   1,  1,  1,
+    // -Z
+    -1, -1, -1,   1, -1, -1,   1,  1, -1,
+    -1, -1, -1,   1,  1, -1,  -1,  1, -1
+};
+
+// Direction through texel (s, t) of a cube face, s and t in [-1, 1].
+// Follows the face orientation table of the GL specification.
+Point3d faceDirection(int face, double s, double t)
+{
+    switch(face) {
+    case 0:  return Point3d( 1, -t, -s);    // +X
+    case 1:  return Point3d(-1, -t,  s);    // -X
+    case 2:  return Point3d( s,  1,  t);    // +Y
+    case 3:  return Point3d( s, -1, -t);    // -Y
+    case 4:  return Point3d( s, -t,  1);    // +Z
+    default: return Point3d(-s, -t, -1);    // -Z
+    }
+}
+
+// Bilinear fetch, wrapping horizontally (longitude) and clamping vertically
+QRgb sampleEquirect(const QImage &img, double u, double v)
+{
+    const int w = img.width();
+    const int h = img.height();
+
+    const double x = u * w - 0.5;
+    const double y = v * h - 0.5;
+    const int x0 = (int)floor(x);
+    const int y0 = (int)floor(y);
+    const double fx = x - x0;
+    const double fy = y - y0;
+
+    const int xs[2] = { ((x0 % w) + w) % w, (((x0 + 1) % w) + w) % w };
+    const int ys[2] = { std::min(std::max(y0, 0), h - 1), std::min(std::max(y0 + 1, 0), h - 1) };
+
+    const QRgb *row0 = (const QRgb *)img.constScanLine(ys[0]);
+    const QRgb *row1 = (const QRgb *)img.constScanLine(ys[1]);
+    const QRgb texels[4] = { row0[xs[0]], row0[xs[1]], row1[xs[0]], row1[xs[1]] };
+    const double weights[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+    double r = 0, g = 0, b = 0;
+    for(int i = 0; i < 4; ++i) {
+        r += weights[i] * qRed(texels[i]);
+        g += weights[i] * qGreen(texels[i]);
+        b += weights[i] * qBlue(texels[i]);
+    }
+    return qRgba((int)(r + 0.5), (int)(g + 0.5), (int)(b + 0.5), 255);
+}
+
+}
+
+Skybox::Skybox(const std::string &_path) : path(_path), loaded(false), name(0) { }
+
+void Skybox::directionToEquirect(double x, double y, double z, double &u, double &v)
+{
+    u = 0.5 + atan2(x, -z) / (2.0 * PI);
+    v = acos(std::min(std::max(y, -1.0), 1.0)) / PI;
+}
+
+void Skybox::bakeFaces(const QImage &equirect, int faceSize, std::vector<GLuint> &faces) const
+{
+    faces.resize(6 * faceSize * faceSize);
+
+    for(int face = 0; face < 6; ++face) {
+        GLuint *texels = &faces[face * faceSize * faceSize];
+
+        for(int j = 0; j < faceSize; ++j) {
+            const double t = 2.0 * (j + 0.5) / faceSize - 1.0;
+            for(int i = 0; i < faceSize; ++i) {
+                const double s = 2.0 * (i + 0.5) / faceSize - 1.0;
+                const Point3d d = faceDirection(face, s, t).normalized();
+
+                double u, v;
+                directionToEquirect(d.x(), d.y(), d.z(), u, v);
+                texels[j * faceSize + i] = sampleEquirect(equirect, u, v);
+            }
+        }
+    }
+}
+
+void Skybox::init()
+{
+    QImage img;
+    std::string error;
+    if(!vfs.readImage(path, img, error)) {
+        LOG_WARNING("Failed to read: %s with message:%s; ", path, error);
+        return;
+    }
+    img = img.convertToFormat(QImage::Format_ARGB32);
+
+    // A cube face spans a quarter of the longitudes and half of the latitudes
+    const int faceSize = std::max(img.width() / 4, img.height() / 2);
+
+    std::vector<GLuint> faces;
+    bakeFaces(img, faceSize, faces);
+
+    glGenTextures(1, &name);
+    glState.bindTexture(GL_TEXTURE_CUBE_MAP, name);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // QRgb is 0xAARRGGBB, which is what BGRA/8_8_8_8_REV reads on any endianness
+    for(int face = 0; face < 6; ++face) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, faceSize, faceSize, 0,
+                     GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &faces[face * faceSize * faceSize]);
+    }
+
+    glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    loaded = true;
+}
+
+void Skybox::draw()
+{
+    if(!loaded) return;
+
+    glState.pushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_VIEWPORT_BIT | GL_CURRENT_BIT | GL_TEXTURE_BIT);
+
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_TEXTURE_2D);
+    glState.enable(GL_TEXTURE_CUBE_MAP);
+#ifdef GL_TEXTURE_CUBE_MAP_SEAMLESS
+    glState.enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+#endif
+    glState.bindTexture(GL_TEXTURE_CUBE_MAP, name);
+    glColor3f(1.0f, 1.0f, 1.0f);
+
+    // Every fragment lands on the far plane: it survives only where the
+    // depth buffer still holds the clear value, and it never writes depth
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glDepthRange(1.0, 1.0);
+
+    // Keep the camera rotation, drop its translation: the sky is at infinity
+    GLfloat view[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    view[12] = view[13] = view[14] = 0.0f;
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadMatrixf(view);
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.clientArrays(true, false, true, false);
+    glVertexPointer(3, GL_FLOAT, 0, cubeVertices);
+    glTexCoordPointer(3, GL_FLOAT, 0, cubeVertices);
+
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    profiler.countDraw(12);
+    profiler.countStateChange(7);
+
+    glPopMatrix();
+    glState.popAttrib();
+}
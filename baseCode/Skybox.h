@@ -0,0 +1,40 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <QtOpenGL>
+#include <string>
+
+/*
+ * Sky drawn as a single unit cube sampling a cube map.
+ *
+ * The six faces are baked at load time from an equirectangular image. The
+ * cube is meant to be drawn after the opaque geometry: it is forced to the
+ * far plane (glDepthRange(1, 1)) and tested with GL_LEQUAL, so only the
+ * pixels nothing else covered get shaded.
+ */
+class Skybox
+{
+public:
+    Skybox(const std::string &_path);
+
+    // Bakes and uploads the cube map, needs a current GL context
+    void init();
+
+    // Draws the sky around the camera of the current modelview matrix
+    void draw();
+
+    const std::string &imagePath() const { return path; }
+
+    // Texture coordinates of a unit world direction in the equirectangular
+    // image: longitude 0 looks down -Z, latitude 0 is the top row
+    static void directionToEquirect(double x, double y, double z, double &u, double &v);
+
+private:
+    void bakeFaces(const QImage &equirect, int faceSize, std::vector<GLuint> &faces) const;
+
+    const std::string path;
+    bool loaded;
+    GLuint name;
+};
+
+#endif // SKYBOX_H
@@ -0,0 +1,481 @@
+#include "SoftRasterizer.h"
+#include "GLState.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTRASTER_SSE2 1
+#endif
+
+namespace {
+
+// GL's default global ambient light
+const float kSceneAmbient = 0.2f;
+
+// Triangles set up by one task
+const size_t kSetupChunk = 2048;
+
+inline float plane(const float p[3], float x, float y)
+{
+    return p[0] * x + p[1] * y + p[2];
+}
+
+inline unsigned int toByte(float value)
+{
+    return (unsigned int)std::min(255.0f, std::max(0.0f, value + 0.5f));
+}
+
+// Plane through three screen space values, as a * x + b * y + c. Solved
+// around the first vertex, in double: c is small then, even far from the origin.
+void planeThrough(const double edge[3][3], double invArea, const float sx[3], const float sy[3],
+                  const float value[3], float out[3])
+{
+    double a = 0.0, b = 0.0;
+    for(int k = 0; k < 3; ++k) {
+        a += edge[k][0] * value[k];
+        b += edge[k][1] * value[k];
+    }
+    a *= invArea;
+    b *= invArea;
+    out[0] = (float)a;
+    out[1] = (float)b;
+    out[2] = (float)(value[0] - a * sx[0] - b * sy[0]);
+}
+
+}
+
+SoftRasterizer::SoftRasterizer()
+    : frameWidth(0), frameHeight(0), tilesX(0), tilesY(0), blocksX(0), blocksY(0),
+      projection(Matrix4::identity()), shininess(0.0f)
+{
+    // GL's defaults
+    light[0] = 0.0f; light[1] = 0.0f; light[2] = 1.0f; light[3] = 0.0f;
+    for(int c = 0; c < 3; ++c) {
+        ambient[c] = 0.2f;
+        diffuse[c] = 0.8f;
+        specular[c] = 0.0f;
+    }
+}
+
+void SoftRasterizer::resize(int width, int height)
+{
+    frameWidth = std::max(width, 0);
+    frameHeight = std::max(height, 0);
+    tilesX = (frameWidth + kTileSize - 1) / kTileSize;
+    tilesY = (frameHeight + kTileSize - 1) / kTileSize;
+    blocksX = (frameWidth + kBlockSize - 1) / kBlockSize;
+    blocksY = (frameHeight + kBlockSize - 1) / kBlockSize;
+
+    const size_t pixelCount = (size_t)frameWidth * frameHeight;
+    color.assign(pixelCount, 0xff000000u);
+    depth.assign(pixelCount + 4, 1.0f);
+    blockFar.assign((size_t)blocksX * blocksY, 1.0f);
+    bins.assign((size_t)tilesX * tilesY, std::vector<unsigned int>());
+    triangles.clear();
+}
+
+void SoftRasterizer::setProjection(const Matrix4 &matrix)
+{
+    projection = matrix;
+}
+
+void SoftRasterizer::setLight(const GLfloat position[4])
+{
+    for(int k = 0; k < 4; ++k) light[k] = position[k];
+}
+
+void SoftRasterizer::setMaterial(const GLfloat materialAmbient[4], const GLfloat materialDiffuse[4],
+                                 const GLfloat materialSpecular[4], GLfloat materialShininess)
+{
+    for(int c = 0; c < 3; ++c) {
+        ambient[c] = materialAmbient[c];
+        diffuse[c] = materialDiffuse[c];
+        specular[c] = materialSpecular[c];
+    }
+    shininess = materialShininess;
+}
+
+const SoftTexture *SoftRasterizer::texture(const std::string &path)
+{
+    std::map<std::string, SoftTexture>::iterator found = cache.find(path);
+    if(found == cache.end()) {
+        found = cache.insert(std::make_pair(path, SoftTexture())).first;
+        found->second.load(path);
+    }
+    return found->second.levels.empty() ? NULL : &found->second;
+}
+
+void SoftRasterizer::begin()
+{
+    triangles.clear();
+    for(size_t i = 0; i < bins.size(); ++i) bins[i].clear();
+}
+
+void SoftRasterizer::draw(const Matrix4 &modelview, const TriangleMesh &mesh, const SoftTexture *texture)
+{
+    if(bins.empty() || mesh.vertexCount == 0) return;
+    const size_t count = mesh.vertexCount;
+
+    // Positions and normals to eye space, one coordinate array at a time
+    eye.assignInterleaved(mesh.positions, count);
+    transformPoints(modelview, eye, eye);
+    if(mesh.normals) {
+        // Inverse transpose of the upper 3x3, as GL transforms normals
+        const Matrix4 inverse = modelview.inverse();
+        Matrix4 normalMatrix = Matrix4::identity();
+        for(int r = 0; r < 3; ++r)
+            for(int c = 0; c < 3; ++c) normalMatrix.m[4 * c + r] = inverse.m[4 * r + c];
+        normals.assignInterleaved(mesh.normals, count);
+        transformPoints(normalMatrix, normals, normals);
+        normalizePoints(normals);
+    }
+
+    // Lighting and clip coordinates, per vertex
+    vertices.resize(count);
+    parallelFor(count, 4096, [&](size_t begin, size_t end) {
+        const GLfloat *p = projection.m;
+        for(size_t i = begin; i < end; ++i) {
+            const float ex = eye.x[i], ey = eye.y[i], ez = eye.z[i];
+            ClipVertex &v = vertices[i];
+            v.x = p[0] * ex + p[4] * ey + p[8] * ez + p[12];
+            v.y = p[1] * ex + p[5] * ey + p[9] * ez + p[13];
+            v.z = p[2] * ex + p[6] * ey + p[10] * ez + p[14];
+            v.w = p[3] * ex + p[7] * ey + p[11] * ez + p[15];
+            v.attrib[0] = mesh.uvs ? mesh.uvs[2 * i] : 0.0f;
+            v.attrib[1] = mesh.uvs ? mesh.uvs[2 * i + 1] : 0.0f;
+
+            // Without normals, GL's current normal: facing the eye
+            Vec3 n(0.0f, 0.0f, 1.0f);
+            if(mesh.normals) n = Vec3(normals.x[i], normals.y[i], normals.z[i]);
+            Vec3 l(light[0], light[1], light[2]);
+            if(light[3] != 0.0f) l = l * (1.0f / light[3]) - Vec3(ex, ey, ez);
+            l = normalized(l);
+
+            // Infinite viewer, as GL_LIGHT_MODEL_LOCAL_VIEWER is off
+            const float nDotL = dot(n, l);
+            float highlight = 0.0f;
+            if(nDotL > 0.0f) {
+                const float nDotH = std::max(0.0f, dot(n, normalized(l + Vec3(0.0f, 0.0f, 1.0f))));
+                highlight = std::pow(nDotH, shininess);
+            }
+            for(int c = 0; c < 3; ++c)
+                v.attrib[2 + c] = std::min(1.0f, kSceneAmbient * ambient[c] + std::max(nDotL, 0.0f) * diffuse[c] +
+                                                 highlight * specular[c]);
+        }
+    });
+
+    // Triangle setup, in chunks whose results are binned in order
+    const size_t triangleCount = mesh.indexCount / 3;
+    const size_t chunks = (triangleCount + kSetupChunk - 1) / kSetupChunk;
+    std::vector<std::vector<Triangle> > results(chunks);
+    parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+        for(size_t c = begin; c < end; ++c) {
+            const size_t first = c * kSetupChunk, last = std::min(triangleCount, first + kSetupChunk);
+            std::vector<Triangle> &out = results[c];
+            out.reserve(last - first);
+
+            for(size_t t = first; t < last; ++t) {
+                const ClipVertex *v[3];
+                bool valid = true;
+                for(int k = 0; k < 3; ++k) {
+                    const size_t index = mesh.indices ? mesh.indices[3 * t + k] : 3 * t + k;
+                    valid = valid && index < count;
+                    v[k] = valid ? &vertices[index] : NULL;
+                }
+                if(valid) clipTriangle(v, texture, out);
+            }
+        }
+    });
+
+    for(size_t c = 0; c < chunks; ++c) {
+        const std::vector<Triangle> &setup = results[c];
+        for(size_t t = 0; t < setup.size(); ++t) {
+            const Triangle &tri = setup[t];
+            const unsigned int index = (unsigned int)triangles.size();
+            triangles.push_back(tri);
+            for(int ty = tri.minY / kTileSize; ty <= tri.maxY / kTileSize; ++ty)
+                for(int tx = tri.minX / kTileSize; tx <= tri.maxX / kTileSize; ++tx)
+                    bins[ty * tilesX + tx].push_back(index);
+        }
+    }
+}
+
+void SoftRasterizer::clipTriangle(const ClipVertex *v[3], const SoftTexture *texture, std::vector<Triangle> &out) const
+{
+    // Outside the same side, near or far plane: nothing to draw
+    int all = 0x3f, any = 0;
+    for(int k = 0; k < 3; ++k) {
+        const ClipVertex &p = *v[k];
+        const int code = (p.x < -p.w ? 1 : 0) | (p.x > p.w ? 2 : 0) | (p.y < -p.w ? 4 : 0) |
+                         (p.y > p.w ? 8 : 0) | (p.z < -p.w ? 16 : 0) | (p.z > p.w ? 32 : 0);
+        all &= code;
+        any |= code;
+    }
+    if(all) return;
+    if(!(any & 16)) {
+        setupTriangle(*v[0], *v[1], *v[2], texture, out);
+        return;
+    }
+
+    // Only the near plane is clipped: past it w gets to 0 and the division
+    // breaks down. The others are left to the screen bounds and the depth test.
+    ClipVertex polygon[4];
+    int n = 0;
+    for(int k = 0; k < 3; ++k) {
+        const ClipVertex &a = *v[k], &b = *v[(k + 1) % 3];
+        const float da = a.z + a.w, db = b.z + b.w;
+        if(da >= 0.0f) polygon[n++] = a;
+        if((da >= 0.0f) != (db >= 0.0f)) {
+            const float t = da / (da - db);
+            ClipVertex &p = polygon[n++];
+            p.x = a.x + (b.x - a.x) * t;
+            p.y = a.y + (b.y - a.y) * t;
+            p.z = a.z + (b.z - a.z) * t;
+            p.w = a.w + (b.w - a.w) * t;
+            for(int j = 0; j < 5; ++j) p.attrib[j] = a.attrib[j] + (b.attrib[j] - a.attrib[j]) * t;
+        }
+    }
+    for(int i = 1; i + 1 < n; ++i) setupTriangle(polygon[0], polygon[i], polygon[i + 1], texture, out);
+}
+
+void SoftRasterizer::setupTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c,
+                                   const SoftTexture *texture, std::vector<Triangle> &out) const
+{
+    const ClipVertex *v[3] = { &a, &b, &c };
+    float sx[3], sy[3], sz[3], iw[3];
+    for(int k = 0; k < 3; ++k) {
+        iw[k] = 1.0f / v[k]->w;
+        sx[k] = (v[k]->x * iw[k] * 0.5f + 0.5f) * frameWidth;
+        sy[k] = (v[k]->y * iw[k] * 0.5f + 0.5f) * frameHeight;
+        sz[k] = v[k]->z * iw[k] * 0.5f + 0.5f;
+    }
+
+    const double area = ((double)sx[1] - sx[0]) * ((double)sy[2] - sy[0]) - ((double)sx[2] - sx[0]) * ((double)sy[1] - sy[0]);
+    if(!(std::fabs(area) > 1e-8)) return;   // NaN included
+
+    const float lowX = std::max(0.0f, std::min(sx[0], std::min(sx[1], sx[2])));
+    const float highX = std::min((float)frameWidth - 1.0f, std::max(sx[0], std::max(sx[1], sx[2])));
+    const float lowY = std::max(0.0f, std::min(sy[0], std::min(sy[1], sy[2])));
+    const float highY = std::min((float)frameHeight - 1.0f, std::max(sy[0], std::max(sy[1], sy[2])));
+    if(lowX > highX || lowY > highY) return;
+
+    Triangle tri;
+    tri.minX = (int)std::floor(lowX);
+    tri.maxX = (int)std::ceil(highX);
+    tri.minY = (int)std::floor(lowY);
+    tri.maxY = (int)std::ceil(highY);
+    tri.minZ = std::min(sz[0], std::min(sz[1], sz[2]));
+    tri.texture = texture;
+    tri.level = 0;
+
+    // Edge k faces vertex k; flipped for clockwise triangles so that the
+    // inside is positive either way (nothing is culled, as in the GL path).
+    // Top-left fill rule: a pixel center exactly on an edge shared by two
+    // triangles belongs to one of them only, the one whose inside is to the
+    // right of the edge, or below it for a horizontal edge (y goes up). The
+    // shared edge evaluates to exactly opposite values in both.
+    const double sign = area > 0.0 ? 1.0 : -1.0;
+    double edge[3][3];
+    for(int k = 0; k < 3; ++k) {
+        const int i = (k + 1) % 3, j = (k + 2) % 3;
+        edge[k][0] = sign * ((double)sy[i] - sy[j]);
+        edge[k][1] = sign * ((double)sx[j] - sx[i]);
+        edge[k][2] = sign * ((double)sx[i] * sy[j] - (double)sx[j] * sy[i]);
+        for(int e = 0; e < 3; ++e) tri.edge[k][e] = (float)edge[k][e];
+        tri.topLeft[k] = tri.edge[k][0] > 0.0f || (tri.edge[k][0] == 0.0f && tri.edge[k][1] < 0.0f);
+    }
+
+    const double invArea = 1.0 / std::fabs(area);
+    planeThrough(edge, invArea, sx, sy, sz, tri.z);
+    planeThrough(edge, invArea, sx, sy, iw, tri.invW);
+    for(int j = 0; j < 5; ++j) {
+        const float value[3] = { v[0]->attrib[j] * iw[0], v[1]->attrib[j] * iw[1], v[2]->attrib[j] * iw[2] };
+        planeThrough(edge, invArea, sx, sy, value, tri.attrib[j]);
+    }
+
+    // Mip level from the texels the triangle covers per pixel
+    if(texture && texture->levels.size() > 1) {
+        const MipLevel &base = texture->levels[0];
+        const float du1 = (b.attrib[0] - a.attrib[0]) * base.width, dv1 = (b.attrib[1] - a.attrib[1]) * base.height;
+        const float du2 = (c.attrib[0] - a.attrib[0]) * base.width, dv2 = (c.attrib[1] - a.attrib[1]) * base.height;
+        const double ratio = std::fabs((double)du1 * dv2 - (double)du2 * dv1) * invArea;
+        if(ratio > 1.0) tri.level = std::min((int)texture->levels.size() - 1, (int)(0.5 * std::log2(ratio)));
+    }
+
+    out.push_back(tri);
+}
+
+void SoftRasterizer::finish()
+{
+    const int tileCount = tilesX * tilesY;
+    if(tileCount == 0) return;
+
+    // Tiles are handed out one at a time: their costs are far from even
+    std::atomic<int> next(0);
+    parallelFor(workerCount(), 1, [&](size_t, size_t) {
+        for(int tile = next++; tile < tileCount; tile = next++) rasterizeTile(tile);
+    });
+}
+
+void SoftRasterizer::rasterizeTile(int tile)
+{
+    const int x0 = (tile % tilesX) * kTileSize, y0 = (tile / tilesX) * kTileSize;
+    const int x1 = std::min(x0 + kTileSize, frameWidth), y1 = std::min(y0 + kTileSize, frameHeight);
+    const int bx0 = x0 / kBlockSize, by0 = y0 / kBlockSize;
+    const int bx1 = (x1 + kBlockSize - 1) / kBlockSize, by1 = (y1 + kBlockSize - 1) / kBlockSize;
+
+    for(int y = y0; y < y1; ++y) {
+        std::fill(color.begin() + (size_t)y * frameWidth + x0, color.begin() + (size_t)y * frameWidth + x1, 0xff000000u);
+        std::fill(depth.begin() + (size_t)y * frameWidth + x0, depth.begin() + (size_t)y * frameWidth + x1, 1.0f);
+    }
+    for(int by = by0; by < by1; ++by)
+        for(int bx = bx0; bx < bx1; ++bx) blockFar[by * blocksX + bx] = 1.0f;
+    float tileFar = 1.0f;
+
+    const std::vector<unsigned int> &bin = bins[tile];
+    for(size_t i = 0; i < bin.size(); ++i) {
+        const Triangle &tri = triangles[bin[i]];
+        if(tri.minZ > tileFar) continue;
+
+        const int cx0 = std::max(tri.minX, x0) / kBlockSize, cx1 = std::min(tri.maxX, x1 - 1) / kBlockSize;
+        const int cy0 = std::max(tri.minY, y0) / kBlockSize, cy1 = std::min(tri.maxY, y1 - 1) / kBlockSize;
+        bool changed = false;
+
+        for(int by = cy0; by <= cy1; ++by)
+            for(int bx = cx0; bx <= cx1; ++bx) {
+                float &far = blockFar[by * blocksX + bx];
+                if(tri.minZ > far) continue;
+
+                const int px0 = bx * kBlockSize, py0 = by * kBlockSize;
+                const int px1 = std::min(px0 + kBlockSize, x1), py1 = std::min(py0 + kBlockSize, y1);
+
+                // Outside one edge at every corner: outside in the whole block
+                bool outside = false;
+                for(int k = 0; k < 3 && !outside; ++k) {
+                    const float *e = tri.edge[k];
+                    const float x = e[0] > 0.0f ? px1 - 0.5f : px0 + 0.5f;
+                    const float y = e[1] > 0.0f ? py1 - 0.5f : py0 + 0.5f;
+                    outside = plane(e, x, y) < 0.0f;
+                }
+                if(outside || !rasterizeBlock(tri, px0, py0, px1, py1)) continue;
+
+                float farthest = 0.0f;
+                for(int y = py0; y < py1; ++y)
+                    for(int x = px0; x < px1; ++x) farthest = std::max(farthest, depth[(size_t)y * frameWidth + x]);
+                far = farthest;
+                changed = true;
+            }
+
+        if(changed) {
+            tileFar = 0.0f;
+            for(int by = by0; by < by1; ++by)
+                for(int bx = bx0; bx < bx1; ++bx) tileFar = std::max(tileFar, blockFar[by * blocksX + bx]);
+        }
+    }
+}
+
+bool SoftRasterizer::rasterizeBlock(const Triangle &tri, int x0, int y0, int x1, int y1)
+{
+    bool written = false;
+
+    for(int y = y0; y < y1; ++y) {
+        const float cy = y + 0.5f;
+        for(int x = x0; x < x1; x += 4) {
+            const size_t first = (size_t)y * frameWidth + x;
+            float z[4];
+            int mask;
+
+            // Coverage and depth of four pixels; lanes past the block are
+            // masked out, the padding of depth keeps their loads in bounds
+#ifdef SOFTRASTER_SSE2
+            const __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+            const __m128 zero = _mm_setzero_ps();
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(int k = 0; k < 3; ++k) {
+                const float *e = tri.edge[k];
+                const __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[0]), px), _mm_set1_ps(e[1] * cy + e[2]));
+                inside = _mm_and_ps(inside, tri.topLeft[k] ? _mm_cmpge_ps(value, zero) : _mm_cmpgt_ps(value, zero));
+            }
+            const __m128 depthValue = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.z[0]), px), _mm_set1_ps(tri.z[1] * cy + tri.z[2]));
+            inside = _mm_and_ps(inside, _mm_cmple_ps(depthValue, _mm_loadu_ps(&depth[first])));
+            _mm_storeu_ps(z, depthValue);
+            mask = _mm_movemask_ps(inside);
+#else
+            mask = 0;
+            for(int lane = 0; lane < 4; ++lane) {
+                const float cx = x + lane + 0.5f;
+                z[lane] = tri.z[0] * cx + (tri.z[1] * cy + tri.z[2]);
+                bool in = z[lane] <= depth[first + lane];
+                for(int k = 0; k < 3; ++k) {
+                    const float value = tri.edge[k][0] * cx + (tri.edge[k][1] * cy + tri.edge[k][2]);
+                    in = in && (tri.topLeft[k] ? value >= 0.0f : value > 0.0f);
+                }
+                if(in) mask |= 1 << lane;
+            }
+#endif
+            mask &= (1 << std::min(4, x1 - x)) - 1;
+            if(!mask) continue;
+            written = true;
+
+            for(int lane = 0; lane < 4; ++lane) {
+                if(!(mask & (1 << lane))) continue;
+                const float cx = x + lane + 0.5f;
+
+                // Perspective correct: the planes interpolate value / w and 1 / w
+                const float w = 1.0f / plane(tri.invW, cx, cy);
+                float r = plane(tri.attrib[2], cx, cy) * w * 255.0f;
+                float g = plane(tri.attrib[3], cx, cy) * w * 255.0f;
+                float b = plane(tri.attrib[4], cx, cy) * w * 255.0f;
+                if(tri.texture) {
+                    // GL_MODULATE
+                    float texel[4];
+                    tri.texture->sample(tri.level, plane(tri.attrib[0], cx, cy) * w, plane(tri.attrib[1], cx, cy) * w, texel);
+                    r *= texel[2] * (1.0f / 255.0f);
+                    g *= texel[1] * (1.0f / 255.0f);
+                    b *= texel[0] * (1.0f / 255.0f);
+                }
+
+                color[first + lane] = 0xff000000u | (toByte(r) << 16) | (toByte(g) << 8) | toByte(b);
+                depth[first + lane] = z[lane];
+            }
+        }
+    }
+    return written;
+}
+
+void SoftRasterizer::present() const
+{
+    if(color.empty()) return;
+
+    glState.pushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_TEXTURE_2D);
+    glState.enable(GL_DEPTH_TEST);
+    glRasterPos2f(-1.0f, -1.0f);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Colors first, then the depths with the color writes off
+    glDepthMask(GL_FALSE);
+    glDrawPixels(frameWidth, frameHeight, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &color[0]);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_ALWAYS);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDrawPixels(frameWidth, frameHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depth[0]);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glState.popAttrib();
+}
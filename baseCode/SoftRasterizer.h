@@ -0,0 +1,121 @@
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+#include <QtOpenGL>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Drawable.h"
+#include "Matrix4.h"
+#include "PointArrays.h"
+#include "SoftTexture.h"
+
+/*
+ * CPU implementation of the opaque pass, for machines without a usable GPU
+ * and to check the GL output against.
+ *
+ * draw() transforms and lights the vertices of a mesh, clips its triangles
+ * against the near plane and files them in the bins of the 64x64 pixel
+ * tiles they overlap. finish() then rasterizes the tiles on every core,
+ * each tile on one thread: its pixels need no lock, and its triangles are
+ * drawn in the order they were submitted.
+ *
+ * Within a tile, coverage and depth are evaluated four pixels at a time
+ * (with SSE when the target has it). The farthest depth of every 8x8 block
+ * is kept, so that a triangle behind everything already drawn there skips
+ * the block, and the tile, without visiting a pixel.
+ *
+ * Shading follows the fixed function state set up by CCanvas: one point
+ * light, evaluated per vertex, modulating a bilinear sample of the mip level
+ * that best matches the triangle's texel density.
+ */
+class SoftRasterizer
+{
+public:
+    SoftRasterizer();
+
+    void resize(int width, int height);
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+
+    void setProjection(const Matrix4 &projection);
+    // GL_LIGHT0 position, in eye space
+    void setLight(const GLfloat position[4]);
+    // Front material, RGBA
+    void setMaterial(const GLfloat ambient[4], const GLfloat diffuse[4], const GLfloat specular[4], GLfloat shininess);
+
+    // Decoded on the first request for a path; NULL if it cannot be read
+    const SoftTexture *texture(const std::string &path);
+
+    // Starts a frame: empties the bins, the tiles are cleared to black at the
+    // far plane when rasterized
+    void begin();
+    // Bins the triangles of mesh, which can go away afterwards; texture, if
+    // any, must stay until finish()
+    void draw(const Matrix4 &modelview, const TriangleMesh &mesh, const SoftTexture *texture);
+    // Rasterizes everything binned since begin()
+    void finish();
+
+    // ARGB words and window depths in [0, 1], bottom row first like glReadPixels
+    const unsigned int *pixels() const { return color.empty() ? NULL : &color[0]; }
+    const float *depths() const { return depth.empty() ? NULL : &depth[0]; }
+    size_t triangleCount() const { return triangles.size(); }
+
+    // Writes the frame, depth included, to the current GL framebuffer, so
+    // that GL can go on drawing over it
+    void present() const;
+
+    static const int kTileSize = 64;
+    static const int kBlockSize = 8;
+
+private:
+    // Screen space triangle, ready to rasterize. Every value is a plane
+    // a * x + b * y + c over the pixel centers.
+    struct Triangle {
+        float edge[3][3];       // > 0 inside, or >= 0 for top-left edges
+        bool topLeft[3];
+        float z[3];
+        float invW[3];
+        float attrib[5][3];     // u, v, r, g, b, all divided by w
+        float minZ;
+        int minX, minY, maxX, maxY;
+        const SoftTexture *texture;
+        int level;              // mip level to sample
+    };
+
+    // Clip space vertex with what is interpolated
+    struct ClipVertex {
+        float x, y, z, w;
+        float attrib[5];
+    };
+
+    void setupTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c,
+                       const SoftTexture *texture, std::vector<Triangle> &out) const;
+    void clipTriangle(const ClipVertex *v[3], const SoftTexture *texture, std::vector<Triangle> &out) const;
+    void rasterizeTile(int tile);
+    bool rasterizeBlock(const Triangle &tri, int x0, int y0, int x1, int y1);
+
+    int frameWidth, frameHeight;
+    int tilesX, tilesY;
+    int blocksX, blocksY;
+
+    Matrix4 projection;
+    GLfloat light[4];
+    GLfloat ambient[3], diffuse[3], specular[3], shininess;
+
+    std::vector<unsigned int> color;
+    std::vector<float> depth;               // padded by a few values for the last lanes
+    std::vector<float> blockFar;            // farthest depth of each block
+
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<unsigned int> > bins;
+
+    // Per draw, kept for their capacity
+    PointArrays eye, normals;
+    std::vector<ClipVertex> vertices;
+
+    std::map<std::string, SoftTexture> cache;
+};
+
+#endif // SOFTRASTERIZER_H
@@ -0,0 +1,69 @@
+#include "SoftTexture.h"
+#include "Log.h"
+#include "Vfs.h"
+
+#include <QtOpenGL>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+inline int channel(unsigned int argb, int shift)
+{
+    return (int)((argb >> shift) & 0xff);
+}
+
+}
+
+bool SoftTexture::load(const std::string &path)
+{
+    levels.clear();
+
+    QImage image;
+    std::string error;
+    if(!vfs.readImage(path, image, error) || image.width() <= 0 || image.height() <= 0) {
+        LOG_WARNING("cannot read %s: %s", path, error);
+        return false;
+    }
+    image = image.convertToFormat(QImage::Format_ARGB32);
+
+    levels.push_back(MipLevel());
+    MipLevel &base = levels.back();
+    base.width = image.width();
+    base.height = image.height();
+    base.pixels.resize((size_t)base.width * base.height * 4);
+    for(int y = 0; y < base.height; ++y)
+        memcpy(&base.pixels[(size_t)y * base.width * 4], image.constScanLine(y), (size_t)base.width * 4);
+
+    std::vector<MipLevel> smaller;
+    buildMipChain(&levels[0].pixels[0], levels[0].width, levels[0].height, smaller);
+    levels.insert(levels.end(), smaller.begin(), smaller.end());
+    return true;
+}
+
+void SoftTexture::sample(int index, float u, float v, float out[4]) const
+{
+    const MipLevel &level = levels[index];
+    const float x = (u - std::floor(u)) * level.width - 0.5f;
+    const float y = (v - std::floor(v)) * level.height - 0.5f;
+    const float fx = std::floor(x), fy = std::floor(y);
+    const float tx = x - fx, ty = y - fy;
+
+    int x0 = (int)fx, y0 = (int)fy;
+    if(x0 < 0) x0 += level.width;
+    if(y0 < 0) y0 += level.height;
+    x0 = std::min(x0, level.width - 1);
+    y0 = std::min(y0, level.height - 1);
+    const int x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+    const int y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+    const unsigned int *texels = (const unsigned int*)&level.pixels[0];
+    const unsigned int t00 = texels[y0 * level.width + x0], t10 = texels[y0 * level.width + x1];
+    const unsigned int t01 = texels[y1 * level.width + x0], t11 = texels[y1 * level.width + x1];
+    for(int c = 0; c < 4; ++c) {
+        const int shift = 8 * c;
+        const float top = channel(t00, shift) + (channel(t10, shift) - channel(t00, shift)) * tx;
+        const float bottom = channel(t01, shift) + (channel(t11, shift) - channel(t01, shift)) * tx;
+        out[c] = top + (bottom - top) * ty;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef SOFTTEXTURE_H
+#define SOFTTEXTURE_H
+
+#include <string>
+#include <vector>
+
+#include "MipChain.h"
+
+// An image sampled on the CPU (software rasterizer, ray tracer): ARGB words,
+// top row first like the GL textures, with the whole mip chain
+struct SoftTexture
+{
+    std::vector<MipLevel> levels;   // largest first, empty if unreadable
+
+    // Decodes the image and builds its mip chain; false, leaving no level,
+    // if it cannot be read
+    bool load(const std::string &path);
+
+    // Bilinear sample of a level, wrapping like GL_REPEAT. Channels in
+    // [0, 255] in the byte order of the words: blue, green, red, alpha.
+    void sample(int level, float u, float v, float out[4]) const;
+};
+
+#endif // SOFTTEXTURE_H
@@ -2,6 +2,8 @@
 #include "Base.h"
 #include <math.h>
 
+#include "Profiler.h"
+
 Sphere::Sphere(const int &lats, const int &longs) : lats(lats), longs(longs)
 {
     build();
@@ -23,7 +25,7 @@ void Sphere::buildSegment(const int &index, const float &phiStep)
     PointArray &segment = strips.back();
     TextureArray &txt = textures.back();
 
-    set(Point3d(0, 1, 0), Point2d(0.0, 1.0f * index / longs), segment, txt);
+    set(Point3f(0, 1, 0), Point2f(0.0f, 1.0f * index / longs), segment, txt);
 
     float step = PI / longs;
     for(int i = 1; i < longs; ++i) {
@@ -31,22 +33,23 @@ void Sphere::buildSegment(const int &index, const float &phiStep)
 
         for(int j = 0; j < 2; ++j) {
             const float phi = phis[j];
-            const Point3d p(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
-            set(p, Point2d(1.0f * (lats - index - j) / lats, 1.0f * (longs - i) / longs), segment, txt);
+            const Point3f p(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            set(p, Point2f(1.0f * (lats - index - j) / lats, 1.0f * (longs - i) / longs), segment, txt);
         }
     }
 
-    set(Point3d(0, -1, 0), Point2d(1.0f * index / lats, 1.0), segment, txt);
+    set(Point3f(0, -1, 0), Point2f(1.0f * index / lats, 1.0f), segment, txt);
 }
 
-void Sphere::set(const Point3d &p, const Point2d &t, PointArray &segment, TextureArray &txt) const
+void Sphere::set(const Point3f &p, const Point2f &t, PointArray &segment, TextureArray &txt) const
 {
     segment.push_back(p);
-    assert(t.x() >= 0.0 && t.x() <= 1.0);
+    assert(t.x() >= 0.0f && t.x() <= 1.0f);
 
     // assert(t.y() >= 0.0 && t.y() <= 1.0);
 
-    txt.push_back(t);
+    // Textures are uploaded top row first (see TexturePixels)
+    txt.push_back(Point2f(t.x(), 1.0f - t.y()));
 }
 
 void Sphere::draw()
@@ -59,13 +62,55 @@ void Sphere::draw()
 
         glBegin(GL_TRIANGLE_STRIP);
         for(unsigned int j = 0; j < segment.size(); ++j) {
-            const Point3d &p = segment[j];
-            const Point2d &t = txt[j];
+            const Point3f &p = segment[j];
+            const Point2f &t = txt[j];
 
-            glNormal3d(p.x(), p.y(), p.z());
-            glTexCoord2d(t.x(), t.y());
-            glVertex3d(p.x(), p.y(), p.z());
+            glNormal3f(p.x(), p.y(), p.z());
+            glTexCoord2f(t.x(), t.y());
+            glVertex3f(p.x(), p.y(), p.z());
         }
         glEnd();
+        profiler.countDraw(segment.size() - 2);
+    }
+}
+
+void Sphere::bounds(GLfloat center[3], GLfloat &radius) const
+{
+    center[0] = center[1] = center[2] = 0.0f;
+    radius = 1.0f;
+}
+
+bool Sphere::triangles(int, TriangleMesh &mesh)
+{
+    if(listIndices.empty()) {
+        for(unsigned int i = 0; i < strips.size(); ++i) {
+            const PointArray &segment = strips[i];
+            const TextureArray &txt = textures[i];
+            const GLuint first = (GLuint)(listPositions.size() / 3);
+
+            for(unsigned int j = 0; j < segment.size(); ++j) {
+                listPositions.push_back(segment[j].x());
+                listPositions.push_back(segment[j].y());
+                listPositions.push_back(segment[j].z());
+                listUvs.push_back(txt[j].x());
+                listUvs.push_back(txt[j].y());
+            }
+            // Every other triangle of a strip is flipped to keep the winding
+            for(unsigned int j = 2; j < segment.size(); ++j) {
+                const bool odd = (j % 2) == 1;
+                listIndices.push_back(first + j - (odd ? 1 : 2));
+                listIndices.push_back(first + j - (odd ? 2 : 1));
+                listIndices.push_back(first + j);
+            }
+        }
+        if(listIndices.empty()) return false;
     }
+
+    mesh.positions = &listPositions[0];
+    mesh.normals = &listPositions[0];
+    mesh.uvs = &listUvs[0];
+    mesh.indices = &listIndices[0];
+    mesh.vertexCount = listPositions.size() / 3;
+    mesh.indexCount = listIndices.size();
+    return true;
 }
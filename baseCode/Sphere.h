@@ -4,24 +4,36 @@
 #include <QtOpenGL>
 #include "Point3.h"
 #include "Point2.h"
+#include "Drawable.h"
 
-class Sphere
+class Sphere : public Drawable
 {
 public:
     Sphere(const int &lats = 20, const int &longs = 10);
     void draw();
 
+    // Unit sphere around the origin
+    void bounds(GLfloat center[3], GLfloat &radius) const;
+
+    // The strips as a triangle list, built on the first call
+    bool triangles(int lod, TriangleMesh &mesh);
+
 private:
-    typedef std::vector<Point3d> PointArray;
-    typedef std::vector<Point2d> TextureArray;
+    typedef std::vector<Point3f> PointArray;
+    typedef std::vector<Point2f> TextureArray;
 
     int lats, longs;
     std::vector<PointArray> strips;
     std::vector<TextureArray> textures;
 
+    // Unit sphere: the positions are the normals
+    std::vector<GLfloat> listPositions;
+    std::vector<GLfloat> listUvs;
+    std::vector<GLuint> listIndices;
+
     void build();
     void buildSegment(const int &index, const float &phiStep);
-    void set(const Point3d &p, const Point2d &t, PointArray &segment, TextureArray &txt) const;
+    void set(const Point3f &p, const Point2f &t, PointArray &segment, TextureArray &txt) const;
 };
 
 #endif // SPHERE_H
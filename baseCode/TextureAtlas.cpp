@@ -0,0 +1,192 @@
+#include "TextureAtlas.h"
+#include "MipChain.h"
+#include "Parallel.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "texture.hpp"
+#include "Vfs.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+int roundUp(int value, int multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+struct TallerFirst {
+    TallerFirst(const std::vector<QImage> &images) : images(images) {}
+    bool operator () (size_t a, size_t b) const { return images[a].height() > images[b].height(); }
+    const std::vector<QImage> &images;
+};
+
+}
+
+TextureAtlas::TextureAtlas(int size) : size(size), name(0), residentBytes(0)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    // The GL context may already be gone, the texture goes with it
+}
+
+const AtlasRegion *TextureAtlas::add(const std::string &path)
+{
+    AtlasRegion region;
+    region.atlas = this;
+    region.offset[0] = region.offset[1] = 0.0f;
+    region.scale[0] = region.scale[1] = 1.0f;
+    region.path = path;
+
+    paths.push_back(path);
+    regions.push_back(region);
+    return &regions.back();
+}
+
+bool TextureAtlas::build()
+{
+    const size_t count = paths.size();
+    std::vector<QImage> images(count);
+
+    parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            QImage img;
+            std::string error;
+            if(!vfs.readImage(paths[i], img, error)) continue;
+
+            if(img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32)
+                img = img.convertToFormat(QImage::Format_ARGB32);
+            while(img.width() > size / 2 || img.height() > size / 2)
+                img = img.scaled(std::max(1, img.width() / 2), std::max(1, img.height() / 2),
+                                 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            images[i] = img;
+        }
+    });
+
+    for(size_t i = 0; i < count; ++i) {
+        if(images[i].isNull()) {
+            LOG_WARNING("TextureAtlas: failed to read %s", paths[i]);
+            return false;
+        }
+    }
+
+    // Shelves, tallest images first. Cells are multiples of 2^kMaxLevel, so
+    // every image starts on a texel of each kept mip level.
+    const int align = 1 << kMaxLevel;
+    std::vector<size_t> order(count);
+    for(size_t i = 0; i < count; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), TallerFirst(images));
+
+    std::vector<int> cellX(count), cellY(count);
+    int x = 0, shelfY = 0, shelfHeight = 0;
+    for(size_t k = 0; k < count; ++k) {
+        const size_t i = order[k];
+        const int width = roundUp(images[i].width() + 2 * kGutter, align);
+        const int height = roundUp(images[i].height() + 2 * kGutter, align);
+
+        if(x + width > size) {
+            x = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        cellX[i] = x;
+        cellY[i] = shelfY;
+        x += width;
+        shelfHeight = std::max(shelfHeight, height);
+    }
+
+    const int height = std::max(align, shelfY + shelfHeight);
+    if(height > size) {
+        LOG_WARNING("TextureAtlas: %u images do not fit in %dx%d", (unsigned)count, size, size);
+        return false;
+    }
+
+    // Same layout as the loaded textures: 32 bit ARGB words, top row first
+    std::vector<unsigned char> pixels(4 * (size_t)size * height, 0);
+    for(size_t i = 0; i < count; ++i) {
+        const QImage &img = images[i];
+        const int w = img.width();
+        const int h = img.height();
+        const int rows = h + 2 * kGutter;
+
+        parallelFor(rows, 64, [&](size_t begin, size_t end) {
+            for(size_t r = begin; r < end; ++r) {
+                // The gutter wraps around, like GL_REPEAT
+                const int sy = ((int)r - kGutter + h * kGutter) % h;
+                const unsigned int *src = (const unsigned int*)img.constScanLine(sy);
+                unsigned int *dst = (unsigned int*)&pixels[4 * ((size_t)(cellY[i] + r) * size + cellX[i])];
+                for(int c = 0; c < w + 2 * kGutter; ++c) dst[c] = src[(c - kGutter + w * kGutter) % w];
+            }
+        });
+
+        AtlasRegion &region = regions[i];
+        region.offset[0] = (GLfloat)(cellX[i] + kGutter) / size;
+        region.offset[1] = (GLfloat)(cellY[i] + kGutter) / height;
+        region.scale[0] = (GLfloat)w / size;
+        region.scale[1] = (GLfloat)h / height;
+    }
+    images.clear();
+
+    glGenTextures(1, &name);
+    glState.bindTexture(GL_TEXTURE_2D, name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Past kMaxLevel the gutters are less than a texel wide and the images
+    // would bleed into each other
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, kMaxLevel);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    int w = size, h = height;
+    residentBytes = 0;
+    for(int level = 0; level <= kMaxLevel; ++level) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &pixels[0]);
+        residentBytes += 4 * (size_t)w * h;
+        if(level == kMaxLevel) break;
+
+        std::vector<unsigned char> next(4 * (size_t)(w / 2) * (h / 2));
+        downsampleBox(&pixels[0], w, h, &next[0]);
+        pixels.swap(next);
+        w /= 2;
+        h /= 2;
+    }
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+
+    LOG_INFO("TextureAtlas: %u images in %dx%d", (unsigned)count, size, height);
+    return true;
+}
+
+void TextureAtlas::bind() const
+{
+    glState.activeTexture(GL_TEXTURE0);
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(GL_TEXTURE_2D, name);
+}
+
+void TextureAtlas::unbind() const
+{
+    glState.disable(GL_TEXTURE_2D);
+}
+
+void TextureAtlas::applyRegion(const AtlasRegion &region)
+{
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(region.offset[0], region.offset[1], 0.0f);
+    glScalef(region.scale[0], region.scale[1], 1.0f);
+    glMatrixMode(GL_MODELVIEW);
+    profiler.countStateChange();
+}
+
+void TextureAtlas::resetRegion()
+{
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+}
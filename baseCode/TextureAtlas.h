@@ -0,0 +1,74 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <QtOpenGL>
+#include <deque>
+#include <string>
+
+class TextureAtlas;
+
+// Where one image ended up in an atlas: texture coordinates of the image,
+// in [0, 1], map to offset + scale * uv in the atlas
+struct AtlasRegion {
+    const TextureAtlas *atlas;
+    GLfloat offset[2];
+    GLfloat scale[2];
+    std::string path;           // of the image
+};
+
+/*
+ * Several images packed in one texture.
+ *
+ * Objects textured from the same atlas are drawn one after the other
+ * without binding anything: only the texture matrix changes, to remap
+ * their coordinates to their rectangle (see DrawList). Images are packed
+ * on shelves, each surrounded by a gutter that repeats the image like
+ * GL_REPEAT would, so linear filtering and the first mip levels never read
+ * a neighbour. Coordinates outside [0, 1] do not wrap: only images drawn
+ * with coordinates in that range belong in an atlas.
+ *
+ * The atlas is built once and is not managed by the texture budget.
+ */
+class TextureAtlas
+{
+public:
+    // size is the width of the atlas; images wider or taller than half of
+    // it are scaled down by powers of two
+    explicit TextureAtlas(int size = 4096);
+    ~TextureAtlas();
+
+    // Queues an image; the region is filled in by build() and stays valid
+    // as long as the atlas
+    const AtlasRegion *add(const std::string &path);
+
+    // Decodes and packs the queued images, and uploads the atlas. Needs a
+    // current GL context. Returns false, leaving no texture, if an image
+    // cannot be read or they do not all fit.
+    bool build();
+
+    bool isBuilt() const { return name != 0; }
+
+    void bind() const;
+    void unbind() const;
+
+    // Loads the texture matrix mapping the image coordinates to region;
+    // the matrix mode is left at GL_MODELVIEW
+    static void applyRegion(const AtlasRegion &region);
+    static void resetRegion();
+
+    size_t bytes() const { return residentBytes; }
+
+    // Gutter around each image, and the mip levels it keeps clean
+    static const int kGutter = 16;
+    static const int kMaxLevel = 4;
+
+private:
+    int size;
+    GLuint name;
+    size_t residentBytes;
+
+    std::deque<std::string> paths;
+    std::deque<AtlasRegion> regions;
+};
+
+#endif // TEXTUREATLAS_H
@@ -0,0 +1,206 @@
+#include "TextureManager.h"
+#include "Log.h"
+#include "Vfs.h"
+
+#include <algorithm>
+
+TextureManager textures;
+
+struct TextureEntry {
+    explicit TextureEntry(const std::string &path)
+        : texture(path), hash(0), references(0), lastUsed(0), failed(false) {}
+
+    Texture texture;
+    unsigned long long hash;    // of the file contents, 0 if unreadable
+    std::vector<std::string> paths;
+    int references;
+    unsigned long lastUsed;     // frame of the last bind
+    bool failed;                // the file did not decode, no more loads
+};
+
+namespace {
+
+// FNV-1a of the whole file
+unsigned long long hashFile(const std::string &path)
+{
+    VfsFile file;
+    if(!vfs.open(path, file) || file.size() == 0) return 0;
+
+    const unsigned char *data = file.data();
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i = 0; i < file.size(); ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+TextureHandle::TextureHandle(TextureEntry *entry) : entry(entry)
+{
+    if(entry) textures.addReference(entry);
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other) : entry(other.entry)
+{
+    if(entry) textures.addReference(entry);
+}
+
+TextureHandle &TextureHandle::operator = (const TextureHandle &other)
+{
+    if(other.entry) textures.addReference(other.entry);
+    if(entry) textures.removeReference(entry);
+    entry = other.entry;
+    return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+    if(entry) textures.removeReference(entry);
+}
+
+void TextureHandle::bind() const
+{
+    if(!entry) return;
+    textures.touch(entry);
+    if(entry->texture.isLoaded()) entry->texture.bind();
+    else textures.streamer.bindPlaceholder();
+}
+
+void TextureHandle::unbind() const
+{
+    if(entry) entry->texture.unbind();
+}
+
+const std::string &TextureHandle::path() const
+{
+    static const std::string none;
+    return entry ? entry->texture.getPath() : none;
+}
+
+TextureManager::TextureManager() : used(0), limit((size_t)256 << 20), uploadLimit((size_t)4 << 20), frame(1)
+{
+}
+
+TextureManager::~TextureManager()
+{
+    // The GL context is gone by now, only the bookkeeping is freed
+    for(size_t i = 0; i < entries.size(); ++i) delete entries[i];
+}
+
+TextureHandle TextureManager::acquire(const std::string &path)
+{
+    std::map<std::string, TextureEntry*>::iterator known = byPath.find(path);
+    if(known != byPath.end()) return TextureHandle(known->second);
+
+    // Another path to the same pixels shares the texture
+    const unsigned long long hash = hashFile(path);
+    if(hash != 0) {
+        std::map<unsigned long long, TextureEntry*>::iterator same = byContent.find(hash);
+        if(same != byContent.end()) {
+            same->second->paths.push_back(path);
+            byPath[path] = same->second;
+            return TextureHandle(same->second);
+        }
+    }
+
+    if(!streamer.isInitialized()) streamer.init();
+
+    TextureEntry *entry = new TextureEntry(path);
+    entry->hash = hash;
+    entry->paths.push_back(path);
+    entry->lastUsed = frame;
+    entries.push_back(entry);
+    byPath[path] = entry;
+    if(hash != 0) byContent[hash] = entry;
+
+    load(entry, 0);
+    return TextureHandle(entry);
+}
+
+void TextureManager::load(TextureEntry *entry, int skipLevels)
+{
+    streamer.request(&entry->texture, skipLevels);
+}
+
+void TextureManager::unload(TextureEntry *entry)
+{
+    streamer.cancel(&entry->texture);
+    used -= entry->texture.bytes();
+    entry->texture.release();
+}
+
+void TextureManager::touch(TextureEntry *entry)
+{
+    entry->lastUsed = frame;
+    if(entry->failed || entry->texture.isLoaded() || streamer.isPending(&entry->texture)) return;
+
+    // Back after an eviction: whole when it fits, otherwise without as many
+    // mip levels as needed, each one divides the size by four
+    const size_t full = entry->texture.fullBytes();
+    int skip = 0;
+    while(skip < 8 && used + (full >> (2 * skip)) > limit) ++skip;
+
+    load(entry, skip);
+    LOG_INFO("Texture reloading without %d levels: %s", skip, entry->texture.getPath());
+}
+
+void TextureManager::addReference(TextureEntry *entry)
+{
+    ++entry->references;
+}
+
+void TextureManager::removeReference(TextureEntry *entry)
+{
+    if(--entry->references > 0) return;
+
+    unload(entry);
+
+    for(size_t i = 0; i < entry->paths.size(); ++i) byPath.erase(entry->paths[i]);
+    if(entry->hash != 0) byContent.erase(entry->hash);
+    entries.erase(std::find(entries.begin(), entries.end(), entry));
+    delete entry;
+}
+
+void TextureManager::beginFrame()
+{
+    failures.clear();
+    streamer.update(uploadLimit, failures);
+    for(size_t i = 0; i < failures.size(); ++i) {
+        TextureEntry *entry = byPath[failures[i]->getPath()];
+        entry->failed = true;
+        LOG_WARNING("Texture failed to load, not retrying: %s", entry->texture.getPath());
+    }
+
+    used = 0;
+    for(size_t i = 0; i < entries.size(); ++i) used += entries[i]->texture.bytes();
+
+    // Anything bound during the frame that just ended is visible
+    const unsigned long visible = frame;
+    ++frame;
+
+    while(used > limit) {
+        TextureEntry *victim = NULL;
+        for(size_t i = 0; i < entries.size(); ++i) {
+            TextureEntry *entry = entries[i];
+            if(!entry->texture.isLoaded() || entry->lastUsed >= visible) continue;
+            if(victim == NULL || entry->lastUsed < victim->lastUsed) victim = entry;
+        }
+        if(victim == NULL) break;   // everything resident is on screen
+
+        unload(victim);
+        LOG_INFO("Texture evicted: %s", victim->texture.getPath());
+    }
+
+    // Give one reduced texture its full resolution back when it fits
+    for(size_t i = 0; i < entries.size(); ++i) {
+        TextureEntry *entry = entries[i];
+        if(entry->failed || !entry->texture.isLoaded() || entry->texture.levelsSkipped() == 0) continue;
+        if(streamer.isPending(&entry->texture)) continue;
+        if(used - entry->texture.bytes() + entry->texture.fullBytes() > limit) continue;
+
+        load(entry, 0);
+        break;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <QtOpenGL>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "texture.hpp"
+#include "TextureStreamer.h"
+
+struct TextureEntry;
+
+// Shared reference to a managed texture. Copies share the same GL texture,
+// which is freed when the last handle goes away. Handles are GL thread only.
+class TextureHandle
+{
+public:
+    TextureHandle() : entry(NULL) {}
+    TextureHandle(const TextureHandle &other);
+    TextureHandle &operator = (const TextureHandle &other);
+    ~TextureHandle();
+
+    bool isNull() const { return entry == NULL; }
+    // File the texture was acquired from, empty for a null handle
+    const std::string &path() const;
+
+    // Marks the texture as used this frame, reloading it if it was evicted.
+    // Binds a placeholder while the texture is still loading.
+    void bind() const;
+    void unbind() const;
+
+private:
+    friend class TextureManager;
+    explicit TextureHandle(TextureEntry *entry);
+
+    TextureEntry *entry;
+};
+
+/*
+ * Owner of every texture loaded from a file.
+ *
+ * The same file, or another file with the same contents, is only loaded
+ * once, in the background (see TextureStreamer). The GPU memory of every
+ * texture is tracked against a budget: when over it, textures that were
+ * not bound during the last frame are freed, least recently used first.
+ * An evicted texture comes back on its next bind, without as many of its
+ * largest mip levels as needed to fit, and gets its full resolution back
+ * once there is room for it again. A file that cannot be decoded is not tried
+ * again: its texture keeps what it had, or the placeholder.
+ */
+class TextureManager
+{
+public:
+    TextureManager();
+    ~TextureManager();
+
+    // Needs a current GL context
+    TextureHandle acquire(const std::string &path);
+
+    // Uploads what finished decoding, and applies the budget to what the
+    // previous frame left resident
+    void beginFrame();
+
+    // Stops background loading, before what it reads from goes away (Vfs)
+    void shutdown() { streamer.shutdown(); }
+
+    void setBudget(size_t bytes) { limit = bytes; }
+    void setUploadBudget(size_t bytesPerFrame) { uploadLimit = bytesPerFrame; }
+    size_t budget() const { return limit; }
+    size_t residentBytes() const { return used; }
+    size_t textureCount() const { return entries.size(); }
+
+private:
+    friend class TextureHandle;
+
+    void touch(TextureEntry *entry);
+    void addReference(TextureEntry *entry);
+    void removeReference(TextureEntry *entry);
+    void load(TextureEntry *entry, int skipLevels);
+    void unload(TextureEntry *entry);
+
+    std::map<std::string, TextureEntry*> byPath;
+    std::map<unsigned long long, TextureEntry*> byContent;
+    std::vector<TextureEntry*> entries;
+    std::vector<const Texture*> failures;
+
+    TextureStreamer streamer;
+
+    size_t used;
+    size_t limit;
+    size_t uploadLimit;
+    unsigned long frame;
+};
+
+extern TextureManager textures;
+
+#endif // TEXTUREMANAGER_H
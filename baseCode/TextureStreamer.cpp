@@ -0,0 +1,197 @@
+#include "TextureStreamer.h"
+#include "GLUtils.h"
+#include "GLState.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+TextureStreamer::TextureStreamer() :
+    initialized(false),
+    compressedTextures(false),
+    pixelBuffers(false),
+    nextBuffer(0),
+    placeholder(0),
+    nextGeneration(1),
+    running(false)
+{
+    for(int i = 0; i < kPixelBuffers; ++i) buffers[i] = 0;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    shutdown();
+
+    for(size_t i = 0; i < todo.size(); ++i) delete todo[i];
+    for(size_t i = 0; i < done.size(); ++i) delete done[i];
+    for(size_t i = 0; i < uploads.size(); ++i) delete uploads[i];
+}
+
+void TextureStreamer::init()
+{
+    compressedTextures = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    pixelBuffers = hasGLVersion(2, 1) || hasGLExtension("GL_ARB_pixel_buffer_object");
+    if(pixelBuffers) glGenBuffers(kPixelBuffers, buffers);
+
+    const GLubyte grey[4] = { 128, 128, 128, 255 };
+    glGenTextures(1, &placeholder);
+    glState.bindTexture(GL_TEXTURE_2D, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+    // Decoding is mostly waiting on zlib and libjpeg, the mip chains are
+    // already parallel: two workers keep a couple of files in flight
+    running = true;
+    const unsigned int count = std::min(2u, workerCount());
+    for(unsigned int i = 0; i < count; ++i) workers.push_back(std::thread(&TextureStreamer::workerLoop, this));
+
+    initialized = true;
+}
+
+void TextureStreamer::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i) workers[i].join();
+    workers.clear();
+}
+
+void TextureStreamer::request(Texture *texture, int skipLevels)
+{
+    Job *job = new Job;
+    job->texture = texture;
+    job->path = texture->getPath();
+    job->skipLevels = skipLevels;
+    job->generation = nextGeneration++;
+    job->decoded = false;
+    job->nextLevel = -1;
+    generations[texture] = job->generation;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        todo.push_back(job);
+    }
+    wake.notify_one();
+}
+
+void TextureStreamer::cancel(Texture *texture)
+{
+    // Jobs still in the queues are dropped when they come out of them
+    generations.erase(texture);
+}
+
+void TextureStreamer::workerLoop()
+{
+    for(;;) {
+        Job *job = NULL;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return !running || !todo.empty(); });
+            if(!running) return;
+            job = todo.front();
+            todo.pop_front();
+        }
+
+        job->decoded = Texture::decode(job->path, job->skipLevels, compressedTextures, job->pixels);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(job);
+    }
+}
+
+void TextureStreamer::update(size_t budget, std::vector<const Texture*> &failed)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while(!done.empty()) {
+            Job *job = done.front();
+            done.pop_front();
+
+            std::map<const Texture*, unsigned long>::iterator current = generations.find(job->texture);
+            if(current == generations.end() || current->second != job->generation) {
+                delete job;
+                continue;
+            }
+            if(!job->decoded) {
+                failed.push_back(job->texture);
+                generations.erase(current);
+                delete job;
+                continue;
+            }
+
+            job->texture->allocate(job->pixels);
+            job->nextLevel = (int)job->pixels.levels.size() - 1;
+            uploads.push_back(job);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    size_t spent = 0;
+    while(!uploads.empty()) {
+        Job *job = uploads.front();
+
+        std::map<const Texture*, unsigned long>::iterator current = generations.find(job->texture);
+        if(current == generations.end() || current->second != job->generation) {
+            uploads.pop_front();
+            delete job;
+            continue;
+        }
+
+        const size_t size = job->pixels.levels[job->nextLevel].size;
+        if(spent > 0 && spent + size > budget) break;
+
+        uploadLevel(job);
+        spent += size;
+
+        if(--job->nextLevel < 0) {
+            generations.erase(current);
+            uploads.pop_front();
+            delete job;
+        }
+    }
+
+    if(pixelBuffers) glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::uploadLevel(Job *job)
+{
+    TexturePixels::Level &level = job->pixels.levels[job->nextLevel];
+    const size_t size = level.size;
+
+    if(!pixelBuffers) {
+        job->texture->uploadLevel(job->pixels, job->nextLevel, level.data);
+    } else {
+        // Orphaned, then refilled: the driver keeps the previous contents
+        // for transfers still in flight and the copy below never waits
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[nextBuffer]);
+        nextBuffer = (nextBuffer + 1) % kPixelBuffers;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+        void *mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if(mapped) {
+            memcpy(mapped, level.data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            job->texture->uploadLevel(job->pixels, job->nextLevel, (const void*)0);
+        } else {
+            glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            job->texture->uploadLevel(job->pixels, job->nextLevel, level.data);
+        }
+    }
+
+    // Nothing reads the level again
+    std::vector<unsigned char>().swap(level.storage);
+    level.data = NULL;
+    if(job->nextLevel == 0) job->pixels.image = QImage();
+}
+
+void TextureStreamer::bindPlaceholder()
+{
+    glState.activeTexture(GL_TEXTURE0);
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(GL_TEXTURE_2D, placeholder);
+}
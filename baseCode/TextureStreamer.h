@@ -0,0 +1,90 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <QtOpenGL>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "texture.hpp"
+
+/*
+ * Background texture loading.
+ *
+ * Worker threads decode the files and build the mip chains. The GL thread
+ * then uploads the levels, smallest first, through a ring of pixel buffer
+ * objects, never more than a byte budget per frame (a single level larger
+ * than the budget goes alone). Since the base level follows the uploads, a
+ * texture is drawn blurry at first and sharpens over a few frames; until
+ * its first level is in, the placeholder is bound instead. A texture that
+ * is reloaded keeps drawing its current levels until the new ones are all
+ * in (see Texture::allocate).
+ */
+class TextureStreamer
+{
+public:
+    TextureStreamer();
+    ~TextureStreamer();
+
+    // Needs a current GL context
+    void init();
+    bool isInitialized() const { return initialized; }
+    // Stops and joins the workers; decodes still queued are dropped
+    void shutdown();
+
+    // Decodes the texture file in the background, dropping skipLevels
+    // levels. A new request replaces the previous one for the same texture.
+    void request(Texture *texture, int skipLevels);
+    // Forgets about the texture, in whatever state its loading is
+    void cancel(Texture *texture);
+    bool isPending(const Texture *texture) const { return generations.count(texture) != 0; }
+
+    // Uploads decoded levels, at most budget bytes (see above). Appends to
+    // failed the textures whose file could not be decoded.
+    void update(size_t budget, std::vector<const Texture*> &failed);
+
+    // 1x1 grey texture, bound in place of textures still loading
+    void bindPlaceholder();
+
+private:
+    struct Job {
+        Texture *texture;           // only used as a key by the workers
+        std::string path;
+        int skipLevels;
+        unsigned long generation;
+        bool decoded;
+        TexturePixels pixels;
+        int nextLevel;              // to upload, counting down
+    };
+
+    void workerLoop();
+    void uploadLevel(Job *job);
+
+    bool initialized;
+    bool compressedTextures;
+    bool pixelBuffers;
+
+    static const int kPixelBuffers = 4;
+    GLuint buffers[kPixelBuffers];
+    int nextBuffer;
+    GLuint placeholder;
+
+    // GL thread only
+    std::map<const Texture*, unsigned long> generations;
+    unsigned long nextGeneration;
+    std::deque<Job*> uploads;
+
+    // Shared with the workers
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job*> todo;
+    std::deque<Job*> done;
+    bool running;
+    std::vector<std::thread> workers;
+};
+
+#endif // TEXTURESTREAMER_H
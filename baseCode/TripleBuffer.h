@@ -0,0 +1,54 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/*
+ * Lock-free handoff of the latest value from one producer thread to one
+ * consumer thread.
+ *
+ * The producer fills back() and publish()es it; the consumer calls update()
+ * to grab the latest published slot, then reads front(). Each side owns one
+ * slot, the third one sits in between and is swapped atomically, so neither
+ * side ever waits for the other. Values the consumer did not pick up in time
+ * are overwritten by newer ones.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : writeIndex(0), readIndex(2), middle(1) {}
+
+    // Producer side
+    T &back() { return values[writeIndex]; }
+    void publish()
+    {
+        const int previous = middle.exchange(writeIndex | kFresh, std::memory_order_acq_rel);
+        writeIndex = previous & kIndexMask;
+    }
+
+    // Consumer side; false if nothing was published since the last update
+    bool update()
+    {
+        if(!(middle.load(std::memory_order_acquire) & kFresh)) return false;
+        const int previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & kIndexMask;
+        return true;
+    }
+    T &front() { return values[readIndex]; }
+    const T &front() const { return values[readIndex]; }
+
+private:
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator = (const TripleBuffer &);
+
+    static const int kIndexMask = 3;
+    static const int kFresh = 4;
+
+    T values[3];
+    int writeIndex;             // producer only
+    int readIndex;              // consumer only
+    std::atomic<int> middle;    // index of the slot in between, plus the fresh bit
+};
+
+#endif // TRIPLEBUFFER_H
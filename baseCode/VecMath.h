@@ -0,0 +1,141 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VECMATH_SSE 1
+#endif
+
+/*
+ * Single precision vectors for the camera and transform code, 16 byte
+ * aligned so a whole vector is one SSE register. Vec3 carries an unused
+ * fourth lane, kept at 0. Without SSE the same operations are done one
+ * lane at a time.
+ */
+struct alignas(16) Vec3
+{
+    float x, y, z;
+    float pad;
+
+    constexpr Vec3() : x(0.0f), y(0.0f), z(0.0f), pad(0.0f) {}
+    constexpr Vec3(float x, float y, float z) : x(x), y(y), z(z), pad(0.0f) {}
+};
+
+struct alignas(16) Vec4
+{
+    float x, y, z, w;
+
+    constexpr Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+    constexpr Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    constexpr Vec4(const Vec3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+    Vec3 xyz() const { return Vec3(x, y, z); }
+};
+
+// Unit quaternion for rotations, w the scalar part
+struct alignas(16) Quat
+{
+    float x, y, z, w;
+
+    constexpr Quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+    constexpr Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+    // Same convention as glRotate: degrees, counterclockwise around the axis.
+    // A zero axis gives the identity.
+    static Quat fromAxisAngle(float degrees, const Vec3 &axis);
+};
+
+#ifdef VECMATH_SSE
+
+inline __m128 load(const Vec3 &v) { return _mm_load_ps(&v.x); }
+inline __m128 load(const Vec4 &v) { return _mm_load_ps(&v.x); }
+inline Vec3 toVec3(__m128 r) { Vec3 v; _mm_store_ps(&v.x, r); v.pad = 0.0f; return v; }
+inline Vec4 toVec4(__m128 r) { Vec4 v; _mm_store_ps(&v.x, r); return v; }
+
+// Sum of the four lanes, in every lane
+inline __m128 horizontalSum(__m128 r)
+{
+    r = _mm_add_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+inline Vec3 operator + (const Vec3 &a, const Vec3 &b) { return toVec3(_mm_add_ps(load(a), load(b))); }
+inline Vec3 operator - (const Vec3 &a, const Vec3 &b) { return toVec3(_mm_sub_ps(load(a), load(b))); }
+inline Vec3 operator * (const Vec3 &a, float s) { return toVec3(_mm_mul_ps(load(a), _mm_set1_ps(s))); }
+inline Vec4 operator + (const Vec4 &a, const Vec4 &b) { return toVec4(_mm_add_ps(load(a), load(b))); }
+inline Vec4 operator - (const Vec4 &a, const Vec4 &b) { return toVec4(_mm_sub_ps(load(a), load(b))); }
+inline Vec4 operator * (const Vec4 &a, float s) { return toVec4(_mm_mul_ps(load(a), _mm_set1_ps(s))); }
+
+// The pad lanes are 0 and drop out of the sums
+inline float dot(const Vec3 &a, const Vec3 &b) { return _mm_cvtss_f32(horizontalSum(_mm_mul_ps(load(a), load(b)))); }
+inline float dot(const Vec4 &a, const Vec4 &b) { return _mm_cvtss_f32(horizontalSum(_mm_mul_ps(load(a), load(b)))); }
+
+inline Vec3 cross(const Vec3 &a, const Vec3 &b)
+{
+    // a.yzx * b.zxy - a.zxy * b.yzx
+    const __m128 ra = load(a), rb = load(b);
+    const __m128 aYZX = _mm_shuffle_ps(ra, ra, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 bYZX = _mm_shuffle_ps(rb, rb, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 r = _mm_sub_ps(_mm_mul_ps(ra, bYZX), _mm_mul_ps(aYZX, rb));
+    return toVec3(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
+#else
+
+inline Vec3 operator + (const Vec3 &a, const Vec3 &b) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator - (const Vec3 &a, const Vec3 &b) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator * (const Vec3 &a, float s) { return Vec3(a.x * s, a.y * s, a.z * s); }
+inline Vec4 operator + (const Vec4 &a, const Vec4 &b) { return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+inline Vec4 operator - (const Vec4 &a, const Vec4 &b) { return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+inline Vec4 operator * (const Vec4 &a, float s) { return Vec4(a.x * s, a.y * s, a.z * s, a.w * s); }
+
+inline float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float dot(const Vec4 &a, const Vec4 &b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+inline Vec3 cross(const Vec3 &a, const Vec3 &b)
+{
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+#endif // VECMATH_SSE
+
+inline float length(const Vec3 &v) { return std::sqrt(dot(v, v)); }
+
+// Zero stays zero
+inline Vec3 normalized(const Vec3 &v)
+{
+    const float l = length(v);
+    return l > 0.0f ? v * (1.0f / l) : v;
+}
+
+// Hamilton product: rotating by b, then by a
+inline Quat operator * (const Quat &a, const Quat &b)
+{
+    return Quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+inline Quat Quat::fromAxisAngle(float degrees, const Vec3 &axis)
+{
+    const float l = length(axis);
+    if(l == 0.0f) return Quat();
+
+    const float half = degrees * (float)(3.141592653589793 / 360.0);
+    const float s = std::sin(half) / l;
+    return Quat(axis.x * s, axis.y * s, axis.z * s, std::cos(half));
+}
+
+// v rotated by the unit quaternion q
+inline Vec3 rotate(const Quat &q, const Vec3 &v)
+{
+    // v + 2w (u x v) + 2 u x (u x v), u the vector part
+    const Vec3 u(q.x, q.y, q.z);
+    const Vec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+#endif // VECMATH_H
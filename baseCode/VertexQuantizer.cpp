@@ -0,0 +1,172 @@
+#include "VertexQuantizer.h"
+#include "GLUtils.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT GL_HALF_FLOAT_ARB
+#endif
+
+namespace {
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes");
+
+const float kPositionSteps = 32767.0f;
+const float kNormalSteps = 127.0f;
+
+// float to IEEE half, rounding to nearest (ties away from zero)
+GLushort floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const unsigned int sign = (bits >> 16) & 0x8000u;
+    const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffffu;
+
+    if(((bits >> 23) & 0xff) == 0xff) return (GLushort)(sign | 0x7c00u | (mantissa ? 0x200u : 0)); // inf, nan
+    if(exponent >= 31) return (GLushort)(sign | 0x7c00u);   // overflow to inf
+    if(exponent <= 0) {
+        if(exponent < -10) return (GLushort)sign;           // underflow to zero
+        mantissa |= 0x800000u;                              // denormal
+        const int shift = 14 - exponent;
+        return (GLushort)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+    }
+
+    // The carry of the rounding may ripple into the exponent, which is correct
+    return (GLushort)(sign | (((unsigned int)exponent << 10) + ((mantissa + 0x1000u) >> 13)));
+}
+
+float halfToFloat(GLushort half)
+{
+    const unsigned int sign = (half & 0x8000u) << 16;
+    const int exponent = (half >> 10) & 0x1f;
+    const unsigned int mantissa = half & 0x3ffu;
+
+    if(exponent == 0) {
+        const float value = mantissa / 16777216.0f; // 2^-24
+        return sign ? -value : value;
+    }
+
+    unsigned int bits;
+    if(exponent == 31) bits = sign | 0x7f800000u | (mantissa << 13);
+    else bits = sign | ((unsigned int)(exponent - 15 + 127) << 23) | (mantissa << 13);
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+GLshort quantizeSnorm(float value, float steps)
+{
+    const float clamped = std::min(std::max(value, -1.0f), 1.0f);
+    return (GLshort)std::floor(clamped * steps + 0.5f);
+}
+
+}
+
+bool quantizeVertices(const std::vector<GLfloat> &positions,
+                      const std::vector<GLfloat> &uvs,
+                      const std::vector<GLfloat> &normals,
+                      QuantizedVertices &out)
+{
+    const size_t vertexCount = positions.size() / 3;
+    out.vertices.assign(vertexCount, CompactVertex());
+    out.positionError = out.normalError = out.uvError = 0.0f;
+
+    GLfloat lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    GLfloat hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for(size_t v = 0; v < vertexCount; ++v)
+        for(int k = 0; k < 3; ++k) {
+            lo[k] = std::min(lo[k], positions[3 * v + k]);
+            hi[k] = std::max(hi[k], positions[3 * v + k]);
+        }
+
+    float diagonal = 0.0f;
+    float halfExtent = 1e-6f;
+    for(int k = 0; k < 3; ++k) {
+        if(vertexCount == 0) lo[k] = hi[k] = 0.0f;
+        diagonal += (hi[k] - lo[k]) * (hi[k] - lo[k]);
+        halfExtent = std::max(halfExtent, 0.5f * (hi[k] - lo[k]));
+        out.offset[k] = 0.5f * (lo[k] + hi[k]);
+    }
+    diagonal = std::sqrt(diagonal);
+
+    // Uniform, a non uniform scale would bend the normals
+    for(int k = 0; k < 3; ++k) out.scale[k] = halfExtent / kPositionSteps;
+
+    const bool hasUvs = uvs.size() >= 2 * vertexCount;
+    const bool hasNormals = normals.size() >= 3 * vertexCount;
+
+    for(size_t v = 0; v < vertexCount; ++v) {
+        CompactVertex &c = out.vertices[v];
+
+        for(int k = 0; k < 3; ++k) {
+            const float p = positions[3 * v + k];
+            c.position[k] = quantizeSnorm((p - out.offset[k]) / (out.scale[k] * kPositionSteps), kPositionSteps);
+            const float decoded = out.offset[k] + out.scale[k] * c.position[k];
+            out.positionError = std::max(out.positionError, std::fabs(decoded - p));
+        }
+        c.position[3] = 0;
+
+        if(hasNormals) {
+            const float *n = &normals[3 * v];
+            const float nLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for(int k = 0; k < 3; ++k) {
+                c.normal[k] = (GLbyte)quantizeSnorm(nLength > 0.0f ? n[k] / nLength : 0.0f, kNormalSteps);
+            }
+
+            float d[3];
+            for(int k = 0; k < 3; ++k) d[k] = c.normal[k] / kNormalSteps;
+            const float dLength = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            if(nLength > 0.0f && dLength > 0.0f) {
+                const float cosine = (n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) / (nLength * dLength);
+                const float degrees = std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * 180.0f / 3.14159265f;
+                out.normalError = std::max(out.normalError, degrees);
+            }
+        }
+        c.normal[3] = 0;
+
+        for(int k = 0; k < 2; ++k) {
+            const float uv = hasUvs ? uvs[2 * v + k] : 0.0f;
+            c.uv[k] = floatToHalf(uv);
+            out.uvError = std::max(out.uvError, std::fabs(halfToFloat(c.uv[k]) - uv));
+        }
+    }
+
+    return out.positionError <= diagonal / 8192.0f
+        && out.normalError <= 1.0f
+        && out.uvError <= 1.0f / 4096.0f;
+}
+
+bool compactVerticesSupported()
+{
+    return hasGLVersion(3, 0) || hasGLExtension("GL_ARB_half_float_vertex");
+}
+
+void bindCompactVertices(GLuint buffer, const QuantizedVertices &format)
+{
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glTranslatef(format.offset[0], format.offset[1], format.offset[2]);
+    glScalef(format.scale[0], format.scale[1], format.scale[2]);
+
+    const GLsizei stride = sizeof(CompactVertex);
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glState.clientArrays(true, true, true, false);
+
+    glVertexPointer(3, GL_SHORT, stride, (void*)offsetof(CompactVertex, position));
+    glNormalPointer(GL_BYTE, stride, (void*)offsetof(CompactVertex, normal));
+    glTexCoordPointer(2, GL_HALF_FLOAT, stride, (void*)offsetof(CompactVertex, uv));
+}
+
+void unbindCompactVertices()
+{
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+}
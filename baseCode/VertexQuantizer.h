@@ -0,0 +1,53 @@
+#ifndef VERTEXQUANTIZER_H
+#define VERTEXQUANTIZER_H
+
+#include <QtOpenGL>
+#include <vector>
+
+/*
+ * Compact, 16 bytes per vertex, layout for static meshes:
+ *  - position: 3 x 16 bit integers, relative to the mesh bounding box,
+ *  - normal:   3 x 8 bit signed normalized,
+ *  - uv:       2 x half float.
+ *
+ * The vertex stage undoes the position quantization: the box offset and
+ * scale are folded in the modelview matrix while the mesh is drawn. The
+ * scale is the same on the three axes, so normals only change length and
+ * GL_NORMALIZE must be enabled. (Octahedral normals would need a vertex
+ * shader, the fixed function pipeline reads 8 bit normals natively.)
+ */
+struct CompactVertex {
+    GLshort position[4];    // w is padding
+    GLbyte normal[4];       // w is padding
+    GLushort uv[2];         // IEEE half floats
+};
+
+struct QuantizedVertices {
+    std::vector<CompactVertex> vertices;
+    GLfloat offset[3];      // dequantized position = offset + scale * position
+    GLfloat scale[3];
+
+    // Worst errors measured on the whole mesh
+    float positionError;    // model units
+    float normalError;      // degrees
+    float uvError;          // uv units
+};
+
+// Quantizes the vertices (3, 2 and 3 floats per vertex, missing uvs are
+// zero). Returns false if one of the errors exceeds what is acceptable for
+// display: 1/8192 of the bounding box diagonal, 1 degree, or 1/4096 in uv.
+bool quantizeVertices(const std::vector<GLfloat> &positions,
+                      const std::vector<GLfloat> &uvs,
+                      const std::vector<GLfloat> &normals,
+                      QuantizedVertices &out);
+
+// True if the current context can fetch half float texture coordinates
+bool compactVerticesSupported();
+
+// Sets the vertex, normal and texture coordinate arrays from a buffer of
+// CompactVertex, and pushes the dequantization on the modelview stack.
+// Must be paired with unbindCompactVertices().
+void bindCompactVertices(GLuint buffer, const QuantizedVertices &format);
+void unbindCompactVertices();
+
+#endif // VERTEXQUANTIZER_H
@@ -0,0 +1,117 @@
+#include "Vfs.h"
+#include "Log.h"
+
+#include <algorithm>
+
+Vfs vfs;
+
+namespace {
+
+bool entryLess(const PackEntry &entry, const std::string &path)
+{
+    return entry.path < path;
+}
+
+std::string cleanPath(const std::string &path)
+{
+    return QDir::cleanPath(QString::fromStdString(path)).toStdString();
+}
+
+}
+
+bool Vfs::mount(const std::string &archivePath, const std::string &rootPath)
+{
+    unmount();
+
+    archive.setFileName(archivePath.c_str());
+    if(!archive.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 size = archive.size();
+    mapped = size > 0 ? archive.map(0, size) : NULL;
+    if(mapped == NULL || !readPackIndex(mapped, (size_t)size, entries)) {
+        LOG_WARNING("Vfs: ignoring malformed archive %s", archivePath);
+        unmount();
+        return false;
+    }
+    mappedSize = (size_t)size;
+    root = cleanPath(rootPath);
+    return true;
+}
+
+void Vfs::unmount()
+{
+    if(mapped) archive.unmap(mapped);
+    if(archive.isOpen()) archive.close();
+    mapped = NULL;
+    mappedSize = 0;
+    entries.clear();
+    root.clear();
+}
+
+const PackEntry *Vfs::find(const std::string &path) const
+{
+    if(mapped == NULL) return NULL;
+
+    // Callers build paths as global_path + "/../images/...": compared once
+    // cleaned, relative to the root
+    const std::string cleaned = cleanPath(path);
+    if(cleaned.size() <= root.size() + 1 || cleaned.compare(0, root.size(), root) != 0 ||
+       cleaned[root.size()] != '/') return NULL;
+
+    const std::string relative = cleaned.substr(root.size() + 1);
+    std::vector<PackEntry>::const_iterator found =
+            std::lower_bound(entries.begin(), entries.end(), relative, entryLess);
+    return found != entries.end() && found->path == relative ? &*found : NULL;
+}
+
+bool Vfs::open(const std::string &path, VfsFile &file) const
+{
+    file.bytes = NULL;
+    file.length = 0;
+    file.owned.clear();
+
+    const PackEntry *entry = find(path);
+    if(entry == NULL) {
+        QFile loose(path.c_str());
+        if(!loose.open(QIODevice::ReadOnly)) return false;
+        file.owned = loose.readAll();
+    } else if(entry->compression == PackStored) {
+        file.bytes = mapped + entry->offset;
+        file.length = (size_t)entry->size;
+        return true;
+    } else {
+        file.owned = qUncompress(mapped + entry->offset, (int)entry->storedSize);
+        if((unsigned long long)file.owned.size() != entry->size) {
+            LOG_WARNING("Vfs: cannot inflate %s", path);
+            file.owned.clear();
+            return false;
+        }
+    }
+
+    file.bytes = reinterpret_cast<const unsigned char*>(file.owned.constData());
+    file.length = (size_t)file.owned.size();
+    return true;
+}
+
+bool Vfs::readImage(const std::string &path, QImage &image, std::string &error) const
+{
+    VfsFile file;
+    if(!open(path, file)) {
+        error = "cannot open file";
+        return false;
+    }
+
+    // Decoded from where the bytes already are, the mapping included
+    const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(file.data()), (int)file.size());
+    QBuffer buffer(const_cast<QByteArray*>(&bytes));
+    buffer.open(QIODevice::ReadOnly);
+
+    const size_t dot = path.find_last_of('.');
+    QImageReader reader(&buffer, dot == std::string::npos ? QByteArray() : QByteArray(path.c_str() + dot + 1));
+    reader.setDecideFormatFromContent(true);
+    if(!reader.read(&image)) {
+        error = reader.errorString().toStdString();
+        return false;
+    }
+    return true;
+}
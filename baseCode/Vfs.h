@@ -0,0 +1,87 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <QtOpenGL>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "PackFile.h"
+
+// Contents of a file opened through the Vfs. Points straight into the
+// mapped archive for stored entries, otherwise holds the bytes itself.
+class VfsFile
+{
+public:
+    VfsFile() : bytes(NULL), length(0) {}
+
+    const unsigned char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    friend class Vfs;
+
+    const unsigned char *bytes;
+    size_t length;
+    QByteArray owned;           // inflated entry or loose file
+};
+
+// Read only std::streambuf over bytes in memory, for parsers taking an
+// std::istream (tinyply)
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const unsigned char *data, size_t size)
+    {
+        char *begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+        setg(begin, begin, begin + size);
+    }
+};
+
+/*
+ * The asset files, as packed by tools/pack into one archive (PackFile.h).
+ *
+ * mount() maps the archive once and reads its table of contents; files
+ * under root are then looked up there, by their path relative to root, and
+ * stored entries are handed out in place, without a copy or a system call.
+ * Files the archive does not hold (or every file, when nothing is mounted)
+ * are read from disk, so loose files keep working during development.
+ *
+ * Mount before any loader runs: open() and readImage() are const and safe
+ * to call from any thread afterwards. Unmount explicitly once every such
+ * thread is stopped; the destructor runs in no particular order with other
+ * globals.
+ */
+class Vfs
+{
+public:
+    Vfs() : mapped(NULL), mappedSize(0) {}
+    ~Vfs() { unmount(); }
+
+    // Returns false, leaving only loose files, when archivePath is missing
+    // or malformed
+    bool mount(const std::string &archivePath, const std::string &root);
+    void unmount();
+
+    bool isMounted() const { return mapped != NULL; }
+    size_t entryCount() const { return entries.size(); }
+
+    // Whole contents of path; false when it can be found nowhere
+    bool open(const std::string &path, VfsFile &file) const;
+
+    // Decodes the image at path, reporting why it could not in error
+    bool readImage(const std::string &path, QImage &image, std::string &error) const;
+
+private:
+    const PackEntry *find(const std::string &path) const;
+
+    QFile archive;
+    uchar *mapped;
+    size_t mappedSize;
+    std::string root;           // cleaned, without the trailing '/'
+    std::vector<PackEntry> entries;
+};
+
+extern Vfs vfs;
+
+#endif // VFS_H
@@ -0,0 +1,66 @@
+#include "VirtualSphere.h"
+#include "Base.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+VirtualSphere::VirtualSphere(VirtualTexture &texture) : texture(texture)
+{
+}
+
+void VirtualSphere::draw()
+{
+    if(!texture.isReady()) return;
+
+    if(texture.needsFeedback()) {
+        // Coarse, only the texture coordinates matter
+        texture.beginFeedback();
+        drawGrid(0.0f, 0.0f, 1.0f, 1.0f, kSegmentsU / 4, kSegmentsV / 4, true);
+        texture.endFeedback();
+    }
+
+    texture.collectPatches(patches);
+    texture.bind();
+    for(size_t i = 0; i < patches.size(); ++i) {
+        const VirtualTexture::Patch &patch = patches[i];
+        texture.applyPatch(patch);
+
+        const int segmentsU = std::max(2, (int)std::ceil(kSegmentsU * (patch.u1 - patch.u0)));
+        const int segmentsV = std::max(2, (int)std::ceil(kSegmentsV * (patch.v1 - patch.v0)));
+        drawGrid(patch.u0, patch.v0, patch.u1, patch.v1, segmentsU, segmentsV, false);
+    }
+    texture.unbind();
+}
+
+void VirtualSphere::drawGrid(float u0, float v0, float u1, float v1, int segmentsU, int segmentsV, bool feedback) const
+{
+    // Same parametrization as Sphere: u goes around against phi, v from the
+    // north pole (0) to the south pole (1)
+    for(int j = 0; j < segmentsV; ++j) {
+        glBegin(GL_TRIANGLE_STRIP);
+        for(int i = 0; i <= segmentsU; ++i) {
+            const float u = u0 + (u1 - u0) * i / segmentsU;
+            const float phi = 2 * PI * (1.0f - u);
+
+            for(int k = 0; k < 2; ++k) {
+                const float v = v0 + (v1 - v0) * (j + k) / segmentsV;
+                const float theta = PI * v;
+                const float x = sin(theta) * cos(phi), y = cos(theta), z = sin(theta) * sin(phi);
+
+                if(feedback) glColor4f(u, v, 0.0f, 1.0f);
+                glNormal3f(x, y, z);
+                glTexCoord2f(u, v);
+                glVertex3f(x, y, z);
+            }
+        }
+        glEnd();
+        profiler.countDraw(2 * segmentsU);
+    }
+}
+
+void VirtualSphere::bounds(GLfloat center[3], GLfloat &radius) const
+{
+    center[0] = center[1] = center[2] = 0.0f;
+    radius = 1.0f;
+}
@@ -0,0 +1,33 @@
+#ifndef VIRTUALSPHERE_H
+#define VIRTUALSPHERE_H
+
+#include <QtOpenGL>
+#include <vector>
+
+#include "Drawable.h"
+#include "VirtualTexture.h"
+
+// Unit sphere textured by a virtual texture, with the same mapping as
+// Sphere: drawn patch by patch, each tessellated for its share of the
+// surface, and drawn once more into the texture feedback every frame
+class VirtualSphere : public Drawable
+{
+public:
+    explicit VirtualSphere(VirtualTexture &texture);
+    void draw();
+
+    // Unit sphere around the origin
+    void bounds(GLfloat center[3], GLfloat &radius) const;
+
+    // Segments around a full turn, and from pole to pole
+    static const int kSegmentsU = 200;
+    static const int kSegmentsV = 200;
+
+private:
+    void drawGrid(float u0, float v0, float u1, float v1, int segmentsU, int segmentsV, bool feedback) const;
+
+    VirtualTexture &texture;
+    std::vector<VirtualTexture::Patch> patches;
+};
+
+#endif // VIRTUALSPHERE_H
@@ -0,0 +1,486 @@
+#include "VirtualTexture.h"
+#include "GLUtils.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "texture.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+VirtualTexture::VirtualTexture() :
+    slotSide(0),
+    physical(0),
+    slotColumns(0),
+    slotRows(0),
+    frame(0),
+    framebuffer(0),
+    colorBuffer(0),
+    depthBuffer(0),
+    probe(0),
+    feedbackWidth(0),
+    feedbackHeight(0),
+    feedbackIndex(0),
+    feedbackDone(false),
+    running(false)
+{
+    file.width = file.height = file.tileSize = file.border = file.levels = 0;
+    for(int i = 0; i < kFeedbackBuffers; ++i) {
+        readbacks[i] = 0;
+        readbackFilled[i] = false;
+    }
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if(loader.joinable()) loader.join();
+
+    for(size_t i = 0; i < done.size(); ++i) delete done[i];
+    // The GL context may already be gone, the textures and buffers go with it
+}
+
+unsigned long long VirtualTexture::tileKey(int level, int x, int y)
+{
+    return ((unsigned long long)level << 48) | ((unsigned long long)y << 24) | (unsigned long long)x;
+}
+
+int &VirtualTexture::page(int level, int x, int y)
+{
+    return pages[level][(size_t)y * vtexTilesX(file, level) + x];
+}
+
+bool VirtualTexture::open(const std::string &path)
+{
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if(!in.is_open()) return false;
+
+    VtexHeader header;
+    if(!readVtexHeader(in, header)) {
+        LOG_WARNING("Ignoring malformed %s", path);
+        return false;
+    }
+    if(!hasGLExtension("GL_EXT_framebuffer_object")) {
+        LOG_WARNING("VirtualTexture: no framebuffer objects, %s not used", path);
+        return false;
+    }
+
+    this->path = path;
+    file = header;
+    slotSide = file.tileSize + 2 * file.border;
+    pages.resize(file.levels);
+    for(int level = 0; level < file.levels; ++level)
+        pages[level].assign((size_t)vtexTilesX(file, level) * vtexTilesY(file, level), -1);
+
+    // The probe has the texel density of the texture divided by 2^shift,
+    // like the feedback buffer the pixel density of the screen: the level
+    // it samples is the level the texture needs on screen
+    int shift = kFeedbackShift;
+    while((file.width >> shift) > 2048 || (file.height >> shift) > 2048) ++shift;
+
+    glGenTextures(1, &probe);
+    glState.bindTexture(GL_TEXTURE_2D, probe);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    int w = std::max(1, file.width >> shift), h = std::max(1, file.height >> shift);
+    for(int i = 0; ; ++i) {
+        const GLubyte level = (GLubyte)std::min(file.levels - 1, i + shift - kFeedbackShift);
+        std::vector<GLubyte> texels(4 * (size_t)w * h, 0);
+        for(size_t t = 0; t < texels.size(); t += 4) {
+            texels[t] = level;
+            texels[t + 3] = 255;
+        }
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, &texels[0]);
+        if(w == 1 && h == 1) break;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+
+    running = true;
+    loader = std::thread(&VirtualTexture::loaderLoop, this);
+    return true;
+}
+
+void VirtualTexture::resize(int width, int height)
+{
+    if(!isOpen()) return;
+
+    if(physical) glState.deleteTextures(1, &physical);
+    if(framebuffer) glDeleteFramebuffersEXT(1, &framebuffer);
+    if(colorBuffer) glDeleteRenderbuffersEXT(1, &colorBuffer);
+    if(depthBuffer) glDeleteRenderbuffersEXT(1, &depthBuffer);
+    if(readbacks[0]) glState.deleteBuffers(kFeedbackBuffers, readbacks);
+    physical = framebuffer = colorBuffer = depthBuffer = 0;
+
+    // Twice the tiles it takes to cover the screen at one texel per pixel:
+    // room for the ancestors, and for the tiles of the next few frames
+    const int across = width / file.tileSize + 2;
+    const int down = height / file.tileSize + 2;
+    const int capacity = 2 * across * down + 1;
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const int maxSlots = std::max(1, maxSize / slotSide);
+    slotColumns = std::min(maxSlots, (int)std::ceil(std::sqrt((double)capacity)));
+    slotRows = std::min(maxSlots, (capacity + slotColumns - 1) / slotColumns);
+
+    glGenTextures(1, &physical);
+    glState.bindTexture(GL_TEXTURE_2D, physical);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, slotColumns * slotSide, slotRows * slotSide, 0,
+                 GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+
+    Slot freeSlot;
+    freeSlot.level = freeSlot.x = freeSlot.y = -1;
+    freeSlot.lastUsed = 0;
+    cacheSlots.assign(slotColumns * slotRows, freeSlot);
+    freeSlots.clear();
+    for(int i = (int)cacheSlots.size() - 1; i >= 0; --i) freeSlots.push_back(i);
+    for(size_t level = 0; level < pages.size(); ++level) std::fill(pages[level].begin(), pages[level].end(), -1);
+
+    // The last level is always there to fall back on, read right away
+    Tile root;
+    root.key = tileKey(file.levels - 1, 0, 0);
+    root.pixels.resize(vtexTileBytes(file));
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    in.seekg((std::streamoff)vtexTileOffset(file, file.levels - 1, 0, 0));
+    in.read((char*)&root.pixels[0], root.pixels.size());
+    if(!in.good() || !upload(root, true)) LOG_WARNING("VirtualTexture: cannot read %s", path);
+
+    // Feedback target, read back through a ring of pixel buffers so that
+    // the GPU is never waited for
+    feedbackWidth = std::max(1, width >> kFeedbackShift);
+    feedbackHeight = std::max(1, height >> kFeedbackShift);
+
+    glGenRenderbuffersEXT(1, &colorBuffer);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, colorBuffer);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, feedbackWidth, feedbackHeight);
+    glGenRenderbuffersEXT(1, &depthBuffer);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthBuffer);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+    glGenFramebuffersEXT(1, &framebuffer);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, framebuffer);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, colorBuffer);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depthBuffer);
+    const bool complete = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    if(!complete) {
+        LOG_WARNING("VirtualTexture: incomplete feedback framebuffer, only the last level is drawn");
+        glDeleteFramebuffersEXT(1, &framebuffer);
+        framebuffer = 0;
+    }
+
+    glGenBuffers(kFeedbackBuffers, readbacks);
+    for(int i = 0; i < kFeedbackBuffers; ++i) {
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4 * feedbackWidth * feedbackHeight, NULL, GL_STREAM_READ);
+        readbackFilled[i] = false;
+    }
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackIndex = 0;
+}
+
+void VirtualTexture::beginFrame()
+{
+    if(!isReady()) return;
+    ++frame;
+    feedbackDone = framebuffer == 0;
+
+    readFeedback();
+    requestTiles();
+
+    std::vector<Tile*> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while(!done.empty() && loaded.size() < (size_t)kUploadsPerFrame) {
+            loaded.push_back(done.front());
+            done.pop_front();
+        }
+    }
+
+    for(size_t i = 0; i < loaded.size(); ++i) {
+        pending.erase(loaded[i]->key);
+        if(loaded[i]->pixels.empty()) {
+            // Failed read: never requested again, the coarser level stands in
+            unreadable.insert(loaded[i]->key);
+        } else {
+            // A tile the cache has no room for is asked for again later
+            upload(*loaded[i], false);
+        }
+        delete loaded[i];
+    }
+}
+
+void VirtualTexture::readFeedback()
+{
+    // The oldest buffer of the ring, written a couple of frames ago
+    const int index = feedbackIndex;
+    if(!readbackFilled[index]) return;
+    readbackFilled[index] = false;
+
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[index]);
+    const GLubyte *texels = (const GLubyte*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if(texels) {
+        wanted.clear();
+        const int count = feedbackWidth * feedbackHeight;
+        for(int i = 0; i < count; ++i) {
+            const GLubyte *t = texels + 4 * i;
+            if(t[3] == 0) continue;     // not covered
+
+            const int level = std::min((int)t[2], file.levels - 1);
+            const int x = std::min(vtexTilesX(file, level) - 1, (int)(t[0] / 255.0f * vtexLevelWidth(file, level) / file.tileSize));
+            const int y = std::min(vtexTilesY(file, level) - 1, (int)(t[1] / 255.0f * vtexLevelHeight(file, level) / file.tileSize));
+            want(level, x, y);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::want(int level, int x, int y)
+{
+    for(; level < file.levels; ++level, x /= 2, y /= 2) {
+        if(!wanted.insert(tileKey(level, x, y)).second) return;    // so are its ancestors
+
+        const int slot = page(level, x, y);
+        if(slot >= 0 && cacheSlots[slot].lastUsed != ULONG_MAX) cacheSlots[slot].lastUsed = frame;
+    }
+}
+
+void VirtualTexture::requestTiles()
+{
+    if(pending.size() >= (size_t)kMaxPending) return;
+
+    // Keys sort by level: coarse tiles first, a patch always has an ancestor to fall back on
+    std::vector<unsigned long long> missing;
+    for(std::set<unsigned long long>::const_reverse_iterator i = wanted.rbegin(); i != wanted.rend(); ++i) {
+        const int level = (int)(*i >> 48);
+        const int y = (int)((*i >> 24) & 0xffffff);
+        const int x = (int)(*i & 0xffffff);
+        if(page(level, x, y) < 0 && pending.count(*i) == 0 && unreadable.count(*i) == 0) missing.push_back(*i);
+        if(pending.size() + missing.size() >= (size_t)kMaxPending) break;
+    }
+    if(missing.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t i = 0; i < missing.size(); ++i) {
+            todo.push_back(missing[i]);
+            pending.insert(missing[i]);
+        }
+    }
+    wake.notify_one();
+}
+
+int VirtualTexture::takeSlot()
+{
+    if(!freeSlots.empty()) {
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // Least recently used, never one used this frame
+    int oldest = -1;
+    for(size_t i = 0; i < cacheSlots.size(); ++i)
+        if(cacheSlots[i].lastUsed < frame && (oldest < 0 || cacheSlots[i].lastUsed < cacheSlots[oldest].lastUsed)) oldest = (int)i;
+    if(oldest >= 0) page(cacheSlots[oldest].level, cacheSlots[oldest].x, cacheSlots[oldest].y) = -1;
+    return oldest;
+}
+
+bool VirtualTexture::upload(const Tile &tile, bool pinned)
+{
+    const int level = (int)(tile.key >> 48);
+    const int y = (int)((tile.key >> 24) & 0xffffff);
+    const int x = (int)(tile.key & 0xffffff);
+    if(page(level, x, y) >= 0) return true;
+
+    const int slot = takeSlot();
+    if(slot < 0) return false;
+
+    glState.bindTexture(GL_TEXTURE_2D, physical);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotColumns) * slotSide, (slot / slotColumns) * slotSide,
+                    slotSide, slotSide, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &tile.pixels[0]);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+
+    Slot &s = cacheSlots[slot];
+    s.level = level;
+    s.x = x;
+    s.y = y;
+    s.lastUsed = pinned ? ULONG_MAX : frame;
+    page(level, x, y) = slot;
+    return true;
+}
+
+void VirtualTexture::beginFeedback()
+{
+    glState.pushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_CURRENT_BIT);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, framebuffer);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+
+    // Whatever pass the surface is drawn in, the feedback needs both
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_BLEND);
+    glState.enable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+
+    // color = coordinates (primary color) + level (probe, in blue)
+    glState.activeTexture(GL_TEXTURE0);
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(GL_TEXTURE_2D, probe);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_ADD);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_PRIMARY_COLOR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_TEXTURE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_ALPHA, GL_PRIMARY_COLOR);
+}
+
+void VirtualTexture::endFeedback()
+{
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[feedbackIndex]);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readbackFilled[feedbackIndex] = true;
+    feedbackIndex = (feedbackIndex + 1) % kFeedbackBuffers;
+
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    glState.popAttrib();
+    profiler.countStateChange(8);
+    feedbackDone = true;
+}
+
+void VirtualTexture::collectPatches(std::vector<Patch> &patches)
+{
+    patches.clear();
+    if(isReady()) collect(file.levels - 1, 0, 0, patches);
+}
+
+void VirtualTexture::collect(int level, int x, int y, std::vector<Patch> &patches)
+{
+    const int tilesX = vtexTilesX(file, level);
+    const int tilesY = vtexTilesY(file, level);
+    if(x >= tilesX || y >= tilesY) return;
+
+    // Tile rectangles in level 0 units, so that children exactly cover their parent
+    bool refine = false;
+    for(int j = 0; level > 0 && j < 4 && !refine; ++j)
+        refine = wanted.count(tileKey(level - 1, 2 * x + j % 2, 2 * y + j / 2)) != 0;
+    if(refine) {
+        for(int j = 0; j < 4; ++j) collect(level - 1, 2 * x + j % 2, 2 * y + j / 2, patches);
+        return;
+    }
+
+    const double span = (double)file.tileSize * (1 << level);
+    Patch patch;
+    patch.u0 = (float)(x * span / file.width);
+    patch.v0 = (float)(y * span / file.height);
+    patch.u1 = x == tilesX - 1 ? 1.0f : (float)((x + 1) * span / file.width);
+    patch.v1 = y == tilesY - 1 ? 1.0f : (float)((y + 1) * span / file.height);
+
+    // Closest resident ancestor
+    patch.level = level;
+    patch.x = x;
+    patch.y = y;
+    while(patch.level < file.levels && page(patch.level, patch.x, patch.y) < 0) {
+        ++patch.level;
+        patch.x /= 2;
+        patch.y /= 2;
+    }
+    if(patch.level < file.levels) patches.push_back(patch);
+}
+
+void VirtualTexture::bind() const
+{
+    glState.activeTexture(GL_TEXTURE0);
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(GL_TEXTURE_2D, physical);
+}
+
+void VirtualTexture::unbind() const
+{
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glState.disable(GL_TEXTURE_2D);
+}
+
+void VirtualTexture::applyPatch(const Patch &patch)
+{
+    const int slot = page(patch.level, patch.x, patch.y);
+    if(cacheSlots[slot].lastUsed != ULONG_MAX) cacheSlots[slot].lastUsed = frame;
+
+    // Level texel u * width lands at texel u * width - x * tileSize of the
+    // tile, past the border of the slot
+    const GLfloat physicalWidth = (GLfloat)(slotColumns * slotSide);
+    const GLfloat physicalHeight = (GLfloat)(slotRows * slotSide);
+    const int originX = (slot % slotColumns) * slotSide + file.border - patch.x * file.tileSize;
+    const int originY = (slot / slotColumns) * slotSide + file.border - patch.y * file.tileSize;
+
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(originX / physicalWidth, originY / physicalHeight, 0.0f);
+    glScalef(vtexLevelWidth(file, patch.level) / physicalWidth, vtexLevelHeight(file, patch.level) / physicalHeight, 1.0f);
+    glMatrixMode(GL_MODELVIEW);
+    profiler.countStateChange();
+}
+
+void VirtualTexture::loaderLoop()
+{
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+
+    for(;;) {
+        unsigned long long key;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !running || !todo.empty(); });
+            if(!running) return;
+            key = todo.front();
+            todo.pop_front();
+        }
+
+        const int level = (int)(key >> 48);
+        const int y = (int)((key >> 24) & 0xffffff);
+        const int x = (int)(key & 0xffffff);
+
+        Tile *tile = new Tile;
+        tile->key = key;
+        tile->pixels.resize(vtexTileBytes(file));
+        in.seekg((std::streamoff)vtexTileOffset(file, level, x, y));
+        in.read((char*)&tile->pixels[0], tile->pixels.size());
+        if(!in.good()) {
+            // Truncated file: the tile is never asked for again, its patch keeps an ancestor
+            in.clear();
+            tile->pixels.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(tile);
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <QtOpenGL>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VtexFile.h"
+
+/*
+ * Texture larger than memory, streamed tile by tile from a .vtex file.
+ *
+ * Without shaders there is no per-pixel page table lookup, so the surface
+ * is drawn in patches instead, one per tile of a quadtree over the texture
+ * coordinates: each patch samples its tile in a fixed size physical cache
+ * (one GL texture divided into cacheSlots) through the texture matrix.
+ *
+ * A feedback pass draws the surface once per frame, at a sixteenth of the
+ * screen resolution, into a small framebuffer: texture coordinates go in
+ * red and green and a probe texture, whose mip levels hold their own
+ * level number, lets the hardware write the level it would sample in
+ * blue. The result is read back asynchronously and decides which tiles are
+ * wanted; a background thread reads them from the file, coarse levels
+ * first, and the GL thread copies a few of them per frame into the cacheSlots
+ * least recently used. Until a tile arrives its patch samples the closest
+ * resident ancestor. The cache, and so the memory used, grows with the
+ * screen and not with the texture; the last level is always resident.
+ */
+class VirtualTexture
+{
+public:
+    VirtualTexture();
+    ~VirtualTexture();
+
+    // Needs a current GL context, and the framebuffer object extension.
+    // Returns false if the file cannot be used.
+    bool open(const std::string &path);
+    bool isOpen() const { return file.levels > 0; }
+
+    // Sizes the tile cache and the feedback buffer for the viewport
+    void resize(int width, int height);
+    bool isReady() const { return isOpen() && physical != 0; }
+
+    // Once per frame, before drawing: reads back the feedback, queues the
+    // tiles it wants and uploads the ones loaded since
+    void beginFrame();
+
+    // Feedback pass, once per frame. Between begin and end, draw the
+    // surface with its texture coordinates in the primary color as well.
+    bool needsFeedback() const { return isReady() && !feedbackDone; }
+    void beginFeedback();
+    void endFeedback();
+
+    struct Patch {
+        float u0, v0, u1, v1;   // covered texture coordinates
+        int level, x, y;        // resident tile sampled, may be an ancestor
+    };
+
+    // Patches covering the whole texture, each at the finest level wanted
+    void collectPatches(std::vector<Patch> &patches);
+
+    void bind() const;
+    void unbind() const;
+    // Loads the texture matrix mapping the coordinates of patch into its slot
+    void applyPatch(const Patch &patch);
+
+    size_t residentTiles() const { return cacheSlots.size() - freeSlots.size(); }
+
+    // Feedback resolution is the screen's divided by 2^kFeedbackShift
+    static const int kFeedbackShift = 4;
+    static const int kUploadsPerFrame = 8;
+    static const int kMaxPending = 32;
+
+private:
+    struct Slot {
+        int level, x, y;        // level -1 when free
+        unsigned long lastUsed;
+    };
+    struct Tile {
+        unsigned long long key;
+        std::vector<unsigned char> pixels;
+    };
+
+    static unsigned long long tileKey(int level, int x, int y);
+    int &page(int level, int x, int y);
+    void want(int level, int x, int y);
+    void collect(int level, int x, int y, std::vector<Patch> &patches);
+    void readFeedback();
+    void requestTiles();
+    bool upload(const Tile &tile, bool pinned);
+    int takeSlot();
+    void loaderLoop();
+
+    std::string path;
+    VtexHeader file;
+    int slotSide;               // tile size with its borders
+
+    // Physical cache
+    GLuint physical;
+    int slotColumns, slotRows;
+    std::vector<Slot> cacheSlots;
+    std::vector<int> freeSlots;
+    std::vector<std::vector<int> > pages;   // slot of every tile, per level, or -1
+    unsigned long frame;
+
+    // Feedback
+    GLuint framebuffer, colorBuffer, depthBuffer;
+    GLuint probe;
+    int feedbackWidth, feedbackHeight;
+    static const int kFeedbackBuffers = 3;
+    GLuint readbacks[kFeedbackBuffers];
+    bool readbackFilled[kFeedbackBuffers];
+    int feedbackIndex;
+    bool feedbackDone;
+    std::set<unsigned long long> wanted;    // feedback tiles and their ancestors
+    std::set<unsigned long long> unreadable;
+
+    // Shared with the loader, pending is GL thread only
+    std::set<unsigned long long> pending;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<unsigned long long> todo;
+    std::deque<Tile*> done;
+    bool running;
+    std::thread loader;
+};
+
+#endif // VIRTUALTEXTURE_H
@@ -0,0 +1,92 @@
+#include "VtexFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = { 'V', 'T', 'E', 'X' };
+const unsigned int kVersion = 1;
+
+// Header words after the magic, in file order
+enum { Version, Width, Height, TileSize, Border, Levels, Reserved, HeaderWords };
+
+}
+
+int vtexLevelCount(int width, int height, int tileSize)
+{
+    int levels = 1;
+    while(width > tileSize || height > tileSize) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++levels;
+    }
+    return levels;
+}
+
+int vtexLevelWidth(const VtexHeader &header, int level)
+{
+    return std::max(1, header.width >> level);
+}
+
+int vtexLevelHeight(const VtexHeader &header, int level)
+{
+    return std::max(1, header.height >> level);
+}
+
+int vtexTilesX(const VtexHeader &header, int level)
+{
+    return (vtexLevelWidth(header, level) + header.tileSize - 1) / header.tileSize;
+}
+
+int vtexTilesY(const VtexHeader &header, int level)
+{
+    return (vtexLevelHeight(header, level) + header.tileSize - 1) / header.tileSize;
+}
+
+size_t vtexTileBytes(const VtexHeader &header)
+{
+    const size_t side = header.tileSize + 2 * header.border;
+    return 4 * side * side;
+}
+
+unsigned long long vtexTileOffset(const VtexHeader &header, int level, int x, int y)
+{
+    unsigned long long tiles = 0;
+    for(int l = 0; l < level; ++l) tiles += (unsigned long long)vtexTilesX(header, l) * vtexTilesY(header, l);
+    tiles += (unsigned long long)y * vtexTilesX(header, level) + x;
+    return sizeof(kMagic) + 4 * HeaderWords + tiles * vtexTileBytes(header);
+}
+
+bool readVtexHeader(std::istream &in, VtexHeader &header)
+{
+    char magic[sizeof(kMagic)];
+    unsigned int words[HeaderWords];
+    in.read(magic, sizeof(magic));
+    in.read((char*)words, sizeof(words));
+    if(!in.good() || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || words[Version] != kVersion) return false;
+
+    header.width = (int)words[Width];
+    header.height = (int)words[Height];
+    header.tileSize = (int)words[TileSize];
+    header.border = (int)words[Border];
+    header.levels = (int)words[Levels];
+
+    return header.width > 0 && header.height > 0 && header.tileSize > 0 && header.border >= 0
+        && header.levels == vtexLevelCount(header.width, header.height, header.tileSize);
+}
+
+bool writeVtexHeader(std::ostream &out, const VtexHeader &header)
+{
+    unsigned int words[HeaderWords] = { 0 };
+    words[Version] = kVersion;
+    words[Width] = (unsigned int)header.width;
+    words[Height] = (unsigned int)header.height;
+    words[TileSize] = (unsigned int)header.tileSize;
+    words[Border] = (unsigned int)header.border;
+    words[Levels] = (unsigned int)header.levels;
+
+    out.write(kMagic, sizeof(kMagic));
+    out.write((const char*)words, sizeof(words));
+    return out.good();
+}
@@ -0,0 +1,45 @@
+#ifndef VTEXFILE_H
+#define VTEXFILE_H
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+/*
+ * Pre-tiled texture (.vtex), written by tools/vtbuild and streamed by
+ * VirtualTexture.
+ *
+ * A 32 byte header, then every tile of every level, level 0 first, rows of
+ * tiles top first. A tile is (tileSize + 2 * border)^2 pixels of 32 bit
+ * ARGB words as QImage stores them, top row first; the border repeats the
+ * texels of the neighbouring tiles so tiles filter without seams. Tiles are
+ * all the same size, so their offset follows from their position. The last
+ * level fits in a single tile. Words are in the byte order of the machine
+ * that wrote the file.
+ */
+struct VtexHeader {
+    int width;
+    int height;
+    int tileSize;
+    int border;
+    int levels;
+};
+
+// Number of levels of a width x height texture tiled by tileSize
+int vtexLevelCount(int width, int height, int tileSize);
+
+// Size of a level, and its number of tiles
+int vtexLevelWidth(const VtexHeader &header, int level);
+int vtexLevelHeight(const VtexHeader &header, int level);
+int vtexTilesX(const VtexHeader &header, int level);
+int vtexTilesY(const VtexHeader &header, int level);
+
+// Bytes of one tile, and where tile (x, y) of level starts in the file
+size_t vtexTileBytes(const VtexHeader &header);
+unsigned long long vtexTileOffset(const VtexHeader &header, int level, int x, int y);
+
+// Returns false on a malformed or truncated header
+bool readVtexHeader(std::istream &in, VtexHeader &header);
+bool writeVtexHeader(std::ostream &out, const VtexHeader &header);
+
+#endif // VTEXFILE_H
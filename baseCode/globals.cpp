@@ -1,3 +1,6 @@
 #include "globals.h"
 
 std::string global_path = "";
+bool compact_vertices = true;
+int texture_budget_mb = 256;
+bool software_rasterizer = false;
@@ -3,4 +3,13 @@
 #include <string>
 extern std::string global_path;
 
+// Upload static meshes with quantized vertices (VertexQuantizer.h)
+extern bool compact_vertices;
+
+// GPU memory for textures before the least recently used ones are evicted
+extern int texture_budget_mb;
+
+// Rasterize the opaque pass on the CPU (SoftRasterizer.h)
+extern bool software_rasterizer;
+
 #endif // GLOBALS_H
@@ -1,66 +1,88 @@
-//
-// Upon first time for generating VC 2008 project file
-//
-// $QTDIR$\bin\qmake -tp vc
-//
-
-/****************************************************************************
-**
-** Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
-** All rights reserved.
-** Contact: Nokia Corporation (qt-info@nokia.com)
-**
-** This file is part of the examples of the Qt Toolkit.
-**
-** $QT_BEGIN_LICENSE:LGPL$
-** Commercial Usage
-** Licensees holding valid Qt Commercial licenses may use this file in
-** accordance with the Qt Commercial License Agreement provided with the
-** Software or, alternatively, in accordance with the terms contained in
-** a written agreement between you and Nokia.
-**
-** GNU Lesser General Public License Usage
-** Alternatively, this file may be used under the terms of the GNU Lesser
-** General Public License version 2.1 as published by the Free Software
-** Foundation and appearing in the file LICENSE.LGPL included in the
-** packaging of this file.  Please review the following information to
-** ensure the GNU Lesser General Public License version 2.1 requirements
-** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
-**
-** In addition, as a special exception, Nokia gives you certain additional
-** rights.  These rights are described in the Nokia Qt LGPL Exception
-** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
-**
-** GNU General Public License Usage
-** Alternatively, this file may be used under the terms of the GNU
-** General Public License version 3.0 as published by the Free Software
-** Foundation and appearing in the file LICENSE.GPL included in the
-** packaging of this file.  Please review the following information to
-** ensure the GNU General Public License version 3.0 requirements will be
-** met: http://www.gnu.org/copyleft/gpl.html.
-**
-** If you have questions regarding the use of this file, please contact
-** Nokia at qt-info@nokia.com.
-** $QT_END_LICENSE$
-**
-****************************************************************************/
-
-#include <QApplication>
-#include "GLRender.h"
-#include "globals.h"
-#include <string.h>
-//! [0]
-int main(int argc, char *argv[])
-{
-    global_path = argv[0];
-    global_path = global_path.substr(0, global_path.size()-9);
-    global_path+= "/../../..";
-    std::cout<<"NEWP: "<<global_path<<endl;
-    QApplication app(argc, argv);
-    GLRender viewer(0, Qt::Window);
-
-    app.setActiveWindow(&viewer);
-    viewer.show();
-    return app.exec();
-}
-//! [0]
+//
+// Upon first time for generating VC 2008 project file
+//
+// $QTDIR$\bin\qmake -tp vc
+//
+
+/****************************************************************************
+**
+** Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (qt-info@nokia.com)
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Usage
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Commercial License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Nokia.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Nokia gives you certain additional
+** rights.  These rights are described in the Nokia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at qt-info@nokia.com.
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QApplication>
+#include "GLRender.h"
+#include "globals.h"
+#include "Log.h"
+#include "TextureManager.h"
+#include "Vfs.h"
+#include <string.h>
+#include <stdlib.h>
+//! [0]
+int main(int argc, char *argv[])
+{
+    global_path = argv[0];
+    global_path = global_path.substr(0, global_path.size()-9);
+    global_path+= "/../../..";
+    LOG_INFO("NEWP: %s", global_path);
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--float-vertices") == 0) compact_vertices = false;
+        else if(strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) texture_budget_mb = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--software") == 0) software_rasterizer = true;
+    }
+    // Assets come from the archive when there is one (tools/pack), loose
+    // files otherwise
+    if(vfs.mount(global_path + "/../images.pak", global_path + "/../images"))
+        LOG_INFO("Mounted images.pak: %u files", (unsigned)vfs.entryCount());
+    else
+        LOG_INFO("No images.pak, reading loose files from %s/../images", global_path);
+    QApplication app(argc, argv);
+    int result;
+    {
+        GLRender viewer(0, Qt::Window);
+
+        app.setActiveWindow(&viewer);
+        viewer.show();
+        result = app.exec();
+    }
+    // The decoding threads read through the mapping: stop them first
+    textures.shutdown();
+    vfs.unmount();
+    return result;
+}
+//! [0]
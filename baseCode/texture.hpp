@@ -7,69 +7,271 @@
 
 // Qt includes.
 #include <QtOpenGL>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "MipChain.h"
+#include "KtxFile.h"
+#include "GLUtils.h"
+#include "GLState.h"
+#include "Log.h"
+#include "Vfs.h"
+
+#ifndef GL_UNSIGNED_INT_8_8_8_8_REV
+#define GL_UNSIGNED_INT_8_8_8_8_REV 0x8367
+#endif
+
+// Decoded texture, ready to upload: what a worker thread hands to the GL thread.
+// Uncompressed pixels are 32 bit ARGB words as QImage stores them (BGRA bytes
+// on little endian machines), top row first: the loaders flip V instead.
+struct TexturePixels {
+    struct Level {
+        int width;
+        int height;
+        const unsigned char *data;  // in storage, or in image for the full size level
+        size_t size;
+        std::vector<unsigned char> storage;
+    };
+
+    bool compressed;
+    GLenum internalFormat;      // GL_RGBA8, or the block compressed format
+    QImage image;               // decoded file, uploaded in place
+    std::vector<Level> levels;  // largest first, without the skipped ones
+    int skipped;
+    size_t fullBytes;           // with every level
+};
 
 // The texture class.
 class Texture
 {
 public:
     // Constructor.
-    Texture(const std::string &path) : loaded(false), path(path) { }
+    Texture(const std::string &path) : loaded(false), path(path), name(0), residentBytes(0), allBytes(0), skipped(0),
+        pending(0), pendingBytes(0), pendingAllBytes(0), pendingSkipped(0) { }
 
     // Bind the program.
     inline void bind()
     {
         assert(loaded);
 
-        glActiveTexture(GL_TEXTURE0);
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, name);
+        glState.activeTexture(GL_TEXTURE0);
+        glState.enable(GL_TEXTURE_2D);
+        glState.bindTexture(GL_TEXTURE_2D, name);
     }
 
     // Unbind the program.
     inline void unbind()
     {
-        glDisable(GL_TEXTURE_2D);
+        glState.disable(GL_TEXTURE_2D);
     }
 
-    // Set 2D texture.
-    void setTexture()
+    // Set 2D texture, synchronously. skipLevels drops the largest mip
+    // levels, a texture with n levels keeps at least its smallest one.
+    void setTexture(int skipLevels = 0)
     {
-        QImageReader reader(path.c_str());
-        QImage img;
+        TexturePixels pixels;
+        if(!decode(path, skipLevels, hasGLExtension("GL_EXT_texture_compression_s3tc"), pixels)) return;
 
-        const bool read = reader.read(&img);
+        allocate(pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for(int i = (int)pixels.levels.size() - 1; i >= 0; --i) uploadLevel(pixels, i, pixels.levels[i].data);
+    }
 
-        if(!read) {
-            std::cout << "Failed to read: " << path.c_str() << " with message:" << reader.errorString().toStdString().c_str() << "; " << std::endl;
-            assert(read);
-            return;
+    // Reads the image, or the block compressed copy made by tools/texcompress
+    // (<path without extension>.ktx) when there is one and compressed is
+    // true, and builds the mip chain. Makes no GL call, any thread can decode.
+    static bool decode(const std::string &path, int skipLevels, bool compressed, TexturePixels &pixels)
+    {
+        if(compressed && decodeCompressed(path, skipLevels, pixels)) return true;
+
+        QImage img;
+        std::string error;
+        if(!vfs.readImage(path, img, error)) {
+            LOG_WARNING("Failed to read: %s with message:%s; ", path, error);
+            return false;
         }
 
         assert(img.width() > 0.0);
 
-        img = QGLWidget::convertToGLFormat(img);
+        // JPEGs decode to RGB32 and most PNGs to ARGB32, both upload as they
+        // are with GL_BGRA / GL_UNSIGNED_INT_8_8_8_8_REV: no swizzle, no flip
+        if(img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32)
+            img = img.convertToFormat(QImage::Format_ARGB32);
+
+        // Whole pyramid built on the CPU, so that minified textures are
+        // filtered instead of sampling the full size level
+        std::vector<MipLevel> levels;
+        buildMipChain(img.constBits(), img.width(), img.height(), levels);
+
+        pixels.compressed = false;
+        pixels.internalFormat = GL_RGBA8;
+        pixels.skipped = std::min(std::max(skipLevels, 0), (int)levels.size());
+        pixels.fullBytes = 4 * (size_t)img.width() * img.height();
+        pixels.levels.clear();
+
+        if(pixels.skipped == 0) {
+            TexturePixels::Level level;
+            level.data = NULL;
+            level.width = img.width();
+            level.height = img.height();
+            level.size = pixels.fullBytes;
+            pixels.levels.push_back(level);
+            pixels.image = img;
+        }
+        for(size_t i = 0; i < levels.size(); ++i) {
+            pixels.fullBytes += levels[i].pixels.size();
+            if((int)i + 1 < pixels.skipped) continue;
+
+            TexturePixels::Level level;
+            level.data = NULL;
+            level.width = levels[i].width;
+            level.height = levels[i].height;
+            level.size = levels[i].pixels.size();
+            pixels.levels.push_back(level);
+            pixels.levels.back().storage.swap(levels[i].pixels);
+        }
+
+        // The levels do not move any more
+        for(size_t i = 0; i < pixels.levels.size(); ++i) {
+            TexturePixels::Level &level = pixels.levels[i];
+            level.data = level.storage.empty() ? pixels.image.constBits() : &level.storage[0];
+        }
+        return true;
+    }
+
+    static bool decodeCompressed(const std::string &path, int skipLevels, TexturePixels &pixels)
+    {
+        const size_t dot = path.find_last_of('.');
+        const std::string ktxPath = (dot == std::string::npos ? path : path.substr(0, dot)) + ".ktx";
 
-        glGenTextures(1, &name);
-        glBindTexture(GL_TEXTURE_2D, name);
+        // Packed KTX files are stored, not deflated: the blocks are copied
+        // once, straight from the mapped archive
+        VfsFile file;
+        if(!vfs.open(ktxPath, file)) return false;
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+        KtxTexture ktx;
+        const bool parsed = parseKtx(file.data(), file.size(), ktx) && !ktx.levels.empty();
+        if(parsed) {
+            const int count = (int)ktx.levels.size();
+            pixels.compressed = true;
+            pixels.internalFormat = ktx.internalFormat;
+            pixels.skipped = std::min(std::max(skipLevels, 0), count - 1);
+            pixels.fullBytes = 0;
+            pixels.levels.clear();
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            for(int i = 0; i < count; ++i) {
+                const KtxLevel &source = ktx.levels[i];
+                pixels.fullBytes += source.size;
+                if(i < pixels.skipped) continue;
+
+                TexturePixels::Level level;
+                level.data = NULL;
+                level.width = source.width;
+                level.height = source.height;
+                level.size = source.size;
+                pixels.levels.push_back(level);
+                pixels.levels.back().storage.assign(source.data, source.data + source.size);
+                pixels.levels.back().data = pixels.levels.back().storage.data();
+            }
+        } else {
+            LOG_WARNING("Ignoring malformed %s", ktxPath);
+        }
+
+        return parsed;
+    }
+
+    // Creates a GL texture for pixels, with no level in it yet. The texture
+    // drawn so far stays bound by bind() until the new one is as good: at
+    // its first level when nothing is drawn yet, otherwise once complete.
+    void allocate(const TexturePixels &pixels)
+    {
+        if(pending != 0) glState.deleteTextures(1, &pending);
+        pendingBytes = 0;
+        pendingSkipped = pixels.skipped;
+        pendingAllBytes = pixels.fullBytes;
+
+        const int count = (int)pixels.levels.size();
+        glGenTextures(1, &pending);
+        glState.bindTexture(GL_TEXTURE_2D, pending);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, count - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+    }
+
+    // Uploads level i of pixels, from client memory or from an offset in the
+    // bound GL_PIXEL_UNPACK_BUFFER. Levels go smallest first: the base level
+    // follows, so the texture can be drawn as soon as one level is in.
+    void uploadLevel(const TexturePixels &pixels, int i, const void *data)
+    {
+        const TexturePixels::Level &level = pixels.levels[i];
+        const GLsizei size = (GLsizei)level.size;
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width(), img.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, img.bits());
+        glState.bindTexture(GL_TEXTURE_2D, pending != 0 ? pending : name);
+        if(pixels.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, pixels.internalFormat, level.width, level.height, 0, size, data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.width, level.height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, i);
 
+        if(pending == 0) {
+            residentBytes += size;
+            return;
+        }
+        pendingBytes += size;
+        if(loaded && i > 0) return;
+
+        // The new texture is drawable and no worse than the old one
+        if(name != 0) glState.deleteTextures(1, &name);
+        name = pending;
+        pending = 0;
+        residentBytes = pendingBytes;
+        pendingBytes = 0;
+        skipped = pendingSkipped;
+        allBytes = pendingAllBytes;
         loaded = true;
     }
 
+    // Frees the GL texture, and the one being loaded to replace it
+    void release()
+    {
+        if(name != 0) glState.deleteTextures(1, &name);
+        if(pending != 0) glState.deleteTextures(1, &pending);
+        name = 0;
+        pending = 0;
+        loaded = false;
+        residentBytes = 0;
+        pendingBytes = 0;
+    }
+
+    // True once at least one level can be drawn
+    bool isLoaded() const { return loaded; }
+    const std::string &getPath() const { return path; }
+
+    // GPU memory used now, replacement included, and with every level loaded
+    size_t bytes() const { return residentBytes + pendingBytes; }
+    size_t fullBytes() const { return allBytes; }
+    int levelsSkipped() const { return skipped; }
+
 private:
     // Global variables.
     bool loaded;
     const std::string path;
     GLuint name;
+
+    size_t residentBytes;
+    size_t allBytes;
+    int skipped;
+
+    // Being uploaded, swapped in for name when ready (see allocate())
+    GLuint pending;
+    size_t pendingBytes;
+    size_t pendingAllBytes;
+    int pendingSkipped;
 };
 
 #endif // TEXTURE_H
@@ -0,0 +1,135 @@
+/*
+ * pack: packs the files of a directory, recursively, into one archive
+ * (PackFile.h), which the viewer maps at startup and reads its models and
+ * textures from.
+ *
+ *   pack [--store] images images.pak
+ *
+ * The viewer looks for images.pak next to the images directory. Entries
+ * are deflated when that saves at least an eighth of their size, except
+ * for formats that are compressed already or read in place (JPEG, PNG,
+ * KTX); --store deflates nothing. Virtual textures (.vtex) are streamed
+ * from loose files and left out.
+ */
+
+#include <QByteArray>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QString>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "PackFile.h"
+
+namespace {
+
+bool hasSuffix(const QString &path, const char *const *suffixes)
+{
+    for(; *suffixes; ++suffixes)
+        if(path.endsWith(*suffixes, Qt::CaseInsensitive)) return true;
+    return false;
+}
+
+const char *const kStoredSuffixes[] = { ".jpg", ".jpeg", ".png", ".ktx", NULL };
+const char *const kSkippedSuffixes[] = { ".vtex", ".pak", NULL };
+
+bool pad(std::ofstream &out)
+{
+    static const char zeros[kPackAlignment] = { 0 };
+    const std::streamoff position = out.tellp();
+    const size_t extra = (kPackAlignment - (size_t)position % kPackAlignment) % kPackAlignment;
+    out.write(zeros, extra);
+    return out.good();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    bool deflate = true;
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--store") == 0) deflate = false;
+        else paths.push_back(argv[i]);
+    }
+    if(paths.size() != 2) {
+        printf("usage: %s [--store] directory archive\n", argv[0]);
+        return 1;
+    }
+
+    const QDir root(QString::fromStdString(paths[0]));
+    if(!root.exists()) {
+        printf("%s: no such directory\n", paths[0].c_str());
+        return 1;
+    }
+
+    // Sorted, so that packing the same files gives the same archive
+    std::vector<QString> files;
+    QDirIterator it(root.path(), QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while(it.hasNext()) {
+        const QString file = it.next();
+        if(!hasSuffix(file, kSkippedSuffixes)) files.push_back(file);
+    }
+    std::sort(files.begin(), files.end());
+
+    std::ofstream out(paths[1].c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out.is_open() || !writePackHeader(out, 0, 0)) {
+        printf("%s: cannot write\n", paths[1].c_str());
+        return 1;
+    }
+
+    std::vector<PackEntry> entries;
+    unsigned long long original = 0, stored = 0;
+    for(size_t i = 0; i < files.size(); ++i) {
+        QFile file(files[i]);
+        if(!file.open(QIODevice::ReadOnly)) {
+            printf("%s: cannot read\n", files[i].toStdString().c_str());
+            return 1;
+        }
+        const QByteArray contents = file.readAll();
+
+        PackEntry entry;
+        entry.path = root.relativeFilePath(files[i]).toStdString();
+        entry.size = (unsigned long long)contents.size();
+        entry.compression = PackStored;
+
+        QByteArray data = contents;
+        if(deflate && !hasSuffix(files[i], kStoredSuffixes)) {
+            const QByteArray deflated = qCompress(contents, 9);
+            if(deflated.size() <= contents.size() - contents.size() / 8) {
+                data = deflated;
+                entry.compression = PackDeflated;
+            }
+        }
+
+        if(!pad(out)) break;
+        entry.offset = (unsigned long long)out.tellp();
+        entry.storedSize = (unsigned long long)data.size();
+        out.write(data.constData(), data.size());
+        entries.push_back(entry);
+
+        original += entry.size;
+        stored += entry.storedSize;
+        printf("  %s: %llu -> %llu bytes%s\n", entry.path.c_str(), entry.size, entry.storedSize,
+               entry.compression == PackDeflated ? ", deflated" : "");
+    }
+
+    const unsigned long long indexOffset = (unsigned long long)out.tellp();
+    writePackIndex(out, entries);
+    out.seekp(0);
+    writePackHeader(out, entries.size(), indexOffset);
+    if(!out.good()) {
+        printf("%s: cannot write\n", paths[1].c_str());
+        return 1;
+    }
+
+    printf("%s: %u files, %.1f MB in %.1f MB\n", paths[1].c_str(), (unsigned)entries.size(),
+           original / 1048576.0, stored / 1048576.0);
+    return 0;
+}
@@ -0,0 +1,15 @@
+# Asset archive packer, see main.cpp
+
+CONFIG += release console c++11 thread
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = pack
+INCLUDEPATH += . ../../baseCode
+
+QT += core
+
+HEADERS += ../../baseCode/PackFile.h
+
+SOURCES += main.cpp \
+    ../../baseCode/PackFile.cpp
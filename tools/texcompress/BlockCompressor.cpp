@@ -0,0 +1,182 @@
+#include "BlockCompressor.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+unsigned short packRgb565(const float color[3])
+{
+    const int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+    const int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+    const int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(unsigned short packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+void writeLittle16(unsigned char *out, unsigned int value)
+{
+    out[0] = (unsigned char)(value & 0xff);
+    out[1] = (unsigned char)(value >> 8);
+}
+
+// 8 bytes: two 565 endpoints and 16 2-bit indices, always in four color mode
+void encodeColorBlock(const unsigned char block[16][4], unsigned char *out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for(int i = 0; i < 16; ++i)
+        for(int k = 0; k < 3; ++k) mean[k] += block[i][k] / 16.0f;
+
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };   // xx xy xz yy yz zz
+    for(int i = 0; i < 16; ++i) {
+        const float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for(int iteration = 0; iteration < 8; ++iteration) {
+        const float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        const float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if(length < 1e-6f) break;   // flat block, any axis will do
+        for(int k = 0; k < 3; ++k) axis[k] = next[k] / length;
+    }
+
+    float lo = 0.0f, hi = 0.0f;
+    for(int i = 0; i < 16; ++i) {
+        const float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+
+    const float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float high[3], low[3];
+    for(int k = 0; k < 3; ++k) {
+        high[k] = mean[k] + axis[k] * hi / std::max(axisLength2, 1e-12f);
+        low[k] = mean[k] + axis[k] * lo / std::max(axisLength2, 1e-12f);
+    }
+
+    unsigned short color0 = packRgb565(high);
+    unsigned short color1 = packRgb565(low);
+    if(color0 < color1) std::swap(color0, color1);
+
+    int palette[4][3];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for(int k = 0; k < 3; ++k) {
+        palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+    }
+
+    unsigned int indices = 0;
+    if(color0 != color1) {
+        for(int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = 1 << 30;
+            for(int p = 0; p < 4; ++p) {
+                int distance = 0;
+                for(int k = 0; k < 3; ++k) distance += (block[i][k] - palette[p][k]) * (block[i][k] - palette[p][k]);
+                if(distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (unsigned int)best << (2 * i);
+        }
+    }
+
+    writeLittle16(out, color0);
+    writeLittle16(out + 2, color1);
+    writeLittle16(out + 4, indices & 0xffff);
+    writeLittle16(out + 6, indices >> 16);
+}
+
+// 8 bytes: two alpha endpoints and 16 3-bit indices, in eight value mode
+void encodeAlphaBlock(const unsigned char block[16][4], unsigned char *out)
+{
+    int alpha0 = 0, alpha1 = 255;
+    for(int i = 0; i < 16; ++i) {
+        alpha0 = std::max(alpha0, (int)block[i][3]);
+        alpha1 = std::min(alpha1, (int)block[i][3]);
+    }
+
+    int palette[8] = { alpha0, alpha1 };
+    for(int p = 1; p < 7; ++p) palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+
+    unsigned long long indices = 0;
+    if(alpha0 != alpha1) {
+        for(int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = 256;
+            for(int p = 0; p < 8; ++p) {
+                const int distance = std::abs(block[i][3] - palette[p]);
+                if(distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (unsigned long long)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)alpha0;
+    out[1] = (unsigned char)alpha1;
+    for(int i = 0; i < 6; ++i) out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+}
+
+size_t compressedSize(int width, int height, bool alpha)
+{
+    const size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (alpha ? 16 : 8);
+}
+
+void compressImage(const unsigned char *rgba, int width, int height, bool alpha,
+                   std::vector<unsigned char> &out)
+{
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const size_t blockBytes = alpha ? 16 : 8;
+    out.resize(compressedSize(width, height, alpha));
+
+    parallelFor(blocksHigh, 4, [&](size_t begin, size_t end) {
+        unsigned char block[16][4];
+        for(size_t by = begin; by < end; ++by) {
+            for(int bx = 0; bx < blocksWide; ++bx) {
+                // Edge blocks repeat the last row and column
+                for(int y = 0; y < 4; ++y)
+                    for(int x = 0; x < 4; ++x) {
+                        const int sx = std::min(4 * bx + x, width - 1);
+                        const int sy = std::min(4 * (int)by + y, height - 1);
+                        memcpy(block[4 * y + x], rgba + 4 * ((size_t)sy * width + sx), 4);
+                    }
+
+                unsigned char *target = &out[(by * blocksWide + bx) * blockBytes];
+                if(alpha) {
+                    encodeAlphaBlock(block, target);
+                    target += 8;
+                }
+                encodeColorBlock(block, target);
+            }
+        }
+    });
+}
@@ -0,0 +1,20 @@
+#ifndef BLOCKCOMPRESSOR_H
+#define BLOCKCOMPRESSOR_H
+
+#include <vector>
+
+/*
+ * BC1 (DXT1) and BC3 (DXT5) encoders, range fit: the endpoints of each
+ * 4x4 block are the extremes of its colors along their principal axis.
+ * Not the best quality an encoder can reach, but fast and robust.
+ */
+
+// Bytes of the compressed image: 8 (BC1) or 16 (BC3) per 4x4 block
+size_t compressedSize(int width, int height, bool alpha);
+
+// Compresses an RGBA image (4 bytes per pixel, rows packed) into BC3 when
+// alpha is true, BC1 otherwise. Block rows are encoded in parallel.
+void compressImage(const unsigned char *rgba, int width, int height, bool alpha,
+                   std::vector<unsigned char> &out);
+
+#endif // BLOCKCOMPRESSOR_H
@@ -0,0 +1,112 @@
+/*
+ * texcompress: encodes images, with their mip chain, to BC1 or BC3 in a KTX
+ * file next to the source (images/moon.png -> images/moon.ktx). Texture
+ * loads the .ktx instead of decoding the image when it finds one.
+ *
+ *   texcompress [--bc1 | --bc3] image...
+ *
+ * Without option, images with transparent pixels go to BC3, others to BC1.
+ */
+
+#include <QImage>
+#include <QString>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "KtxFile.h"
+#include "MipChain.h"
+
+namespace {
+
+enum Format { Automatic, ForceBc1, ForceBc3 };
+
+std::string ktxPath(const std::string &path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    const size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + ".ktx";
+    return path.substr(0, dot) + ".ktx";
+}
+
+bool compressFile(const std::string &path, Format format)
+{
+    QImage image;
+    if(!image.load(QString::fromStdString(path))) {
+        printf("%s: cannot read\n", path.c_str());
+        return false;
+    }
+    image = image.convertToFormat(QImage::Format_ARGB32);
+
+    const int width = image.width();
+    const int height = image.height();
+
+    // RGBA bytes, top row first like the runtime upload (the loaders flip V)
+    std::vector<unsigned char> rgba(4 * (size_t)width * height);
+    bool transparent = false;
+    for(int y = 0; y < height; ++y) {
+        const QRgb *line = (const QRgb*)image.constScanLine(y);
+        unsigned char *out = &rgba[4 * (size_t)y * width];
+        for(int x = 0; x < width; ++x) {
+            out[4 * x] = (unsigned char)qRed(line[x]);
+            out[4 * x + 1] = (unsigned char)qGreen(line[x]);
+            out[4 * x + 2] = (unsigned char)qBlue(line[x]);
+            out[4 * x + 3] = (unsigned char)qAlpha(line[x]);
+            transparent = transparent || qAlpha(line[x]) != 255;
+        }
+    }
+
+    const bool alpha = format == ForceBc3 || (format == Automatic && transparent);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<MipLevel> mips;
+    buildMipChain(&rgba[0], width, height, mips);
+
+    std::vector<std::vector<unsigned char> > levels(mips.size() + 1);
+    compressImage(&rgba[0], width, height, alpha, levels[0]);
+    for(size_t i = 0; i < mips.size(); ++i)
+        compressImage(&mips[i].pixels[0], mips[i].width, mips[i].height, alpha, levels[i + 1]);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const std::string output = ktxPath(path);
+    const GLenum internalFormat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if(!writeKtx(output, internalFormat, alpha ? GL_RGBA : GL_RGB, width, height, levels)) {
+        printf("%s: cannot write\n", output.c_str());
+        return false;
+    }
+
+    size_t bytes = 0;
+    for(size_t i = 0; i < levels.size(); ++i) bytes += levels[i].size();
+    printf("%s: %dx%d, %u levels, %s, %.1f KB (%.1f KB as RGBA8), %.2f s\n",
+           output.c_str(), width, height, (unsigned int)levels.size(), alpha ? "BC3" : "BC1",
+           bytes / 1024.0, rgba.size() * 4.0 / 3.0 / 1024.0, seconds);
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Format format = Automatic;
+    int failures = 0, files = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--bc1") == 0) format = ForceBc1;
+        else if(strcmp(argv[i], "--bc3") == 0) format = ForceBc3;
+        else {
+            ++files;
+            if(!compressFile(argv[i], format)) ++failures;
+        }
+    }
+
+    if(files == 0) {
+        printf("usage: %s [--bc1 | --bc3] image...\n", argv[0]);
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
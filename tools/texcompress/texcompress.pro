@@ -0,0 +1,21 @@
+# Offline texture compressor, see main.cpp
+
+CONFIG += release console c++11 thread
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = texcompress
+INCLUDEPATH += . ../../baseCode
+
+QT += core gui opengl
+
+HEADERS += BlockCompressor.h \
+    ../../baseCode/KtxFile.h \
+    ../../baseCode/MipChain.h \
+    ../../baseCode/Parallel.h
+
+SOURCES += main.cpp \
+    BlockCompressor.cpp \
+    ../../baseCode/KtxFile.cpp \
+    ../../baseCode/MipChain.cpp \
+    ../../baseCode/Parallel.cpp
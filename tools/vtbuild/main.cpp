@@ -0,0 +1,218 @@
+/*
+ * vtbuild: cuts an image, with its mip levels, into the tiles of a virtual
+ * texture, in a .vtex file next to the source (images/train1.jpg ->
+ * images/train1.vtex). CCanvas streams the big planet from it when it
+ * finds one.
+ *
+ *   vtbuild [--tile N] [--clamp] image...
+ *
+ * Tiles hold N x N texels (254 by default, so that they take 256 x 256 with
+ * their one texel border). Borders wrap around horizontally, like the
+ * longitudes of a planet map, unless --clamp is given.
+ *
+ * Formats that can decode part of an image (JPEG) are read one row of
+ * tiles at a time, so images too large for a QImage can be tiled; the
+ * others are decoded whole.
+ */
+
+#include <QImage>
+#include <QImageReader>
+#include <QString>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "MipChain.h"
+#include "Parallel.h"
+#include "VtexFile.h"
+
+namespace {
+
+// Row y of a level, as 32 bit ARGB words
+typedef std::function<const unsigned int*(int y)> RowSource;
+
+struct Level {
+    int width;
+    int height;
+    std::vector<unsigned int> pixels;
+};
+
+std::string vtexPath(const std::string &path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    const size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + ".vtex";
+    return path.substr(0, dot) + ".vtex";
+}
+
+// Writes the tiles of row ty of a width x height level, borders included
+void writeTileRow(std::ofstream &out, const VtexHeader &header, int width, int height, int ty,
+                  const RowSource &row, bool wrap)
+{
+    const int tileSize = header.tileSize;
+    const int border = header.border;
+    const int side = tileSize + 2 * border;
+    const int tilesX = (width + tileSize - 1) / tileSize;
+
+    std::vector<unsigned int> tiles((size_t)tilesX * side * side);
+    parallelFor(tilesX, 1, [&](size_t begin, size_t end) {
+        for(size_t tx = begin; tx < end; ++tx) {
+            unsigned int *tile = &tiles[tx * side * side];
+            for(int j = 0; j < side; ++j) {
+                const unsigned int *src = row(std::min(std::max(ty * tileSize - border + j, 0), height - 1));
+                for(int i = 0; i < side; ++i) {
+                    int x = (int)tx * tileSize - border + i;
+                    x = wrap ? (x % width + width) % width : std::min(std::max(x, 0), width - 1);
+                    tile[j * side + i] = src[x];
+                }
+            }
+        }
+    });
+    out.write((const char*)&tiles[0], tiles.size() * sizeof(unsigned int));
+}
+
+bool readRows(const std::string &path, int width, int y, int rows, QImage &image)
+{
+    QImageReader reader(QString::fromStdString(path));
+    reader.setClipRect(QRect(0, y, width, rows));
+    if(!reader.read(&image)) return false;
+    if(image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_RGB32)
+        image = image.convertToFormat(QImage::Format_ARGB32);
+    return true;
+}
+
+bool tileFile(const std::string &path, int tileSize, bool wrap)
+{
+    QImageReader reader(QString::fromStdString(path));
+    const int width = reader.size().width();
+    const int height = reader.size().height();
+    if(width <= 0 || height <= 0) {
+        printf("%s: cannot read\n", path.c_str());
+        return false;
+    }
+
+    QImage whole;
+    const bool bands = reader.supportsOption(QImageIOHandler::ClipRect);
+    if(!bands && !readRows(path, width, 0, height, whole)) {
+        printf("%s: cannot decode\n", path.c_str());
+        return false;
+    }
+
+    VtexHeader header;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.border = 1;
+    header.levels = vtexLevelCount(width, height, tileSize);
+
+    const std::string output = vtexPath(path);
+    std::ofstream out(output.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out.is_open() || !writeVtexHeader(out, header)) {
+        printf("%s: cannot write\n", output.c_str());
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Level 0, a row of tiles at a time, filtering level 1 on the way
+    Level next;
+    next.width = std::max(1, width / 2);
+    next.height = std::max(1, height / 2);
+    if(header.levels > 1) next.pixels.resize((size_t)next.width * next.height);
+
+    for(int ty = 0; ty < vtexTilesY(header, 0); ++ty) {
+        const int first = std::max(0, ty * tileSize - header.border);
+        const int last = std::min(height, (ty + 1) * tileSize + header.border);
+
+        QImage band;
+        int bandStart = 0;
+        if(bands) {
+            if(!readRows(path, width, first, last - first, band)) {
+                printf("%s: cannot decode rows %d to %d\n", path.c_str(), first, last);
+                return false;
+            }
+            bandStart = first;
+        } else {
+            band = whole;
+        }
+
+        const RowSource row = [&](int y) { return (const unsigned int*)band.constScanLine(y - bandStart); };
+        writeTileRow(out, header, width, height, ty, row, wrap);
+
+        if(header.levels > 1) {
+            // Tiles are an even number of rows, the pairs never straddle two bands
+            const int y = ty * tileSize;
+            const int rows = std::min(height, y + tileSize) - y;
+            const int halfRows = std::min(next.height - y / 2, std::max(1, rows / 2));
+            std::vector<unsigned int> half((size_t)next.width * std::max(1, rows / 2));
+            downsampleBox(band.constScanLine(y - bandStart), width, rows, (unsigned char*)&half[0]);
+            if(halfRows > 0) std::copy(half.begin(), half.begin() + (size_t)halfRows * next.width,
+                                       next.pixels.begin() + (size_t)(y / 2) * next.width);
+        }
+    }
+    whole = QImage();
+
+    for(int level = 1; level < header.levels; ++level) {
+        Level current;
+        current.width = next.width;
+        current.height = next.height;
+        current.pixels.swap(next.pixels);
+
+        const RowSource row = [&](int y) { return &current.pixels[(size_t)y * current.width]; };
+        for(int ty = 0; ty < vtexTilesY(header, level); ++ty)
+            writeTileRow(out, header, current.width, current.height, ty, row, wrap);
+
+        if(level + 1 < header.levels) {
+            next.width = std::max(1, current.width / 2);
+            next.height = std::max(1, current.height / 2);
+            next.pixels.resize((size_t)next.width * next.height);
+            downsampleBox((const unsigned char*)&current.pixels[0], current.width, current.height,
+                          (unsigned char*)&next.pixels[0]);
+        }
+    }
+
+    if(!out.good()) {
+        printf("%s: cannot write\n", output.c_str());
+        return false;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const unsigned long long bytes = vtexTileOffset(header, header.levels - 1, 0, 0) + vtexTileBytes(header);
+    printf("%s: %dx%d, %d levels of %dx%d tiles, %.1f MB, %.2f s\n",
+           output.c_str(), width, height, header.levels, tileSize, tileSize, bytes / 1048576.0, seconds);
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int tileSize = 254;
+    bool wrap = true;
+    int failures = 0, files = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            // Even, so that the rows of a tile downsample on their own
+            tileSize = std::max(16, atoi(argv[++i]) & ~1);
+        } else if(strcmp(argv[i], "--clamp") == 0) {
+            wrap = false;
+        } else {
+            ++files;
+            if(!tileFile(argv[i], tileSize, wrap)) ++failures;
+        }
+    }
+
+    if(files == 0) {
+        printf("usage: %s [--tile N] [--clamp] image...\n", argv[0]);
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
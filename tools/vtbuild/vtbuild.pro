@@ -0,0 +1,19 @@
+# Virtual texture tiler, see main.cpp
+
+CONFIG += release console c++11 thread
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = vtbuild
+INCLUDEPATH += . ../../baseCode
+
+QT += core gui
+
+HEADERS += ../../baseCode/VtexFile.h \
+    ../../baseCode/MipChain.h \
+    ../../baseCode/Parallel.h
+
+SOURCES += main.cpp \
+    ../../baseCode/VtexFile.cpp \
+    ../../baseCode/MipChain.cpp \
+    ../../baseCode/Parallel.cpp